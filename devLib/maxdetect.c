@@ -44,14 +44,14 @@
 
 static void maxDetectLowHighWait (const int pin)
 {
-  unsigned int timeOut = millis () + 2000 ;
+  unsigned int start = millis () ;
 
   while (digitalRead (pin) == HIGH)
-    if (millis () > timeOut)
+    if ((millis () - start) > 2000)
       return ;
 
   while (digitalRead (pin) == LOW)
-    if (millis () > timeOut)
+    if ((millis () - start) > 2000)
       return ;
 }
 
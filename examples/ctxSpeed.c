@@ -0,0 +1,114 @@
+/*
+ * ctxSpeed.c:
+ *	Compare the cost of digitalWrite () and the _ctx functions, on the
+ *	default context and on a second, independent one.
+ *	Run it with WIRINGPI_SIM=1 to do it all on simulated hardware;
+ *	otherwise the second context is the simulator and the default
+ *	is the real GPIO (via sudo).
+ *
+ * Copyright (c) 2015 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <wiringPi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define	PIN		17		// BCM_GPIO
+#define	COUNT		10000000
+
+
+static void report (const char *name, uint64_t start)
+{
+  printf ("%-40s %6.2f nS\n", name, (double)(nanos () - start) / (2 * COUNT)) ;
+}
+
+
+int main (void)
+{
+  struct wpiContext *def, *ctx ;
+  uint64_t start ;
+  int i, fail = 0 ;
+
+  printf ("Raspberry Pi wiringPi context speed test program\n") ;
+  printf ("================================================\n\n") ;
+
+  if (wiringPiSetupGpio () != 0)
+    return 1 ;
+
+  def = wiringPiContextDefault () ;
+
+  if ((ctx = wiringPiContextCreate (WPI_MODE_GPIO, "sim")) == NULL)
+  {
+    fprintf (stderr, "Unable to create a simulator context\n") ;
+    return 1 ;
+  }
+
+  pinMode     (PIN, OUTPUT) ;
+  pinMode_ctx (ctx, PIN, OUTPUT) ;
+
+  start = nanos () ;
+  for (i = 0 ; i < COUNT ; ++i)
+  {
+    digitalWrite (PIN, HIGH) ;
+    digitalWrite (PIN, LOW) ;
+  }
+  report ("digitalWrite ()", start) ;
+
+  start = nanos () ;
+  for (i = 0 ; i < COUNT ; ++i)
+  {
+    digitalWrite_ctx (def, PIN, HIGH) ;
+    digitalWrite_ctx (def, PIN, LOW) ;
+  }
+  report ("digitalWrite_ctx (default)", start) ;
+
+  start = nanos () ;
+  for (i = 0 ; i < COUNT ; ++i)
+  {
+    digitalWrite_ctx (ctx, PIN, HIGH) ;
+    digitalWrite_ctx (ctx, PIN, LOW) ;
+  }
+  report ("digitalWrite_ctx (second simulator)", start) ;
+
+// The two contexts must not see each other's writes
+
+  digitalWrite     (PIN, LOW) ;
+  digitalWrite_ctx (ctx, PIN, HIGH) ;
+  delay (10) ;
+
+  if (digitalRead_ctx (ctx, PIN) != HIGH)
+  {
+    printf ("\nSecond context didn't go high\n") ;
+    fail = 1 ;
+  }
+  if (digitalRead (PIN) != LOW)
+  {
+    printf ("\nDefault context was changed by the second one\n") ;
+    fail = 1 ;
+  }
+
+  wiringPiContextDestroy (ctx) ;
+
+  printf ("\n%s\n", fail ? "FAIL" : "OK") ;
+
+  return fail ;
+}
@@ -0,0 +1,146 @@
+/*
+ * edgeLog.c:
+ *	Shared by the softPwm, softTone and softServo test programs: a
+ *	pretend expansion module that notes down every write, and a check
+ *	on the simulator that edges due together went out together.
+ *
+ * Copyright (c) 2015 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <wiringPi.h>
+#include <wiringPiSim.h>
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "edgeLog.h"
+
+struct edge  edges [MAX_EDGES] ;
+volatile int numEdges  = 0 ;
+volatile int recording = 0 ;
+
+
+/*
+ * recordWrite:
+ *	The module's digitalWrite: note it down
+ *********************************************************************************
+ */
+
+static void recordWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  if (recording && (numEdges < MAX_EDGES))
+  {
+    edges [numEdges].pin   = pin ;
+    edges [numEdges].value = value ;
+    edges [numEdges].ns    = nanos () ;
+    ++numEdges ;
+  }
+}
+
+
+/*
+ * edgeLogNode:
+ *	Add the module, so we can see exactly what got written to its pins
+ *	and when - on anything, with or without real (or simulated) GPIO.
+ *	Being an expansion module, its pins are written one at a time.
+ *********************************************************************************
+ */
+
+void edgeLogNode (int pinBase, int numPins)
+{
+  struct wiringPiNodeStruct *node ;
+
+  node = wiringPiNewNode (pinBase, numPins) ;
+  node->digitalWrite = recordWrite ;
+}
+
+
+/*
+ * edgeLogMerged:
+ *	For on-board pins (BCM_GPIO 0-31, as a mask) that should all change
+ *	at the same instants: watch the simulator's output latch for mS
+ *	milliseconds and check they always changed together. The simulator
+ *	records every bank write that changes the latch as an event of its
+ *	own, so pins written separately show up as changes to only some of
+ *	them, however close together the writes were.
+ *	Returns 0 if they did, 1 if not (or if we're not on the simulator).
+ *********************************************************************************
+ */
+
+int edgeLogMerged (uint32_t mask, unsigned int mS)
+{
+  struct wpiSim *sim ;
+  struct wpiSimEvent events [64] ;
+  uint32_t last = 0, changed ;
+  unsigned int start, next = 0 ;
+  int count, i, seen = 0, together = 0, split = 0, lost = 0 ;
+
+  if ((sim = wiringPiSim ()) == NULL)
+  {
+    printf ("  Not on the simulator (WIRINGPI_SIM=1)\n") ;
+    return 1 ;
+  }
+
+  wiringPiSimSync (sim) ;
+  while (wiringPiSimEvents (sim, events, 64) > 0)	// Only what happens from now
+    ;
+
+// Keep reading them, as the simulator only keeps the last lot. If it
+//	did drop some, start again from the next latch value we see.
+
+  start = millis () ;
+  do
+  {
+    delay (1) ;
+
+    while ((count = wiringPiSimEvents (sim, events, 64)) > 0)
+      for (i = 0 ; i < count ; ++i)
+      {
+	if (seen && (events [i].seq != next))
+	{
+	  ++lost ;
+	  seen = 0 ;
+	}
+	next = events [i].seq + 1 ;
+
+	if ((events [i].type != WPI_SIM_LATCH) || (events [i].reg != 0))
+	  continue ;
+
+	if (seen)
+	{
+	  changed = (events [i].value ^ last) & mask ;
+	  /**/ if (changed == mask)
+	    ++together ;
+	  else if (changed != 0)
+	    ++split ;
+	}
+	last = events [i].value ;
+	seen = 1 ;
+      }
+  }
+  while ((millis () - start) < mS) ;
+
+  printf ("  %d changes to all the pins at once, %d to only some of them", together, split) ;
+  if (lost > 0)
+    printf (" (missed events %d times)", lost) ;
+  printf ("\n") ;
+
+  return ((together > 0) && (split == 0)) ? 0 : 1 ;
+}
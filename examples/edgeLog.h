@@ -0,0 +1,43 @@
+/*
+ * edgeLog.h:
+ *	Shared by the softPwm, softTone and softServo test programs: a
+ *	pretend expansion module that notes down every write, and a check
+ *	on the simulator that edges due together went out together.
+ *
+ * Copyright (c) 2015 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <stdint.h>
+
+#define	MAX_EDGES	20000
+
+struct edge
+{
+  int      pin ;
+  int      value ;
+  uint64_t ns ;				// nanos () when it was written
+} ;
+
+extern struct edge  edges [MAX_EDGES] ;
+extern volatile int numEdges ;
+extern volatile int recording ;		// Only note them down while set
+
+extern void edgeLogNode   (int pinBase, int numPins) ;
+extern int  edgeLogMerged (uint32_t mask, unsigned int mS) ;
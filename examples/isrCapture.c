@@ -0,0 +1,86 @@
+/*
+ * isrCapture.c:
+ *	Wait for Interrupt test program - event capture method
+ *
+ *	As isr.c, but rather than counting in globals, every edge on pins
+ *	0-7 is queued up with its level and timestamp, and we read them in
+ *	batches. Nothing is lost unless the ring fills up, and then we know.
+ *
+ *	How to test:
+ *	  Compile & run this program (via sudo), then in another terminal:
+ *		gpio mode 0 up
+ *		gpio mode 0 down
+ *	at which point it should report the edges.
+ *
+ * Copyright (c) 2015 Gordon Henderson.
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <wiringPi.h>
+
+#define	RING_SIZE	1024
+#define	BATCH		  64
+
+
+int main (void)
+{
+  struct wpiEventRing *ring ;
+  struct wpiEdgeEvent events [BATCH] ;
+  unsigned int lost, lastLost = 0 ;
+  uint64_t lastNs = 0 ;
+  int pin, count, i ;
+
+  wiringPiSetup () ;
+
+  if ((ring = wpiEventRingCreate (RING_SIZE)) == NULL)
+  {
+    fprintf (stderr, "Unable to create the event ring\n") ;
+    return 1 ;
+  }
+
+  for (pin = 0 ; pin < 8 ; ++pin)
+    wiringPiISRCapture (pin, INT_EDGE_BOTH, ring) ;
+
+  for (;;)
+  {
+    printf ("Waiting ... ") ; fflush (stdout) ;
+    (void)wpiEventRingWait (ring, -1) ;
+    printf ("\n") ;
+
+    while ((count = wpiEventRingRead (ring, events, BATCH)) > 0)
+      for (i = 0 ; i < count ; ++i)
+      {
+	printf ("  Pin %d: %-7s -> %d  #%-5u  +%8.3f mS\n", events [i].pin,
+		events [i].edge == INT_EDGE_RISING ? "rising" : "falling",
+		events [i].level, events [i].seq,
+		lastNs == 0 ? 0.0 : (double)(events [i].ns - lastNs) / 1000000.0) ;
+	lastNs = events [i].ns ;
+      }
+
+    if ((lost = wpiEventRingOverflows (ring)) != lastLost)
+    {
+      printf ("  ** %u events lost - ring full\n", lost - lastLost) ;
+      lastLost = lost ;
+    }
+  }
+
+  return 0 ;
+}
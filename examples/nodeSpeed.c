@@ -0,0 +1,86 @@
+/*
+ * nodeSpeed.c:
+ *	Measure the cost of dispatching to extension module nodes as
+ *	more and more of them are added. It should stay flat.
+ *	No hardware is needed - the nodes are all dummies.
+ *
+ * Copyright (c) 2015 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <wiringPi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#define	COUNT		10000000
+#define	PINS_PER_NODE	      16
+#define	PIN_BASE	     100
+#define	MAX_NODES	     256
+
+
+/*
+ * nodeTest:
+ *	Time COUNT digitalWrites to the given pin, returning nS per call
+ *********************************************************************************
+ */
+
+static double nodeTest (int pin)
+{
+  struct timeval tStart, tEnd ;
+  double uSecs ;
+  int count ;
+
+  gettimeofday (&tStart, NULL) ;
+  for (count = 0 ; count < COUNT ; ++count)
+    digitalWrite (pin, count & 1) ;
+  gettimeofday (&tEnd, NULL) ;
+
+  uSecs = (tEnd.tv_sec - tStart.tv_sec) * 1000000.0 + (tEnd.tv_usec - tStart.tv_usec) ;
+
+  return uSecs * 1000.0 / COUNT ;
+}
+
+
+int main (void)
+{
+  int nodes, next ;
+
+  printf ("Raspberry Pi wiringPi node dispatch speed test program\n") ;
+  printf ("======================================================\n\n") ;
+
+  printf ("Nodes | First node | Last node\n") ;
+  printf ("------+------------+----------\n") ;
+
+  next = 0 ;
+  for (nodes = 1 ; nodes <= MAX_NODES ; nodes *= 2)
+  {
+    for ( ; next < nodes ; ++next)
+      (void)wiringPiNewNode (PIN_BASE + next * PINS_PER_NODE, PINS_PER_NODE) ;
+
+// The first node added is at the end of the list, the last is at the front
+
+    printf ("%5d | %7.2f nS | %6.2f nS\n", nodes,
+	nodeTest (PIN_BASE), nodeTest (PIN_BASE + (nodes - 1) * PINS_PER_NODE)) ;
+    fflush (stdout) ;
+  }
+
+  return 0 ;
+}
@@ -0,0 +1,210 @@
+/*
+ * patternTest.c:
+ *	Check the pattern player against the simulated hardware: play a
+ *	2-bit gray code on BCM_GPIO 17 & 18 in each of the modes, then
+ *	make sure the simulator saw every step, in order, and report how
+ *	late the steps were.
+ *	Run it with WIRINGPI_SIM=1 in the environment (it sets that itself
+ *	if it's not there). Exits non-zero on failure.
+ *
+ * Copyright (c) 2015 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+
+#include <wiringPi.h>
+#include <wiringPiSim.h>
+#include <wiringPiPattern.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define	PIN_A		17
+#define	PIN_B		18
+#define	STEPS		 8
+#define	STEP_TIME	200000		// nS
+#define	LOOPS		 5
+#define	BUFFERS		 6
+
+static const uint32_t gray [STEPS] = { 1, 3, 2, 0, 1, 3, 2, 0 } ;
+
+static struct wpiPatternStep steps [STEPS] ;
+static uint32_t late [STEPS] ;
+
+
+/*
+ * makeSteps:
+ *	Build the pattern once, up-front
+ *********************************************************************************
+ */
+
+static void makeSteps (void)
+{
+  int i ;
+
+  for (i = 0 ; i < STEPS ; ++i)
+  {
+    steps [i].offset      = (uint64_t)i * STEP_TIME ;
+    steps [i].setMask [0] = ((gray [i] & 1) ? (1 << PIN_A) : 0) | ((gray [i] & 2) ? (1 << PIN_B) : 0) ;
+    steps [i].clrMask [0] = ((gray [i] & 1) ? 0 : (1 << PIN_A)) | ((gray [i] & 2) ? 0 : (1 << PIN_B)) ;
+    steps [i].setMask [1] = steps [i].clrMask [1] = 0 ;
+  }
+}
+
+
+/*
+ * reset:
+ *	Both pins low, and forget what the simulator has seen so far.
+ *	One bank write, so it's a single change to the latch.
+ *********************************************************************************
+ */
+
+static void reset (void)
+{
+  struct wpiSimEvent events [64] ;
+
+  digitalWriteBank (0, 0, (1 << PIN_A) | (1 << PIN_B)) ;
+
+  while (wiringPiSimEvents (wiringPiSim (), events, 64) > 0)
+    ;
+}
+
+
+/*
+ * simSteps:
+ *	Go through what the simulator saw since last time and count the
+ *	changes to our pins, and how many of them weren't the next step of
+ *	the gray code.
+ *********************************************************************************
+ */
+
+static int simSteps (int *bad)
+{
+  struct wpiSimEvent events [64] ;
+  uint32_t value ;
+  int count, i, seen = 0 ;
+
+  *bad = 0 ;
+
+  while ((count = wiringPiSimEvents (wiringPiSim (), events, 64)) > 0)
+    for (i = 0 ; i < count ; ++i)
+    {
+      if ((events [i].type != WPI_SIM_LATCH) || (events [i].reg != 0))
+	continue ;
+
+      value = ((events [i].value >> PIN_A) & 1) | (((events [i].value >> PIN_B) & 1) << 1) ;
+      if (value != gray [seen % STEPS])
+	++*bad ;
+      ++seen ;
+    }
+
+  return seen ;
+}
+
+
+/*
+ * check:
+ *	Make sure the simulator saw passes lots of the pattern, and print
+ *	the stats.
+ *********************************************************************************
+ */
+
+static int check (const char *name, struct wpiPattern *pattern, int passes)
+{
+  struct wpiPatternStats stats ;
+  int seen, bad ;
+
+  seen = simSteps (&bad) ;
+  wpiPatternStats (pattern, &stats) ;
+
+  printf ("%-10s %3d steps seen (%3d expected), %d wrong.  Late: mean %7.1f uS, max %7.1f uS, %u underruns\n",
+	name, seen, passes * STEPS, bad,
+	stats.steps == 0 ? 0.0 : (double)stats.totalLate / stats.steps / 1000.0,
+	(double)stats.maxLate / 1000.0, stats.underruns) ;
+
+  return ((seen == passes * STEPS) && (bad == 0)) ? 0 : 1 ;
+}
+
+
+int main (void)
+{
+  struct wpiPattern *pattern ;
+  struct wpiPatternStats stats ;
+  int fails = 0, seen, bad, i ;
+
+  printf ("Raspberry Pi wiringPi pattern player test program\n") ;
+  printf ("=================================================\n\n") ;
+
+  setenv ("WIRINGPI_SIM", "1", 0) ;
+
+  wiringPiSetupGpio () ;
+  if (wiringPiSim () == NULL)
+  {
+    fprintf (stderr, "Not running on the simulated hardware\n") ;
+    return 1 ;
+  }
+
+  pinMode (PIN_A, OUTPUT) ;
+  pinMode (PIN_B, OUTPUT) ;
+  reset () ;
+
+  makeSteps () ;
+
+// One-shot
+
+  pattern = wpiPatternStart (WPI_PATTERN_ONESHOT, steps, STEPS, 0, late) ;
+  wpiPatternWait (pattern, -1) ;
+  fails += check ("One-shot:", pattern, 1) ;
+  wpiPatternStop (pattern) ;
+
+  printf ("  Each step: ") ;
+  for (i = 0 ; i < STEPS ; ++i)
+    printf (" %6.1f", (double)late [i] / 1000.0) ;
+  printf (" uS late\n") ;
+
+// Loop: Let it go round a few times, then stop it wherever it's got to
+
+  pattern = wpiPatternStart (WPI_PATTERN_LOOP, steps, STEPS, STEPS * STEP_TIME, NULL) ;
+  do
+  {
+    delay (1) ;
+    wpiPatternStats (pattern, &stats) ;
+  } while (stats.passes < LOOPS) ;
+  wpiPatternStop (pattern) ;
+
+  seen = simSteps (&bad) ;
+  printf ("%-10s %3d steps seen (%3d+ expected), %d wrong\n", "Loop:", seen, LOOPS * STEPS, bad) ;
+  if ((seen < LOOPS * STEPS) || (bad != 0))
+    ++fails ;
+  reset () ;
+
+// Stream: The same buffer, over and over
+
+  pattern = wpiPatternStart (WPI_PATTERN_STREAM, steps, STEPS, STEPS * STEP_TIME, NULL) ;
+  for (i = 1 ; i < BUFFERS ; ++i)
+    wpiPatternQueue (pattern, steps, STEPS, STEPS * STEP_TIME, NULL) ;
+  wpiPatternWait (pattern, -1) ;
+  fails += check ("Stream:", pattern, BUFFERS) ;
+  wpiPatternStop (pattern) ;
+
+  printf ("\n%s\n", fails == 0 ? "OK" : "FAILED") ;
+
+  return fails == 0 ? 0 : 1 ;
+}
@@ -0,0 +1,113 @@
+/*
+ * periodicTest.c:
+ *	Compare a loop timed with delayMicroseconds () against one timed
+ *	with periodicNext (): the first drifts by however long the loop
+ *	body takes, the second keeps to absolute deadlines.
+ *	No hardware is needed.
+ *
+ * Copyright (c) 2015 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+
+#include <wiringPi.h>
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define	PERIOD		1000		// uS
+#define	LOOPS		2000
+#define	WORK		  50		// uS of "work" in each loop
+
+
+/*
+ * work:
+ *	Busy for a while, like the body of a real loop would be
+ *********************************************************************************
+ */
+
+static void work (void)
+{
+  uint64_t end = nanos () + WORK * 1000 ;
+
+  while (nanos () < end)
+    ;
+}
+
+
+/*
+ * report:
+ *	Print how far each wake-up was from where it should have been
+ *********************************************************************************
+ */
+
+static void report (const char *name, uint64_t start, uint64_t *wakes)
+{
+  int64_t err, minErr = INT64_MAX, maxErr = INT64_MIN, sum = 0 ;
+  int i ;
+
+  for (i = 0 ; i < LOOPS ; ++i)
+  {
+    err = (int64_t)(wakes [i] - start) - (int64_t)(i + 1) * PERIOD * 1000 ;
+    if (err < minErr) minErr = err ;
+    if (err > maxErr) maxErr = err ;
+    sum += err ;
+  }
+
+  printf ("%-20s min: %8.1f uS  max: %8.1f uS  mean: %8.1f uS  drift: %8.1f uS\n", name,
+	(double)minErr / 1000.0, (double)maxErr / 1000.0, (double)sum / LOOPS / 1000.0,
+	(double)(wakes [LOOPS - 1] - start) / 1000.0 - (double)LOOPS * PERIOD) ;
+}
+
+
+int main (void)
+{
+  static uint64_t wakes [LOOPS] ;
+  struct wpiPeriodic state = { 0, 0 } ;
+  uint64_t start ;
+  int i ;
+
+  printf ("Raspberry Pi wiringPi periodic timing test program\n") ;
+  printf ("==================================================\n\n") ;
+
+  printf ("Spin threshold: %u nS\n", delayCalibrate ()) ;
+  printf ("%d loops of %d uS, with %d uS of work in each\n\n", LOOPS, PERIOD, WORK) ;
+
+  start = nanos () ;
+  for (i = 0 ; i < LOOPS ; ++i)
+  {
+    work () ;
+    delayMicroseconds (PERIOD - WORK) ;
+    wakes [i] = nanos () ;
+  }
+  report ("delayMicroseconds:", start, wakes) ;
+
+  start = nanos () ;
+  state.next = start ;
+  for (i = 0 ; i < LOOPS ; ++i)
+  {
+    work () ;
+    (void)periodicNext (&state, PERIOD * 1000) ;
+    wakes [i] = nanos () ;
+  }
+  report ("periodicNext:", start, wakes) ;
+  printf ("  (%u periods overran)\n", state.overruns) ;
+
+  return 0 ;
+}
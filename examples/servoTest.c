@@ -0,0 +1,167 @@
+/*
+ * servoTest.c:
+ *	Drive a dozen servos with softServo and check the pulse widths and
+ *	the frame rate that come out, then see what softServoStats () says.
+ *	Run it with WIRINGPI_SIM=1 to do it on simulated hardware - then it
+ *	also checks that servos with the same width are turned on and off
+ *	together, with one bank write.
+ *
+ * Copyright (c) 2015 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <wiringPi.h>
+#include <softServo.h>
+#include <wiringPiSim.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "edgeLog.h"
+
+// The servos are on a pretend expansion module that notes down the
+//	time of every write (see edgeLog.c)
+
+#define	PIN_BASE	1000
+#define	SERVOS		12
+#define	FRAME		20000		// uS
+#define	RUN_TIME	500		// mS
+
+// On the simulator, a few more on-board pins, all at the same width
+
+#define	FIRST_PIN	4		// BCM_GPIO
+#define	SIM_SERVOS	4
+
+
+/*
+ * check:
+ *	Work out the average pulse width and frame period of a pin and see
+ *	if they're near enough to what we asked for.
+ *********************************************************************************
+ */
+
+static int check (int pin, int width)
+{
+  uint64_t firstRise = 0, lastRise = 0, highTime = 0 ;
+  int i, rises = 0, pulses = 0, level = LOW ;
+  double gotWidth, gotFrame ;
+
+  for (i = 0 ; i < numEdges ; ++i)
+  {
+    if (edges [i].pin != pin)
+      continue ;
+
+    if ((edges [i].value == HIGH) && (level == LOW))
+    {
+      if (rises++ == 0)
+	firstRise = edges [i].ns ;
+      lastRise = edges [i].ns ;
+    }
+    else if ((edges [i].value == LOW) && (level == HIGH) && (rises > 0))
+    {
+      highTime += edges [i].ns - lastRise ;
+      ++pulses ;
+    }
+
+    level = edges [i].value ;
+  }
+
+  if ((rises < 2) || (pulses == 0))
+  {
+    printf ("  Pin %d: only %d frames seen\n", pin, rises) ;
+    return 1 ;
+  }
+
+  gotWidth = (double)highTime / pulses / 1000.0 ;
+  gotFrame = (double)(lastRise - firstRise) / (rises - 1) / 1000.0 ;
+
+  printf ("  %4d uS: got %7.1f uS, frame %8.1f uS over %d frames\n", width, gotWidth, gotFrame, rises - 1) ;
+
+  return ((gotWidth < width - 20) || (gotWidth > width + 20) || (gotFrame < FRAME * 0.99) || (gotFrame > FRAME * 1.01)) ? 1 : 0 ;
+}
+
+
+int main (void)
+{
+  struct softServoStats stats ;
+  int i, fails = 0 ;
+
+  printf ("Raspberry Pi wiringPi softServo test program\n") ;
+  printf ("============================================\n\n") ;
+
+  if (wiringPiSetupGpio () != 0)
+    return 1 ;
+
+  edgeLogNode (PIN_BASE, SERVOS) ;
+
+  softServoFrame (FRAME) ;
+
+// Widths from 750 to 2250 uS, a couple the same
+
+  for (i = 0 ; i < SERVOS ; ++i)
+  {
+    if (softServoAdd (PIN_BASE + i) != 0)
+    {
+      fprintf (stderr, "Unable to add a servo on pin %d\n", PIN_BASE + i) ;
+      return 1 ;
+    }
+    softServoWrite (PIN_BASE + i, -250 + (i / 2) * 300) ;
+  }
+
+  delay (100) ;
+  recording = 1 ;
+  delay (RUN_TIME) ;
+  recording = 0 ;
+
+  for (i = 0 ; i < SERVOS ; ++i)
+    fails += check (PIN_BASE + i, 750 + (i / 2) * 300) ;
+
+  softServoStats (&stats) ;
+
+  printf ("\n%llu frames, %llu skipped, %llu pulses\n",
+	(unsigned long long)stats.frames, (unsigned long long)stats.skipped, (unsigned long long)stats.pulses) ;
+  printf ("Pulse error: average %.1f uS, worst %.1f uS\n",
+	stats.pulses == 0 ? 0.0 : (double)stats.totalError / stats.pulses / 1000.0, (double)stats.maxError / 1000.0) ;
+  printf ("Worst frame start: %.1f uS late\n", (double)stats.maxLate / 1000.0) ;
+
+  for (i = 0 ; i < SERVOS ; ++i)
+    softServoRemove (PIN_BASE + i) ;
+
+  if (wiringPiSim () != NULL)
+  {
+    printf ("\n%d on-board servos, all 1500 uS, on the simulator:\n", SIM_SERVOS) ;
+
+    for (i = 0 ; i < SIM_SERVOS ; ++i)
+    {
+      softServoAdd   (FIRST_PIN + i) ;
+      softServoWrite (FIRST_PIN + i, 500) ;
+    }
+    delay (50) ;
+
+    fails += edgeLogMerged (((1 << SIM_SERVOS) - 1) << FIRST_PIN, RUN_TIME) ;
+
+    for (i = 0 ; i < SIM_SERVOS ; ++i)
+      softServoRemove (FIRST_PIN + i) ;
+  }
+
+  printf ("\n%s\n", fails == 0 ? "OK" : "FAILED") ;
+
+  return fails == 0 ? 0 : 1 ;
+}
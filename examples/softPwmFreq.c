@@ -0,0 +1,132 @@
+/*
+ * softPwmFreq.c:
+ *	softPwm at frequencies of your choosing: show how fast we can go on
+ *	this set-up, then run a couple of channels and sample them to see
+ *	that the duty cycle comes out right.
+ *	Run it with WIRINGPI_SIM=1 to do it on simulated hardware.
+ *
+ * Copyright (c) 2015 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <wiringPi.h>
+#include <softPwm.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "edgeLog.h"
+
+// The channels are on a pretend expansion module that notes down the
+//	time of every write (see edgeLog.c), so we can see exactly what
+//	softPwm did - on anything, with or without real (or simulated) GPIO.
+
+#define	PIN_BASE	1000
+#define	RUN_TIME	200		// mS
+
+static int resolutions [] = { 10, 100, 256, 1000, 4096 } ;
+
+
+/*
+ * check:
+ *	Work out the frequency and duty cycle of a pin from what it was
+ *	sent, and see if they're near enough to what we asked for.
+ *********************************************************************************
+ */
+
+static int check (int pin, int freq, double wantDuty)
+{
+  uint64_t firstRise = 0, lastRise = 0, mark = 0, highTime = 0 ;
+  int i, rises = 0, level = LOW ;
+  double gotFreq, gotDuty ;
+
+// Count the high time of whole periods only: a mark is added in when
+//	the next period starts
+
+  for (i = 0 ; i < numEdges ; ++i)
+  {
+    if (edges [i].pin != pin)
+      continue ;
+
+    if ((edges [i].value == HIGH) && (level == LOW))
+    {
+      if (rises++ == 0)
+	firstRise = edges [i].ns ;
+      highTime += mark ;
+      mark      = 0 ;
+      lastRise  = edges [i].ns ;
+    }
+    else if ((edges [i].value == LOW) && (level == HIGH) && (rises > 0))
+      mark = edges [i].ns - lastRise ;
+
+    level = edges [i].value ;
+  }
+
+  if (rises < 2)
+  {
+    printf ("  Pin %d: only %d periods seen\n", pin, rises) ;
+    return 1 ;
+  }
+
+  gotFreq = (double)(rises - 1) * 1000000000.0 / (double)(lastRise - firstRise) ;
+  gotDuty = 100.0 * (double)highTime / (double)(lastRise - firstRise) ;
+
+  printf ("  %6d Hz, %5.1f%%: got %9.1f Hz, %5.1f%% over %d periods\n",
+	freq, wantDuty, gotFreq, gotDuty, rises - 1) ;
+
+  return ((gotFreq < freq * 0.99) || (gotFreq > freq * 1.01) || (gotDuty < wantDuty - 2.0) || (gotDuty > wantDuty + 2.0)) ? 1 : 0 ;
+}
+
+
+int main (void)
+{
+  int i, fails = 0 ;
+
+  printf ("Raspberry Pi wiringPi softPwm frequency test program\n") ;
+  printf ("====================================================\n\n") ;
+
+  if (wiringPiSetupGpio () != 0)
+    return 1 ;
+
+  printf ("Highest frequency on BCM_GPIO 17, by resolution:\n") ;
+  for (i = 0 ; i < (int)(sizeof (resolutions) / sizeof (resolutions [0])) ; ++i)
+    printf ("  %5d steps: %9d Hz\n", resolutions [i], softPwmMaxFreq (17, resolutions [i])) ;
+  printf ("\n") ;
+
+  edgeLogNode (PIN_BASE, 2) ;
+
+  softPwmCreateFreq (PIN_BASE,     25, 100, 1000) ;
+  softPwmCreateFreq (PIN_BASE + 1, 192, 256, 2000) ;
+
+  delay (10) ;
+  recording = 1 ;
+  delay (RUN_TIME) ;
+  recording = 0 ;
+
+  softPwmStop (PIN_BASE) ;
+  softPwmStop (PIN_BASE + 1) ;
+
+  fails += check (PIN_BASE,     1000, 25.0) ;
+  fails += check (PIN_BASE + 1, 2000, 75.0) ;
+
+  printf ("\n%s\n", fails == 0 ? "OK" : "FAILED") ;
+
+  return fails == 0 ? 0 : 1 ;
+}
@@ -0,0 +1,183 @@
+/*
+ * softPwmLoad.c:
+ *	Run a lot of softPwm channels for a few seconds and see what it
+ *	costs: CPU time, threads and wakeups. Then again with them all
+ *	steady at 0% or 100%, and with the same number of idle softTone
+ *	channels, neither of which should cost anything.
+ *	Run it with WIRINGPI_SIM=1 to do it on simulated hardware - then it
+ *	also checks that channels with their edges at the same time are
+ *	written together, with one bank write.
+ *
+ * Copyright (c) 2015 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <wiringPi.h>
+#include <softPwm.h>
+#include <softTone.h>
+#include <wiringPiSim.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "edgeLog.h"
+
+#define	CHANNELS	16
+#define	FIRST_PIN	 4		// BCM_GPIO
+#define	RANGE		100
+#define	SECONDS		 3
+
+
+/*
+ * procStatus:
+ *	Pull a number out of /proc/self/status
+ *********************************************************************************
+ */
+
+static long procStatus (const char *name)
+{
+  FILE *fd ;
+  char line [128] ;
+  long value = -1 ;
+  size_t len = strlen (name) ;
+
+  if ((fd = fopen ("/proc/self/status", "r")) == NULL)
+    return -1 ;
+
+  while (fgets (line, sizeof (line), fd) != NULL)
+    if ((strncmp (line, name, len) == 0) && (line [len] == ':'))
+    {
+      value = atol (line + len + 1) ;
+      break ;
+    }
+
+  fclose (fd) ;
+  return value ;
+}
+
+
+/*
+ * cpuTime:
+ *	Process CPU time used so far, nS
+ *********************************************************************************
+ */
+
+static uint64_t cpuTime (void)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &ts) ;
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec ;
+}
+
+
+/*
+ * measure:
+ *	Let it run for a while and print what it cost
+ *********************************************************************************
+ */
+
+static void measure (const char *name)
+{
+  struct rusage before, after ;
+  uint64_t cpuStart, start, cpu, wall ;
+  long switches ;
+
+  delay (100) ;		// Let it settle
+
+  getrusage (RUSAGE_SELF, &before) ;
+  cpuStart = cpuTime () ;
+  start    = nanos () ;
+
+  delay (SECONDS * 1000) ;
+
+  wall = nanos () - start ;
+  cpu  = cpuTime () - cpuStart ;
+  getrusage (RUSAGE_SELF, &after) ;
+
+  switches = (after.ru_nvcsw  - before.ru_nvcsw) + (after.ru_nivcsw - before.ru_nivcsw) ;
+
+  printf ("%s\n", name) ;
+  printf ("  Threads:          %ld\n", procStatus ("Threads")) ;
+  printf ("  CPU:              %.1f%%\n", 100.0 * (double)cpu / (double)wall) ;
+  printf ("  Context switches: %.0f/S\n", (double)switches * 1000000000.0 / (double)wall) ;
+}
+
+
+int main (void)
+{
+  char name [80] ;
+  int i, fails = 0 ;
+
+  printf ("Raspberry Pi wiringPi softPwm load test program\n") ;
+  printf ("===============================================\n\n") ;
+
+  if (wiringPiSetupGpio () != 0)
+    return 1 ;
+
+  measure ("Nothing running:") ;
+
+  for (i = 0 ; i < CHANNELS ; ++i)
+    if (softPwmCreate (FIRST_PIN + i, (i * RANGE) / (CHANNELS - 1), RANGE) != 0)
+    {
+      fprintf (stderr, "Unable to create softPwm on pin %d\n", FIRST_PIN + i) ;
+      return 1 ;
+    }
+
+  sprintf (name, "%d softPwm channels, duty 0%% to 100%%, range %d:", CHANNELS, RANGE) ;
+  measure (name) ;
+
+// All the same: every edge is due on every channel at once
+
+  if (wiringPiSim () != NULL)
+  {
+    for (i = 0 ; i < CHANNELS ; ++i)
+      softPwmWrite (FIRST_PIN + i, RANGE / 4) ;
+    delay (50) ;
+
+    printf ("%d softPwm channels, all 25%%, on the simulator:\n", CHANNELS) ;
+    fails += edgeLogMerged (((1 << CHANNELS) - 1) << FIRST_PIN, 500) ;
+  }
+
+  for (i = 0 ; i < CHANNELS ; ++i)
+    softPwmWrite (FIRST_PIN + i, (i & 1) ? RANGE : 0) ;
+
+  sprintf (name, "%d softPwm channels, all 0%% or 100%%:", CHANNELS) ;
+  measure (name) ;
+
+  for (i = 0 ; i < CHANNELS ; ++i)
+  {
+    softPwmStop    (FIRST_PIN + i) ;
+    softToneCreate (FIRST_PIN + i) ;
+  }
+
+  sprintf (name, "%d idle softTone channels:", CHANNELS) ;
+  measure (name) ;
+
+  for (i = 0 ; i < CHANNELS ; ++i)
+    softToneStop (FIRST_PIN + i) ;
+
+  if (wiringPiSim () != NULL)
+    printf ("\n%s\n", fails == 0 ? "OK" : "FAILED") ;
+
+  return fails == 0 ? 0 : 1 ;
+}
@@ -33,7 +33,7 @@
 #define	SLOW_COUNT	 1000000
 #define	PASSES		       5
 
-void speedTest (int pin, int maxCount)
+void speedTest (int pin, struct wpiPinHandle *handle, int maxCount)
 {
   int count, sum, perSec, i ;
   unsigned int start, end ;
@@ -43,8 +43,12 @@ void speedTest (int pin, int maxCount)
   for (i = 0 ; i < PASSES ; ++i)
   {
     start = millis () ;
-    for (count = 0 ; count < maxCount ; ++count)
-      digitalWrite (pin, 1) ;
+    if (handle == NULL)
+      for (count = 0 ; count < maxCount ; ++count)
+	digitalWrite (pin, 1) ;
+    else
+      for (count = 0 ; count < maxCount ; ++count)
+	wpiPinWrite (handle, 1) ;
     end = millis () ;
     printf (" %6d", end - start) ;
     fflush (stdout) ;
@@ -60,6 +64,8 @@ void speedTest (int pin, int maxCount)
 
 int main (void)
 {
+  struct wpiPinHandle handle ;
+
   printf ("Raspberry Pi wiringPi GPIO speed test program\n") ;
   printf ("=============================================\n") ;
 
@@ -68,28 +74,46 @@ int main (void)
   printf ("\nNative wiringPi method: (%8d iterations)\n", FAST_COUNT) ;
   wiringPiSetup () ;
   pinMode (0, OUTPUT) ;
-  speedTest (0, FAST_COUNT) ;
+  speedTest (0, NULL, FAST_COUNT) ;
 
 // GPIO
 
   printf ("\nNative GPIO method: (%8d iterations)\n", FAST_COUNT) ;
   wiringPiSetupGpio () ;
   pinMode (17, OUTPUT) ;
-  speedTest (17, FAST_COUNT) ;
+  speedTest (17, NULL, FAST_COUNT) ;
 
 // Phys
 
   printf ("\nPhysical pin GPIO method: (%8d iterations)\n", FAST_COUNT) ;
   wiringPiSetupPhys () ;
   pinMode (11, OUTPUT) ;
-  speedTest (11, FAST_COUNT) ;
+  speedTest (11, NULL, FAST_COUNT) ;
+
+// Pre-resolved pin handle
+
+  printf ("\nPin handle method: (%8d iterations)\n", FAST_COUNT) ;
+  wpiPinOpen (11, &handle) ;
+  speedTest (11, &handle, FAST_COUNT) ;
 
 // Switch to SYS mode:
 
   system ("/usr/local/bin/gpio export 17 out") ;
   printf ("\n/sys/class/gpio method: (%8d iterations)\n", SLOW_COUNT) ;
   wiringPiSetupSys () ;
-  speedTest (17, SLOW_COUNT) ;
+  speedTest (17, NULL, SLOW_COUNT) ;
+  system ("/usr/local/bin/gpio unexport 17") ;
+
+// Switch to the GPIO character device:
+//	(The pin has to be unexported first - an exported pin is busy as far
+//	as it's concerned)
+
+  printf ("\n/dev/gpiochip method: (%8d iterations)\n", SLOW_COUNT) ;
+  if (wiringPiSetupGpioChip () == 0)
+  {
+    pinMode (17, OUTPUT) ;
+    speedTest (17, NULL, SLOW_COUNT) ;
+  }
 
   return 0 ;
 }
@@ -0,0 +1,102 @@
+/*
+ * timeSpeed.c:
+ *	Measure the cost of a call to each of the wiringPi time functions,
+ *	and the system calls behind them, as these end up inside every
+ *	busy-wait loop.
+ *	No hardware is needed.
+ *
+ * Copyright (c) 2015 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <wiringPi.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
+
+#define	COUNT	5000000
+
+static volatile uint64_t sink ;
+
+static void callMillis   (void) { sink += millis   () ; }
+static void callMicros   (void) { sink += micros   () ; }
+static void callMillis64 (void) { sink += millis64 () ; }
+static void callMicros64 (void) { sink += micros64 () ; }
+static void callNanos    (void) { sink += nanos    () ; }
+
+static void callGettimeofday (void)
+{
+  struct timeval tv ;
+  gettimeofday (&tv, NULL) ;
+  sink += tv.tv_usec ;
+}
+
+static void callMonotonic (void)
+{
+  struct timespec ts ;
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  sink += ts.tv_nsec ;
+}
+
+static void callMonotonicRaw (void)
+{
+  struct timespec ts ;
+  clock_gettime (CLOCK_MONOTONIC_RAW, &ts) ;
+  sink += ts.tv_nsec ;
+}
+
+
+/*
+ * timeTest:
+ *	Time COUNT calls to the function and print nS per call
+ *********************************************************************************
+ */
+
+static void timeTest (const char *name, void (*function)(void))
+{
+  uint64_t start, end ;
+  int count ;
+
+  start = nanos () ;
+  for (count = 0 ; count < COUNT ; ++count)
+    function () ;
+  end = nanos () ;
+
+  printf ("%-30s %7.1f nS\n", name, (double)(end - start) / COUNT) ;
+}
+
+
+int main (void)
+{
+  printf ("Raspberry Pi wiringPi time function speed test program\n") ;
+  printf ("======================================================\n\n") ;
+
+  timeTest ("millis ()",                       callMillis) ;
+  timeTest ("micros ()",                       callMicros) ;
+  timeTest ("millis64 ()",                     callMillis64) ;
+  timeTest ("micros64 ()",                     callMicros64) ;
+  timeTest ("nanos ()",                        callNanos) ;
+  timeTest ("gettimeofday ()",                 callGettimeofday) ;
+  timeTest ("clock_gettime (MONOTONIC)",       callMonotonic) ;
+  timeTest ("clock_gettime (MONOTONIC_RAW)",   callMonotonicRaw) ;
+
+  return 0 ;
+}
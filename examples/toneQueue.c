@@ -0,0 +1,200 @@
+/*
+ * toneQueue.c:
+ *	Queue up a tune on a couple of softTone pins and let them get on
+ *	with it, then check each note came out at the right frequency,
+ *	duty cycle and time.
+ *	Run it with WIRINGPI_SIM=1 to do it on simulated hardware - then it
+ *	also checks that pins with their edges at the same time are written
+ *	together, with one bank write.
+ *
+ * Copyright (c) 2015 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <wiringPi.h>
+#include <softTone.h>
+#include <wiringPiSim.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "edgeLog.h"
+
+// The pins are on a pretend expansion module that notes down the time
+//	of every write (see edgeLog.c)
+
+#define	PIN_BASE	1000
+
+// On the simulator, a few more on-board pins, all playing the same note.
+//	They start on the next mS after they're queued, maybe not all the
+//	same one, so it's a whole number of cycles to the mS.
+
+#define	FIRST_PIN	4		// BCM_GPIO
+#define	SIM_PINS	4
+#define	SIM_FREQ	1000
+#define	SIM_TIME	600		// mS
+
+// The tune: frequency, duration (mS) and duty cycle (%)
+
+struct note
+{
+  int freq, duration, duty ;
+} ;
+
+static struct note tune0 [] =
+{
+  { 1000, 100, 50 }, { 0, 50, 50 }, { 2000, 100, 25 }, { 500, 100, 75 }, { 0, 0, 0 }
+} ;
+
+static struct note tune1 [] =
+{
+  { 1000, 100, 50 }, { 4000, 150, 50 }, { 0, 50, 0 }, { 250, 100, 10 }, { 0, 0, 0 }
+} ;
+
+
+/*
+ * check:
+ *	Go through the edges on a pin, a note at a time, and see that each
+ *	had about the right number of cycles and duty cycle.
+ *********************************************************************************
+ */
+
+static int check (int pin, struct note *tune)
+{
+  uint64_t start, noteStart, noteEnd, lastRise = 0, high ;
+  int i, n, rises, want, level, fails = 0 ;
+  double gotDuty ;
+
+  for (i = 0 ; (i < numEdges) && ((edges [i].pin != pin) || (edges [i].value != HIGH)) ; ++i)
+    ;
+  if (i == numEdges)
+  {
+    printf ("  Pin %d: nothing seen\n", pin) ;
+    return 1 ;
+  }
+  start = edges [i].ns ;
+
+  printf ("  Pin %d:\n", pin) ;
+
+  noteStart = start ;
+  for (n = 0 ; tune [n].duration != 0 ; ++n)
+  {
+    noteEnd = noteStart + (uint64_t)tune [n].duration * 1000000 ;
+    rises   = 0 ;
+    high    = 0 ;
+    level   = LOW ;
+
+    for (i = 0 ; i < numEdges ; ++i)
+    {
+      if ((edges [i].pin != pin) || (edges [i].ns + 20000 < noteStart) || (edges [i].ns + 20000 >= noteEnd))
+	continue ;
+
+      if ((edges [i].value == HIGH) && (level == LOW))
+      {
+	++rises ;
+	lastRise = edges [i].ns ;
+      }
+      else if ((edges [i].value == LOW) && (level == HIGH))
+	high += edges [i].ns - lastRise ;
+
+      level = edges [i].value ;
+    }
+
+    gotDuty = 100.0 * (double)high / (double)(noteEnd - noteStart) ;
+
+    printf ("    %4d Hz, %3d mS, %3d%%: %4d cycles, %5.1f%%\n",
+	tune [n].freq, tune [n].duration, tune [n].duty, rises, gotDuty) ;
+
+    if (tune [n].freq == 0)
+      fails += (rises != 0) ? 1 : 0 ;
+    else		// Cycles we're too late for are skipped: allow a few
+    {
+      want = tune [n].freq * tune [n].duration / 1000 ;
+      if (abs (rises - want) > want / 33 + 1)
+	++fails ;
+      if ((gotDuty < tune [n].duty - 2.0) || (gotDuty > tune [n].duty + 2.0))
+	++fails ;
+    }
+
+    noteStart = noteEnd ;
+  }
+
+  return fails ;
+}
+
+
+int main (void)
+{
+  uint64_t start ;
+  int i, fails = 0 ;
+
+  printf ("Raspberry Pi wiringPi softTone queue test program\n") ;
+  printf ("=================================================\n\n") ;
+
+  if (wiringPiSetupGpio () != 0)
+    return 1 ;
+
+  edgeLogNode (PIN_BASE, 2) ;
+  recording = 1 ;
+
+  softToneCreate (PIN_BASE) ;
+  softToneCreate (PIN_BASE + 1) ;
+  delay (100) ;		// Let the thread get going
+
+// Queue it all up; we're not involved from here on
+
+  for (i = 0 ; tune0 [i].duration != 0 ; ++i)
+    softToneQueue (PIN_BASE, tune0 [i].freq, tune0 [i].duration, tune0 [i].duty) ;
+  for (i = 0 ; tune1 [i].duration != 0 ; ++i)
+    softToneQueue (PIN_BASE + 1, tune1 [i].freq, tune1 [i].duration, tune1 [i].duty) ;
+
+  start = nanos () ;
+  while ((softTonePending (PIN_BASE) > 0) || (softTonePending (PIN_BASE + 1) > 0))
+    delay (10) ;
+
+  printf ("Played in %.0f mS\n\n", (double)(nanos () - start) / 1000000.0) ;
+
+  fails += check (PIN_BASE,     tune0) ;
+  fails += check (PIN_BASE + 1, tune1) ;
+
+  softToneStop (PIN_BASE) ;
+  softToneStop (PIN_BASE + 1) ;
+
+  if (wiringPiSim () != NULL)
+  {
+    printf ("\n%d on-board pins, all %d Hz, on the simulator:\n", SIM_PINS, SIM_FREQ) ;
+
+    for (i = 0 ; i < SIM_PINS ; ++i)
+    {
+      softToneCreate (FIRST_PIN + i) ;
+      softToneQueue  (FIRST_PIN + i, SIM_FREQ, SIM_TIME, 50) ;
+    }
+    delay (50) ;
+
+    fails += edgeLogMerged (((1 << SIM_PINS) - 1) << FIRST_PIN, SIM_TIME - 200) ;
+
+    for (i = 0 ; i < SIM_PINS ; ++i)
+      softToneStop (FIRST_PIN + i) ;
+  }
+
+  printf ("\n%s\n", fails == 0 ? "OK" : "FAILED") ;
+
+  return fails == 0 ? 0 : 1 ;
+}
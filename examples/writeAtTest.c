@@ -0,0 +1,76 @@
+/*
+ * writeAtTest.c:
+ *	Queue up a burst of writes with digitalWriteAt () and see how late
+ *	they went out. Pairs of pins due at the same time should go out as
+ *	one bank write.
+ *	Runs on the simulated hardware (WIRINGPI_SIM=1) if there's no Pi.
+ *
+ * Copyright (c) 2015 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+
+#include <wiringPi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define	PIN_A		17		// BCM_GPIO
+#define	PIN_B		18
+#define	WRITES		1000
+#define	GAP		500000		// nS
+
+
+int main (void)
+{
+  struct wpiTimedStats stats ;
+  uint64_t start ;
+  int i ;
+
+  printf ("Raspberry Pi wiringPi scheduled write test program\n") ;
+  printf ("==================================================\n\n") ;
+
+  wiringPiSetupGpio () ;
+
+  pinMode (PIN_A, OUTPUT) ;
+  pinMode (PIN_B, OUTPUT) ;
+
+// Queue them all up, in reverse to give the heap something to do
+
+  start = nanos () + 10000000 ;
+  for (i = WRITES - 1 ; i >= 0 ; --i)
+  {
+    digitalWriteAt (PIN_A, i & 1, start + (uint64_t)i * GAP) ;
+    digitalWriteAt (PIN_B, i & 1, start + (uint64_t)i * GAP) ;
+  }
+
+  do
+  {
+    delay (10) ;
+    digitalWriteAtStats (&stats) ;
+  } while (stats.depth > 0) ;
+
+  printf ("Most queued:    %u\n", stats.maxDepth) ;
+  printf ("Writes:         %llu in %llu bank writes\n", (unsigned long long)stats.events, (unsigned long long)stats.writes) ;
+  printf ("Late:           mean %.1f uS, max %.1f uS\n",
+	(double)stats.totalLate / stats.events / 1000.0, (double)stats.maxLate / 1000.0) ;
+
+  return 0 ;
+}
@@ -68,6 +68,7 @@ char *usage = "Usage: gpio -v\n"
 	      "       gpio unexportall/exports\n"
 	      "       gpio export/edge/unexport ...\n"
 	      "       gpio wfi <pin> <mode>\n"
+	      "       gpio save/restore <file>\n"
 	      "       gpio drive <group> <value>\n"
 	      "       gpio pwm-bal/pwm-ms \n"
 	      "       gpio pwmr <range> \n"
@@ -960,6 +961,98 @@ static void doWriteByte (int argc, char *argv [])
 }
 
 
+/*
+ * doSave: doRestore:
+ *	gpio save file
+ *	gpio restore file
+ *	Save the GPIO set-up (modes, levels, pulls, PWM, clocks & pad drive)
+ *	to a file, or put it back again. A file of "-" is stdout/stdin.
+ *********************************************************************************
+ */
+
+static void doSave (int argc, char *argv [])
+{
+  struct wpiState state ;
+  char *buf ;
+  int len ;
+  FILE *fd ;
+
+  if (argc != 3)
+  {
+    fprintf (stderr, "Usage: %s save file\n", argv [0]) ;
+    exit (1) ;
+  }
+
+  if (wpiStateSave (&state) != 0)
+  {
+    fprintf (stderr, "%s: save: Only available with the on-board GPIO mapped\n", argv [0]) ;
+    exit (1) ;
+  }
+
+  len = wpiStateFormat (&state, NULL, 0) + 1 ;
+  if ((buf = malloc (len)) == NULL)
+  {
+    fprintf (stderr, "%s: save: Out of memory\n", argv [0]) ;
+    exit (1) ;
+  }
+  wpiStateFormat (&state, buf, len) ;
+
+  if (strcmp (argv [2], "-") == 0)
+    fd = stdout ;
+  else if ((fd = fopen (argv [2], "w")) == NULL)
+  {
+    fprintf (stderr, "%s: save: Unable to open %s: %s\n", argv [0], argv [2], strerror (errno)) ;
+    exit (1) ;
+  }
+
+  fputs (buf, fd) ;
+
+  if (fd != stdout)
+    fclose (fd) ;
+  free (buf) ;
+}
+
+static void doRestore (int argc, char *argv [])
+{
+  struct wpiState state ;
+  char buf [4096] ;
+  size_t len ;
+  FILE *fd ;
+
+  if (argc != 3)
+  {
+    fprintf (stderr, "Usage: %s restore file\n", argv [0]) ;
+    exit (1) ;
+  }
+
+  if (strcmp (argv [2], "-") == 0)
+    fd = stdin ;
+  else if ((fd = fopen (argv [2], "r")) == NULL)
+  {
+    fprintf (stderr, "%s: restore: Unable to open %s: %s\n", argv [0], argv [2], strerror (errno)) ;
+    exit (1) ;
+  }
+
+  len = fread (buf, 1, sizeof (buf) - 1, fd) ;
+  buf [len] = 0 ;
+
+  if (fd != stdin)
+    fclose (fd) ;
+
+  if (wpiStateParse (&state, buf) != 0)
+  {
+    fprintf (stderr, "%s: restore: %s is not a saved GPIO state\n", argv [0], argv [2]) ;
+    exit (1) ;
+  }
+
+  if (wpiStateRestore (&state) != 0)
+  {
+    fprintf (stderr, "%s: restore: Only available with the on-board GPIO mapped\n", argv [0]) ;
+    exit (1) ;
+  }
+}
+
+
 /*
  * doRead:
  *	Read a pin and return the value
@@ -1389,6 +1482,8 @@ int main (int argc, char *argv [])
   else if (strcasecmp (argv [1], "wb"       ) == 0) doWriteByte  (argc, argv) ;
   else if (strcasecmp (argv [1], "clock"    ) == 0) doClock      (argc, argv) ;
   else if (strcasecmp (argv [1], "wfi"      ) == 0) doWfi        (argc, argv) ;
+  else if (strcasecmp (argv [1], "save"     ) == 0) doSave       (argc, argv) ;
+  else if (strcasecmp (argv [1], "restore"  ) == 0) doRestore    (argc, argv) ;
   else
   {
     fprintf (stderr, "%s: Unknown command: %s.\n", argv [0], argv [1]) ;
@@ -52,14 +52,22 @@ extern int wpMode ;
 
 static void doReadallExternal (void)
 {
-  int pin ;
+  int pin, bit ;
+  unsigned int bits = 0 ;
 
   printf ("+------+---------+--------+\n") ;
   printf ("|  Pin | Digital | Analog |\n") ;
   printf ("+------+---------+--------+\n") ;
 
+// Read the digital values 8 at a time - one transaction on most devices
+
   for (pin = wiringPiNodes->pinBase ; pin <= wiringPiNodes->pinMax ; ++pin)
-    printf ("| %4d |  %4d   |  %4d  |\n", pin, digitalRead (pin), analogRead (pin)) ;
+  {
+    bit = (pin - wiringPiNodes->pinBase) & 7 ;
+    if (bit == 0)
+      bits = digitalRead8 (pin) ;
+    printf ("| %4d |  %4d   |  %4d  |\n", pin, (bits >> bit) & 1, analogRead (pin)) ;
+  }
 
   printf ("+------+---------+--------+\n") ;
 }
@@ -75,6 +83,20 @@ static void doReadallExternal (void)
  *********************************************************************************
  */
 
+// gpioLevels:
+//	Snapshot of both GPIO banks, taken once so that the whole table
+//	shows the pins as they were at the same instant.
+
+static uint32_t gpioLevels [2] ;
+
+static int readallLevel (int gpioPin)
+{
+  if ((gpioPin < 0) || (gpioPin > 53))
+    return 0 ;
+
+  return (gpioLevels [gpioPin >> 5] >> (gpioPin & 31)) & 1 ;
+}
+
 static char *alts [] =
 {
   "IN", "OUT", "ALT5", "ALT4", "ALT0", "ALT1", "ALT2", "ALT3"
@@ -178,7 +200,7 @@ static void readallPhys (int physPin)
       pin = physToWpi [physPin] ;
 
     printf (" | %4s", alts [getAlt (pin)]) ;
-    printf (" | %d", digitalRead (pin)) ;
+    printf (" | %d", readallLevel (physPinToGpio (physPin))) ;
   }
 
 // Pin numbers:
@@ -200,7 +222,7 @@ static void readallPhys (int physPin)
     else
       pin = physToWpi [physPin] ;
 
-    printf (" | %d", digitalRead (pin)) ;
+    printf (" | %d", readallLevel (physPinToGpio (physPin))) ;
     printf (" | %-4s", alts [getAlt (pin)]) ;
   }
 
@@ -227,11 +249,11 @@ void cmReadall (void)
   {
     printf ("| %3d ", pin) ;
     printf ("| %-4s ", alts [getAlt (pin)]) ;
-    printf ("| %s  ", digitalRead (pin) == HIGH ? "High" : "Low ") ;
+    printf ("| %s  ", readallLevel (pin) == HIGH ? "High" : "Low ") ;
     printf ("|      ") ;
     printf ("| %3d ", pin + 28) ;
     printf ("| %-4s ", alts [getAlt (pin + 28)]) ;
-    printf ("| %s  ", digitalRead (pin + 28) == HIGH ? "High" : "Low ") ;
+    printf ("| %s  ", readallLevel (pin + 28) == HIGH ? "High" : "Low ") ;
     printf ("|\n") ;
   }
 
@@ -325,6 +347,8 @@ void doReadall (void)
 
   piBoardId (&model, &rev, &mem, &maker, &overVolted) ;
 
+  digitalReadBanks (gpioLevels) ;
+
   /**/ if ((model == PI_MODEL_A) || (model == PI_MODEL_B))
     abReadall (model, rev) ;
   else if ((model == PI_MODEL_BP) || (model == PI_MODEL_AP) || (model == PI_MODEL_2) || (model == PI_MODEL_ZERO))
@@ -118,6 +118,17 @@ static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
 }
 
 
+/*
+ * myDigitalRead8:
+ *********************************************************************************
+ */
+
+static unsigned int myDigitalRead8 (struct wiringPiNodeStruct *node, int pin)
+{
+  return (wiringPiI2CReadReg8 (node->fd, MCP23x08_GPIO) >> ((pin - node->pinBase) & 7)) & 0xFF ;
+}
+
+
 /*
  * mcp23008Setup:
  *	Create a new instance of an MCP23008 I2C GPIO interface. We know it
@@ -143,6 +154,7 @@ int mcp23008Setup (const int pinBase, const int i2cAddress)
   node->pullUpDnControl = myPullUpDnControl ;
   node->digitalRead     = myDigitalRead ;
   node->digitalWrite    = myDigitalWrite ;
+  node->digitalRead8    = myDigitalRead8 ;
   node->data2           = wiringPiI2CReadReg8 (fd, MCP23x08_OLAT) ;
 
   return 0 ;
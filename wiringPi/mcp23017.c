@@ -163,6 +163,29 @@ static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
 }
 
 
+/*
+ * myDigitalRead8:
+ *	Only touch the port(s) we actually need
+ *********************************************************************************
+ */
+
+static unsigned int myDigitalRead8 (struct wiringPiNodeStruct *node, int pin)
+{
+  unsigned int value ;
+
+  pin -= node->pinBase ;
+
+  /**/ if (pin == 0)		// Bank A
+    value = wiringPiI2CReadReg8 (node->fd, MCP23x17_GPIOA) ;
+  else if (pin >= 8)		// Bank B
+    value = wiringPiI2CReadReg8 (node->fd, MCP23x17_GPIOB) >> (pin - 8) ;
+  else				// Straddles both
+    value = (wiringPiI2CReadReg8 (node->fd, MCP23x17_GPIOA) | (wiringPiI2CReadReg8 (node->fd, MCP23x17_GPIOB) << 8)) >> pin ;
+
+  return value & 0xFF ;
+}
+
+
 /*
  * mcp23017Setup:
  *	Create a new instance of an MCP23017 I2C GPIO interface. We know it
@@ -188,6 +211,7 @@ int mcp23017Setup (const int pinBase, const int i2cAddress)
   node->pullUpDnControl = myPullUpDnControl ;
   node->digitalRead     = myDigitalRead ;
   node->digitalWrite    = myDigitalWrite ;
+  node->digitalRead8    = myDigitalRead8 ;
   node->data2           = wiringPiI2CReadReg8 (fd, MCP23x17_OLATA) ;
   node->data3           = wiringPiI2CReadReg8 (fd, MCP23x17_OLATB) ;
 
@@ -157,6 +157,17 @@ static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
 }
 
 
+/*
+ * myDigitalRead8:
+ *********************************************************************************
+ */
+
+static unsigned int myDigitalRead8 (struct wiringPiNodeStruct *node, int pin)
+{
+  return (readByte (node->data0, node->data1, MCP23x08_GPIO) >> ((pin - node->pinBase) & 7)) & 0xFF ;
+}
+
+
 /*
  * mcp23s08Setup:
  *	Create a new instance of an MCP23s08 SPI GPIO interface. We know it
@@ -183,6 +194,7 @@ int mcp23s08Setup (const int pinBase, const int spiPort, const int devId)
   node->pullUpDnControl = myPullUpDnControl ;
   node->digitalRead     = myDigitalRead ;
   node->digitalWrite    = myDigitalWrite ;
+  node->digitalRead8    = myDigitalRead8 ;
   node->data2           = readByte (spiPort, devId, MCP23x08_OLAT) ;
 
   return 0 ;
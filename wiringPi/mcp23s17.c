@@ -202,6 +202,29 @@ static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
 }
 
 
+/*
+ * myDigitalRead8:
+ *	Only touch the port(s) we actually need
+ *********************************************************************************
+ */
+
+static unsigned int myDigitalRead8 (struct wiringPiNodeStruct *node, int pin)
+{
+  unsigned int value ;
+
+  pin -= node->pinBase ;
+
+  /**/ if (pin == 0)		// Bank A
+    value = readByte (node->data0, node->data1, MCP23x17_GPIOA) ;
+  else if (pin >= 8)		// Bank B
+    value = readByte (node->data0, node->data1, MCP23x17_GPIOB) >> (pin - 8) ;
+  else				// Straddles both
+    value = (readByte (node->data0, node->data1, MCP23x17_GPIOA) | (readByte (node->data0, node->data1, MCP23x17_GPIOB) << 8)) >> pin ;
+
+  return value & 0xFF ;
+}
+
+
 /*
  * mcp23s17Setup:
  *	Create a new instance of an MCP23s17 SPI GPIO interface. We know it
@@ -229,6 +252,7 @@ int mcp23s17Setup (const int pinBase, const int spiPort, const int devId)
   node->pullUpDnControl = myPullUpDnControl ;
   node->digitalRead     = myDigitalRead ;
   node->digitalWrite    = myDigitalWrite ;
+  node->digitalRead8    = myDigitalRead8 ;
   node->data2           = readByte (spiPort, devId, MCP23x17_OLATA) ;
   node->data3           = readByte (spiPort, devId, MCP23x17_OLATB) ;
 
@@ -98,6 +98,18 @@ static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
 }
 
 
+/*
+ * myDigitalRead8:
+ *	All 8 pins come back in one I2C read
+ *********************************************************************************
+ */
+
+static unsigned int myDigitalRead8 (struct wiringPiNodeStruct *node, int pin)
+{
+  return (wiringPiI2CRead (node->fd) >> ((pin - node->pinBase) & 7)) & 0xFF ;
+}
+
+
 /*
  * pcf8574Setup:
  *	Create a new instance of a PCF8574 I2C GPIO interface. We know it
@@ -120,6 +132,7 @@ int pcf8574Setup (const int pinBase, const int i2cAddress)
   node->pinMode      = myPinMode ;
   node->digitalRead  = myDigitalRead ;
   node->digitalWrite = myDigitalWrite ;
+  node->digitalRead8 = myDigitalRead8 ;
   node->data2        = wiringPiI2CRead (fd) ;
 
   return 0 ;
@@ -1,7 +1,7 @@
 /*
  * softPwm.c:
- *	Provide 2 channels of software driven PWM.
- *	Copyright (c) 2012-2014 Gordon Henderson
+ *	Provide any number of channels of software driven PWM.
+ *	Copyright (c) 2012-2015 Gordon Henderson
  ***********************************************************************
  * This file is part of wiringPi:
  *	https://projects.drogon.net/raspberry-pi/wiringpi/
@@ -22,12 +22,41 @@
  ***********************************************************************
  */
 
+// All the channels are run by one thread: it works out which channel
+//	has the next edge due, sleeps until just before it and busy-waits
+//	the rest of the way (see wpiWaitUntil ()), then does every edge for
+//	that time. Edges on different channels that fall at the same instant
+//	go out as a single bank write, if they're on-board pins. Pins that
+//	aren't are written one at a time with digitalWrite ().
+//
+//	Times are in nS: softPwmCreate () channels have a period of range
+//	PULSE_TIMEs, softPwmCreateFreq () ones whatever frequency they ask
+//	for, divided into however many steps they want. Each channel's
+//	periods start on a multiple of its period, so channels with the
+//	same frequency rise together.
+//
+//	A new mark from softPwmWrite () takes effect at the start of the
+//	next period.
+//
+//	A channel with a mark of 0 or the whole range is just a level: it's
+//	written once and the channel is parked until softPwmWrite () gives
+//	it something else to do. With nothing but parked channels, the
+//	thread sleeps until it's woken.
+
 #include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
 #include <pthread.h>
 
 #include "wiringPi.h"
 #include "softPwm.h"
 
+#ifndef	TRUE
+#  define	TRUE	(1==1)
+#  define	FALSE	(!TRUE)
+#endif
+
 // MAX_PINS:
 //	This is more than the number of Pi pins because we can actually softPwm
 //	pins that are on GPIO expanders. It's not that efficient and more than 1 or
@@ -35,65 +64,181 @@
 
 #define	MAX_PINS	1024
 
-// The PWM Frequency is derived from the "pulse time" below. Essentially,
-//	the frequency is a function of the range and this pulse time.
+// For softPwmCreate (), the PWM Frequency is derived from the "pulse time"
+//	below. Essentially, the frequency is a function of the range and this
+//	pulse time.
 //	The total period will be range * pulse time in µS, so a pulse time
 //	of 100 and a range of 100 gives a period of 100 * 100 = 10,000 µS
 //	which is a frequency of 100Hz.
 //
-//	It's possible to get a higher frequency by lowering the pulse time,
-//	however CPU uage will skyrocket as wiringPi uses a hard-loop to time
-//	periods under 100µS - this is because the Linux timer calls are just
-//	accurate at all, and have an overhead.
-//
 //	Another way to increase the frequency is to reduce the range - however
-//	that reduces the overall output accuracy...
+//	that reduces the overall output accuracy... or use softPwmCreateFreq ()
 
 #define	PULSE_TIME	100
+#define	PULSE_NS	((uint64_t)PULSE_TIME * 1000)
+
+struct softPwmChannel
+{
+  int      pin ;
+  int      bank ;
+  uint32_t mask ;		// 0 if it's not an on-board pin
+  int      fall ;		// Next edge is the end of the mark
+  uint64_t period ;		// nS
+  uint64_t start ;		// Start of this period
+  uint64_t next ;		// When the next edge is due, WPI_NEVER if parked
+  int      mark ;		//	... and the mark it was parked at
+} ;
+
+static volatile int marks  [MAX_PINS] ;
+static volatile int range  [MAX_PINS] ;
+static volatile int parked [MAX_PINS] ;
 
-static volatile int marks         [MAX_PINS] ;
-static volatile int range         [MAX_PINS] ;
-static volatile pthread_t threads [MAX_PINS] ;
-static volatile int newPin = -1 ;
+static pthread_mutex_t pwmLock = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t  pwmCond ;
+static int             pwmRunning = FALSE ;
+
+static struct softPwmChannel channels [MAX_PINS] ;
+static int                   numChannels = 0 ;
+
+
+/*
+ * softPwmEdge:
+ *	Move a channel on past the edge that's due, returning the level to
+ *	write. A mark of 0 or the whole range has no falling edge, and
+ *	the channel is parked.
+ *********************************************************************************
+ */
+
+static int softPwmEdge (struct softPwmChannel *ch, uint64_t now)
+{
+  uint64_t period = ch->period ;
+  int index = ch->pin & (MAX_PINS - 1) ;
+  int mark ;
+
+  if (ch->fall)
+  {
+    ch->fall = FALSE ;
+    ch->next = ch->start + period ;
+    return LOW ;
+  }
+
+// Start of a period. If we've fallen a long way behind, skip the
+//	periods we've missed rather than trying to catch up with them
+
+  if (ch->next + period <= now)
+    ch->next += ((now - ch->next) / period) * period ;
+
+  ch->start = ch->next ;
+  mark      = marks [index] ;
+
+  if ((mark > 0) && (mark < range [index]))
+  {
+    ch->fall = TRUE ;
+    ch->next = ch->start + (period * mark) / range [index] ;
+    return HIGH ;
+  }
+
+// Steady: Park it, then look at the mark again in case softPwmWrite ()
+//	changed it without seeing that we'd parked (see softPwmWake ())
+
+  ch->mark = mark ;
+  __atomic_store_n (&parked [index], TRUE, __ATOMIC_SEQ_CST) ;
+
+  if (__atomic_load_n (&marks [index], __ATOMIC_SEQ_CST) == mark)
+    ch->next = WPI_NEVER ;
+  else
+  {
+    parked [index] = FALSE ;
+    ch->next = ch->start + period ;
+  }
+
+  return (mark > 0) ? HIGH : LOW ;
+}
 
 
 /*
  * softPwmThread:
- *	Thread to do the actual PWM output
+ *	Thread to do the actual PWM output, for all the pins.
  *********************************************************************************
  */
 
 static PI_THREAD (softPwmThread)
 {
-  int pin, mark, space ;
-  struct sched_param param ;
-
-  param.sched_priority = sched_get_priority_max (SCHED_RR) ;
-  pthread_setschedparam (pthread_self (), SCHED_RR, &param) ;
+  struct softPwmChannel *ch ;
+  struct wpiBatch batch ;
+  uint64_t when, now ;
+  int i ;
 
-  pin    = newPin ;
-  newPin = -1 ;
+  (void)piHiPri (90) ;
+  (void)delayThreshold () ;		// Calibrate now, not with the lock held
 
-  piHiPri (90) ;
+  pthread_mutex_lock (&pwmLock) ;
 
   for (;;)
   {
-    mark  = marks [pin] ;
-    space = range [pin] - mark ;
+    when = WPI_NEVER ;
+    for (i = 0 ; i < numChannels ; ++i)
+      if (channels [i].next < when)
+	when = channels [i].next ;
 
-    if (mark != 0)
-      digitalWrite (pin, HIGH) ;
-    delayMicroseconds (mark * 100) ;
+// Not due yet? Wait, but look again if a channel is added or stopped
 
-    if (space != 0)
-      digitalWrite (pin, LOW) ;
-    delayMicroseconds (space * 100) ;
+    if (!wpiWaitUntil (&pwmCond, &pwmLock, when))
+      continue ;
+
+// Do all the edges for this time
+
+    wpiBatchClear (&batch) ;
+    now = nanos () ;
+
+    for (i = 0 ; i < numChannels ; ++i)
+    {
+      ch = &channels [i] ;
+      if (ch->next == when)
+	wpiBatchAdd (&batch, ch->pin, ch->bank, ch->mask, softPwmEdge (ch, now)) ;
+    }
+
+    (void)wpiBatchWrite (&batch) ;
   }
 
   return NULL ;
 }
 
 
+/*
+ * softPwmWake:
+ *	Start a parked channel again, at the start of its next period, if
+ *	its mark has changed.
+ *********************************************************************************
+ */
+
+static void softPwmWake (int index)
+{
+  struct softPwmChannel *ch ;
+  int i ;
+
+  pthread_mutex_lock (&pwmLock) ;
+
+  if (parked [index])
+    for (i = 0 ; i < numChannels ; ++i)
+    {
+      ch = &channels [i] ;
+      if ((ch->pin & (MAX_PINS - 1)) != index)
+	continue ;
+
+      if (marks [index] != ch->mark)
+      {
+	parked [index] = FALSE ;
+	ch->next = (nanos () / ch->period + 1) * ch->period ;
+	pthread_cond_signal (&pwmCond) ;
+      }
+      break ;
+    }
+
+  pthread_mutex_unlock (&pwmLock) ;
+}
+
+
 /*
  * softPwmWrite:
  *	Write a PWM value to the given pin
@@ -109,58 +254,186 @@ void softPwmWrite (int pin, int value)
   else if (value > range [pin])
     value = range [pin] ;
 
-  marks [pin] = value ;
+  __atomic_store_n (&marks [pin], value, __ATOMIC_SEQ_CST) ;
+
+  if (__atomic_load_n (&parked [pin], __ATOMIC_SEQ_CST))
+    softPwmWake (pin) ;
 }
 
 
 /*
- * softPwmCreate:
- *	Create a new softPWM thread.
+ * softPwmAdd:
+ *	Create a new softPWM channel with a period of period nS, starting
+ *	the thread if it's the first.
  *********************************************************************************
  */
 
-int softPwmCreate (int pin, int initialValue, int pwmRange)
+static int softPwmAdd (int pin, int initialValue, int pwmRange, uint64_t period)
 {
-  int res ;
+  struct softPwmChannel *ch ;
+  uint32_t setMask [2], clrMask [2] ;
   pthread_t myThread ;
+  int index = pin & (MAX_PINS - 1) ;
+  int res ;
 
-  if (range [pin] != 0)	// Already running on this pin
+  if (range [index] != 0)	// Already running on this pin
     return -1 ;
 
-  if (range <= 0)
+  if ((pwmRange <= 0) || (period == 0))
     return -1 ;
 
   pinMode      (pin, OUTPUT) ;
   digitalWrite (pin, LOW) ;
 
-  marks [pin] = initialValue ;
-  range [pin] = pwmRange ;
+  pthread_mutex_lock (&pwmLock) ;
+
+  if (!pwmRunning)
+  {
+    wpiWaitInit (&pwmCond) ;
+
+    if ((res = pthread_create (&myThread, NULL, softPwmThread, NULL)) != 0)
+    {
+      pthread_cond_destroy (&pwmCond) ;
+      pthread_mutex_unlock (&pwmLock) ;
+      return res ;
+    }
+    pthread_detach (myThread) ;
+    pwmRunning = TRUE ;
+  }
+
+  ch = &channels [numChannels++] ;
 
-  newPin = pin ;
-  res    = pthread_create (&myThread, NULL, softPwmThread, NULL) ;
+  ch->pin    = pin ;
+  ch->bank   = 0 ;
+  ch->mask   = 0 ;
+  ch->fall   = FALSE ;
+  ch->period = period ;
+  ch->next   = (nanos () / period + 1) * period ;	// On the grid, so edges line up
+  ch->start  = ch->next ;
 
-  while (newPin != -1)
-    delay (1) ;
+  if (digitalPinsToMask (&pin, 1, 0, setMask, clrMask) == 0)
+  {
+    ch->bank = (clrMask [1] != 0) ? 1 : 0 ;
+    ch->mask = clrMask [ch->bank] ;
+  }
 
-  threads [pin] = myThread ;
+  /**/ if (initialValue < 0)
+    initialValue = 0 ;
+  else if (initialValue > pwmRange)
+    initialValue = pwmRange ;
 
-  return res ;
+  range  [index] = pwmRange ;
+  marks  [index] = initialValue ;
+  parked [index] = FALSE ;
+
+  pthread_cond_signal  (&pwmCond) ;
+  pthread_mutex_unlock (&pwmLock) ;
+
+  return 0 ;
 }
 
 
 /*
- * softPwmStop:
- *	Stop an existing softPWM thread
+ * softPwmCreate:
+ *	Create a new softPWM channel, range PULSE_TIMEs long
  *********************************************************************************
  */
 
-void softPwmStop (int pin)
+int softPwmCreate (int pin, int initialValue, int pwmRange)
 {
-  if (range [pin] != 0)
+  if (pwmRange <= 0)
+    return -1 ;
+
+  return softPwmAdd (pin, initialValue, pwmRange, pwmRange * PULSE_NS) ;
+}
+
+
+/*
+ * softPwmCreateFreq:
+ *	Create a new softPWM channel at freq Hz, with values from 0 to
+ *	resolution. See softPwmMaxFreq () for how fast it's sensible to go.
+ *********************************************************************************
+ */
+
+int softPwmCreateFreq (int pin, int initialValue, int resolution, int freq)
+{
+  if ((freq <= 0) || (freq > 1000000000))
+    return -1 ;
+
+  return softPwmAdd (pin, initialValue, resolution, 1000000000 / (uint64_t)freq) ;
+}
+
+
+/*
+ * softPwmMaxFreq:
+ *	The highest frequency a channel on pin can run at with the given
+ *	resolution, with one step no shorter than it takes us to do an edge
+ *	on that pin. That depends on how wiringPi was set up - memory mapped
+ *	GPIO takes tens of nS, gpiochip an ioctl and Sys mode a write to a
+ *	file, and a pin on an expansion module is at the mercy of its bus.
+ *	The time to read the pin (the same path as writing it) plus a look
+ *	at the clock is used as the cost of an edge. Expect a channel at
+ *	this frequency to keep the scheduler thread busy all the time.
+ *********************************************************************************
+ */
+
+#define	EDGE_SAMPLES	64
+
+int softPwmMaxFreq (int pin, int resolution)
+{
+  uint64_t start, edge, best = ~(uint64_t)0 ;
+  int i ;
+
+  if (resolution <= 0)
+    return 0 ;
+
+// Take the quickest of a few tries: we want the cost when nothing else
+//	gets in the way, as that's what the thread sees when it's spinning
+
+  for (i = 0 ; i < EDGE_SAMPLES ; ++i)
   {
-    pthread_cancel (threads [pin]) ;
-    pthread_join   (threads [pin], NULL) ;
-    range [pin] = 0 ;
-    digitalWrite (pin, LOW) ;
+    start = nanos () ;
+    (void)digitalRead (pin) ;
+    edge = nanos () - start ;
+    if (edge < best)
+      best = edge ;
   }
+
+  if (best == 0)
+    best = 1 ;
+
+  return (int)(1000000000 / (best * (uint64_t)resolution)) ;
+}
+
+
+/*
+ * softPwmStop:
+ *	Stop the softPWM on a pin and leave it low
+ *********************************************************************************
+ */
+
+void softPwmStop (int pin)
+{
+  int index = pin & (MAX_PINS - 1) ;
+  int i ;
+
+  if (range [index] == 0)
+    return ;
+
+  pthread_mutex_lock (&pwmLock) ;
+
+  for (i = 0 ; i < numChannels ; ++i)
+    if (channels [i].pin == pin)
+    {
+      channels [i] = channels [--numChannels] ;
+      break ;
+    }
+
+  range  [index] = 0 ;
+  parked [index] = FALSE ;
+
+  pthread_cond_signal  (&pwmCond) ;
+  pthread_mutex_unlock (&pwmLock) ;
+
+  digitalWrite (pin, LOW) ;
 }
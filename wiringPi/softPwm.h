@@ -1,6 +1,6 @@
 /*
  * softPwm.h:
- *	Provide 2 channels of software driven PWM.
+ *	Provide any number of channels of software driven PWM.
  *	Copyright (c) 2012 Gordon Henderson
  ***********************************************************************
  * This file is part of wiringPi:
@@ -26,9 +26,11 @@
 extern "C" {
 #endif
 
-extern int  softPwmCreate (int pin, int value, int range) ;
-extern void softPwmWrite  (int pin, int value) ;
-extern void softPwmStop   (int pin) ;
+extern int  softPwmCreate     (int pin, int value, int range) ;
+extern int  softPwmCreateFreq (int pin, int value, int resolution, int freq) ;
+extern int  softPwmMaxFreq    (int pin, int resolution) ;
+extern void softPwmWrite      (int pin, int value) ;
+extern void softPwmStop       (int pin) ;
 
 #ifdef __cplusplus
 }
@@ -2,7 +2,7 @@
  * softServo.c:
  *	Provide N channels of software driven PWM suitable for RC
  *	servo motors.
- *	Copyright (c) 2012 Gordon Henderson
+ *	Copyright (c) 2012-2015 Gordon Henderson
  ***********************************************************************
  * This file is part of wiringPi:
  *	https://projects.drogon.net/raspberry-pi/wiringpi/
@@ -23,15 +23,6 @@
  ***********************************************************************
  */
 
-//#include <stdio.h>
-#include <string.h>
-#include <time.h>
-#include <sys/time.h>
-#include <pthread.h>
-
-#include "wiringPi.h"
-#include "softServo.h"
-
 // RC Servo motors are a bit of an oddity - designed in the days when 
 //	radio control was experimental and people were tryin to make
 //	things as simple as possible as it was all very expensive...
@@ -54,20 +45,100 @@
 //	the multipexing, but it does need to be at least 10mS, and preferably 16
 //	from what I've been able to determine.
 
-// WARNING:
-//	This code is really experimental. It was written in response to some people
-//	asking for a servo driver, however while it works, there is too much
-//	jitter to successfully drive a small servo - I have tried it with a micro
-//	servo and it worked, but the servo ran hot due to the jitter in the signal
-//	being sent to it.
+// How it's done:
+//	One thread does all the servos. Each frame starts at an absolute
+//	time, a whole number of frame periods on from the last, so the frame
+//	rate doesn't drift with however long the frame took. All the pulses
+//	start together with one bank write (pins on expansion modules are
+//	written one at a time), then the servos are turned off in order of
+//	pulse width, each at the time it went high plus its width - so
+//	lateness in one doesn't add on to the next, and servos finishing
+//	together are turned off with one bank write.
 //
-//	If you want servo control for the Pi, then use the servoblaster kernel
-//	module.
+//	The edge list sorted by width is only rebuilt when softServoWrite ()
+//	changes something. The thread sleeps for most of the gap between
+//	frames and busy-waits the last bit before each edge (see
+//	delayUntil ()).
+//
+//	softServoStats () says how far out the pulse widths were - the time
+//	from the write that started a pulse to the write that ended it,
+//	against what was asked for.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "wiringPi.h"
+#include "softServo.h"
+
+#ifndef	TRUE
+#  define	TRUE	(1==1)
+#  define	FALSE	(!TRUE)
+#endif
 
-#define	MAX_SERVOS	8
+#define	FRAME_TIME	8000		// uS, can be changed by softServoFrame ()
+#define	MIN_FRAME	2500		// Longest pulse is 2250 uS
+
+struct servo
+{
+  int      pin ;
+  int      bank ;
+  uint32_t mask ;			// 0 if it's not an on-board pin
+  uint64_t width ;			// nS
+} ;
 
-static int pinMap     [MAX_SERVOS] ;	// Keep track of our pins
-static int pulseWidth [MAX_SERVOS] ;	// microseconds
+static pthread_mutex_t servoLock = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t  servoCond = PTHREAD_COND_INITIALIZER ;
+static int             servoRunning = FALSE ;
+
+static struct servo *servos    = NULL ;	// As set by softServoWrite ()
+static int           numServos = 0 ;
+static int           maxServos = 0 ;
+static int           changed   = FALSE ;	// Since the edges were sorted
+
+static uint64_t      framePeriod = (uint64_t)FRAME_TIME * 1000 ;
+
+static struct softServoStats stats ;
+
+
+/*
+ * sortEdges:
+ *	Copy the servos into the thread's edge list and sort it by width,
+ *	shortest first. Insertion sort: there aren't many, and they mostly
+ *	arrive in order anyway after the first time.
+ *	Called with the lock held.
+ *********************************************************************************
+ */
+
+static int sortEdges (struct servo **edges, int *maxEdges)
+{
+  struct servo *newEdges, t ;
+  int i, j ;
+
+  if (numServos > *maxEdges)
+  {
+    if ((newEdges = realloc (*edges, numServos * sizeof (struct servo))) == NULL)
+      return *maxEdges ;		// Keep what we had, try again next frame
+    *edges    = newEdges ;
+    *maxEdges = numServos ;
+  }
+
+  memcpy (*edges, servos, numServos * sizeof (struct servo)) ;
+
+  for (i = 1 ; i < numServos ; ++i)
+  {
+    t = (*edges) [i] ;
+    for (j = i ; (j > 0) && ((*edges) [j - 1].width > t.width) ; --j)
+      (*edges) [j] = (*edges) [j - 1] ;
+    (*edges) [j] = t ;
+  }
+
+  changed = FALSE ;
+  return numServos ;
+}
 
 
 /*
@@ -78,75 +149,94 @@ static int pulseWidth [MAX_SERVOS] ;	// microseconds
 
 static PI_THREAD (softServoThread)
 {
-  register int i, j, k, m, tmp ;
-  int lastDelay, pin, servo ;
+  struct servo *edges = NULL ;
+  struct wpiBatch batch ;
+  uint64_t frame, period, rise, fall, error, frameError, totalError, late, now, skipped ;
+  unsigned int pulses ;
+  int maxEdges = 0, numEdges = 0 ;
+  int i, j ;
 
-  int myDelays [MAX_SERVOS] ;
-  int myPins   [MAX_SERVOS] ;
+  (void)piHiPri (90) ;
+  (void)delayThreshold () ;		// Measure it now, not in the first frame
 
-  struct timeval  tNow, tStart, tPeriod, tGap, tTotal ;
-  struct timespec tNs ;
-
-  tTotal.tv_sec  =    0 ;
-  tTotal.tv_usec = 8000 ;
-
-  piHiPri (50) ;
+  frame = nanos () ;
 
   for (;;)
   {
-    gettimeofday (&tStart, NULL) ;
-
-    memcpy (myDelays, pulseWidth, sizeof (myDelays)) ;
-    memcpy (myPins,   pinMap,     sizeof (myPins)) ;
-
-// Sort the delays (& pins), shortest first
-
-    for (m = MAX_SERVOS / 2 ; m > 0 ; m /= 2 )
-      for (j = m ; j < MAX_SERVOS ; ++j)
-	for (i = j - m ; i >= 0 ; i -= m)
-	{
-	  k = i + m ;
-	  if (myDelays [k] >= myDelays [i])
-	    break ;
-	  else // Swap
-	  {
-	    tmp = myDelays [i] ; myDelays [i] = myDelays [k] ; myDelays [k] = tmp ;
-	    tmp = myPins   [i] ; myPins   [i] = myPins   [k] ; myPins   [k] = tmp ;
-	  }
-	}
-
-// All on
-
-    lastDelay = 0 ;
-    for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
-    {
-      if ((pin = myPins [servo]) == -1)
-	continue ;
+    pthread_mutex_lock (&servoLock) ;
 
-      digitalWrite (pin, HIGH) ;
-      myDelays [servo] = myDelays [servo] - lastDelay ;
-      lastDelay += myDelays [servo] ;
+    while (numServos == 0)		// Nothing to do
+    {
+      pthread_cond_wait (&servoCond, &servoLock) ;
+      frame = nanos () ;
     }
 
-// Now loop, turning them all off as required
+    if (changed)
+      numEdges = sortEdges (&edges, &maxEdges) ;
+    period = framePeriod ;
 
-    for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
+    pthread_mutex_unlock (&servoLock) ;
+
+// Start of the frame: all on
+
+    delayUntil (frame) ;
+    late = nanos () - frame ;
+
+    wpiBatchClear (&batch) ;
+    for (i = 0 ; i < numEdges ; ++i)
+      wpiBatchAdd (&batch, edges [i].pin, edges [i].bank, edges [i].mask, HIGH) ;
+    (void)wpiBatchWrite (&batch) ;
+    rise = nanos () ;
+
+// Then off, in order. Everything that's due by the time we get to it
+//	goes in the same write.
+
+    frameError = 0 ;
+    totalError = 0 ;
+    pulses     = 0 ;
+
+    for (i = 0 ; i < numEdges ; i = j)
     {
-      if ((pin = myPins [servo]) == -1)
-	continue ;
+      delayUntil (rise + edges [i].width) ;
+
+      wpiBatchClear (&batch) ;
+      for (j = i ; (j < numEdges) && (rise + edges [j].width <= nanos ()) ; ++j)
+	wpiBatchAdd (&batch, edges [j].pin, edges [j].bank, edges [j].mask, LOW) ;
+      (void)wpiBatchWrite (&batch) ;
+      fall = nanos () ;
+
+      for ( ; i < j ; ++i, ++pulses)
+      {
+	error = fall - rise - edges [i].width ;
+	if (error > frameError)
+	  frameError = error ;
+	totalError += error ;
+      }
+    }
 
-      delayMicroseconds (myDelays [servo]) ;
-      digitalWrite (pin, LOW) ;
+// Next frame. If we've missed any (e.g. something else had the CPU),
+//	skip them, keeping to the same grid.
+
+    frame  += period ;
+    skipped = 0 ;
+    if ((now = nanos ()) > frame)
+    {
+      skipped = (now - frame) / period + 1 ;
+      frame  += skipped * period ;
     }
 
-// Wait until the end of an 8mS time-slot
+    pthread_mutex_lock (&servoLock) ;
+      ++stats.frames ;
+      stats.skipped    += skipped ;
+      stats.pulses     += pulses ;
+      stats.totalError += totalError ;
+      stats.lastError   = frameError ;
+      if (frameError > stats.maxError)
+	stats.maxError = frameError ;
+      if (late > stats.maxLate)
+	stats.maxLate = late ;
+    pthread_mutex_unlock (&servoLock) ;
 
-    gettimeofday (&tNow, NULL) ;
-    timersub (&tNow, &tStart, &tPeriod) ;
-    timersub (&tTotal, &tPeriod, &tGap) ;
-    tNs.tv_sec  = tGap.tv_sec ;
-    tNs.tv_nsec = tGap.tv_usec * 1000 ;
-    nanosleep (&tNs, NULL) ;
   }
 
   return NULL ;
@@ -155,7 +245,8 @@ static PI_THREAD (softServoThread)
 
 /*
  * softServoWrite:
- *	Write a Servo value to the given pin
+ *	Write a Servo value to the given pin: -250 to 1250, the pulse width
+ *	being 1000 uS more than that.
  *********************************************************************************
  */
 
@@ -163,49 +254,188 @@ void softServoWrite (int servoPin, int value)
 {
   int servo ;
 
-  servoPin &= 63 ;
-
   /**/ if (value < -250)
     value = -250 ;
   else if (value > 1250)
     value = 1250 ;
 
-  for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
-    if (pinMap [servo] == servoPin)
-      pulseWidth [servo] = value + 1000 ; // uS
+  pthread_mutex_lock (&servoLock) ;
+
+  for (servo = 0 ; servo < numServos ; ++servo)
+    if (servos [servo].pin == servoPin)
+    {
+      servos [servo].width = (uint64_t)(value + 1000) * 1000 ;
+      changed = TRUE ;
+      break ;
+    }
+
+  pthread_mutex_unlock (&servoLock) ;
+}
+
+
+/*
+ * softServoAdd:
+ *	Add a servo on the given pin, at the mid point, starting the thread
+ *	if it's the first.
+ *	Returns 0, or -1 with errno set.
+ *********************************************************************************
+ */
+
+int softServoAdd (int pin)
+{
+  struct servo *newServos ;
+  uint32_t setMask [2], clrMask [2] ;
+  pthread_t myThread ;
+  int servo, res ;
+
+  pinMode      (pin, OUTPUT) ;
+  digitalWrite (pin, LOW) ;
+
+  pthread_mutex_lock (&servoLock) ;
+
+  for (servo = 0 ; servo < numServos ; ++servo)
+    if (servos [servo].pin == pin)	// Already got it
+    {
+      pthread_mutex_unlock (&servoLock) ;
+      return 0 ;
+    }
+
+  if (!servoRunning)
+  {
+    if ((res = pthread_create (&myThread, NULL, softServoThread, NULL)) != 0)
+    {
+      pthread_mutex_unlock (&servoLock) ;
+      errno = res ;
+      return -1 ;
+    }
+    pthread_detach (myThread) ;
+    servoRunning = TRUE ;
+  }
+
+  if (numServos == maxServos)
+  {
+    if ((newServos = realloc (servos, (maxServos + 8) * sizeof (struct servo))) == NULL)
+    {
+      pthread_mutex_unlock (&servoLock) ;
+      return -1 ;
+    }
+    servos     = newServos ;
+    maxServos += 8 ;
+  }
+
+  servos [numServos].pin   = pin ;
+  servos [numServos].bank  = 0 ;
+  servos [numServos].mask  = 0 ;
+  servos [numServos].width = 1500 * 1000 ;		// Mid point
+
+  if (digitalPinsToMask (&pin, 1, 0, setMask, clrMask) == 0)
+  {
+    servos [numServos].bank = (clrMask [1] != 0) ? 1 : 0 ;
+    servos [numServos].mask = clrMask [servos [numServos].bank] ;
+  }
+
+  ++numServos ;
+  changed = TRUE ;
+
+  pthread_cond_signal  (&servoCond) ;
+  pthread_mutex_unlock (&servoLock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * softServoRemove:
+ *	Stop driving a servo. The pin is left low.
+ *********************************************************************************
+ */
+
+void softServoRemove (int pin)
+{
+  uint64_t period ;
+  int servo, found = FALSE ;
+
+  pthread_mutex_lock (&servoLock) ;
+
+  period = framePeriod ;
+
+  for (servo = 0 ; servo < numServos ; ++servo)
+    if (servos [servo].pin == pin)
+    {
+      servos [servo] = servos [--numServos] ;
+      changed = TRUE ;
+      found   = TRUE ;
+      break ;
+    }
+
+  pthread_mutex_unlock (&servoLock) ;
+
+// The thread may have sorted the edges for its next frame before we
+//	took the servo out, and that frame can start up to a period from
+//	now and run for as long as the longest pulse. Let it finish before
+//	we make sure the pin is low.
+
+  if (found)
+  {
+    delay ((unsigned int)(period / 1000000) + MIN_FRAME / 1000 + 1) ;
+    digitalWrite (pin, LOW) ;
+  }
+}
+
+
+/*
+ * softServoFrame:
+ *	Set the frame period, in uS. Takes effect from the next frame.
+ *	Returns 0, or -1 if it's too short for the longest pulse.
+ *********************************************************************************
+ */
+
+int softServoFrame (int uS)
+{
+  if (uS < MIN_FRAME)
+    return -1 ;
+
+  pthread_mutex_lock (&servoLock) ;
+    framePeriod = (uint64_t)uS * 1000 ;
+  pthread_mutex_unlock (&servoLock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * softServoStats:
+ *	How accurate the pulses have been
+ *********************************************************************************
+ */
+
+void softServoStats (struct softServoStats *result)
+{
+  pthread_mutex_lock (&servoLock) ;
+    *result = stats ;
+  pthread_mutex_unlock (&servoLock) ;
 }
 
 
 /*
  * softServoSetup:
- *	Setup the software servo system
+ *	Setup the software servo system, with up to 8 servos (-1 for none).
+ *	More can be added with softServoAdd ()
  *********************************************************************************
  */
 
 int softServoSetup (int p0, int p1, int p2, int p3, int p4, int p5, int p6, int p7)
 {
+  int pins [8] ;
   int servo ;
 
-  if (p0 != -1) { pinMode (p0, OUTPUT) ; digitalWrite (p0, LOW) ; }
-  if (p1 != -1) { pinMode (p1, OUTPUT) ; digitalWrite (p1, LOW) ; }
-  if (p2 != -1) { pinMode (p2, OUTPUT) ; digitalWrite (p2, LOW) ; }
-  if (p3 != -1) { pinMode (p3, OUTPUT) ; digitalWrite (p3, LOW) ; }
-  if (p4 != -1) { pinMode (p4, OUTPUT) ; digitalWrite (p4, LOW) ; }
-  if (p5 != -1) { pinMode (p5, OUTPUT) ; digitalWrite (p5, LOW) ; }
-  if (p6 != -1) { pinMode (p6, OUTPUT) ; digitalWrite (p6, LOW) ; }
-  if (p7 != -1) { pinMode (p7, OUTPUT) ; digitalWrite (p7, LOW) ; }
-
-  pinMap [0] = p0 ;
-  pinMap [1] = p1 ;
-  pinMap [2] = p2 ;
-  pinMap [3] = p3 ;
-  pinMap [4] = p4 ;
-  pinMap [5] = p5 ;
-  pinMap [6] = p6 ;
-  pinMap [7] = p7 ;
-
-  for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
-    pulseWidth [servo] = 1500 ;		// Mid point
-  
-  return piThreadCreate (softServoThread) ;
+  pins [0] = p0 ; pins [1] = p1 ; pins [2] = p2 ; pins [3] = p3 ;
+  pins [4] = p4 ; pins [5] = p5 ; pins [6] = p6 ; pins [7] = p7 ;
+
+  for (servo = 0 ; servo < 8 ; ++servo)
+    if (pins [servo] != -1)
+      if (softServoAdd (pins [servo]) != 0)
+	return -1 ;
+
+  return 0 ;
 }
@@ -2,7 +2,7 @@
  * softServo.h:
  *	Provide N channels of software driven PWM suitable for RC
  *	servo motors.
- *	Copyright (c) 2012 Gordon Henderson
+ *	Copyright (c) 2012-2015 Gordon Henderson
  ***********************************************************************
  * This file is part of wiringPi:
  *	https://projects.drogon.net/raspberry-pi/wiringpi/
@@ -23,12 +23,32 @@
  ***********************************************************************
  */
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// How the pulses have been going. Times are nS; an error is how much
+//	longer a pulse was than asked for.
+
+struct softServoStats
+{
+  uint64_t frames ;		// Frames sent
+  uint64_t skipped ;		// Frames missed because we were late
+  uint64_t pulses ;		// Pulses sent
+  uint64_t totalError ;		// Over all the pulses
+  uint64_t maxError ;		// Worst pulse
+  uint64_t lastError ;		// Worst pulse in the last frame
+  uint64_t maxLate ;		// Worst start of frame
+} ;
+
 extern void softServoWrite  (int pin, int value) ;
-extern int softServoSetup   (int p0, int p1, int p2, int p3, int p4, int p5, int p6, int p7) ;
+extern int  softServoSetup  (int p0, int p1, int p2, int p3, int p4, int p5, int p6, int p7) ;
+extern int  softServoAdd    (int pin) ;
+extern void softServoRemove (int pin) ;
+extern int  softServoFrame  (int uS) ;
+extern void softServoStats  (struct softServoStats *stats) ;
 
 #ifdef __cplusplus
 }
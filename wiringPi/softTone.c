@@ -5,7 +5,7 @@
  *	one (or 2) GPIO pins and a piezeo "speaker" element.
  *	(Or a high impedance speaker, but don'y blame me if you blow-up
  *	the GPIO pins!)
- *	Copyright (c) 2012 Gordon Henderson
+ *	Copyright (c) 2012-2015 Gordon Henderson
  ***********************************************************************
  * This file is part of wiringPi:
  *	https://projects.drogon.net/raspberry-pi/wiringpi/
@@ -26,125 +26,484 @@
  ***********************************************************************
  */
 
+// All the tone pins are run by one thread, in the same way as softPwm:
+//	it works out which pin has the next edge due, sleeps until just
+//	before it and busy-waits the rest of the way (see wpiWaitUntil ()),
+//	then does every edge for that time. Edges on different pins that fall
+//	at the same instant go out as a single bank write, if they're
+//	on-board pins. Pins that aren't are written one at a time with
+//	digitalWrite ().
+//
+//	Each pin has a queue of notes - a frequency, a duration and a duty
+//	cycle - added by softToneQueue (), which the thread plays one after
+//	the other, each starting exactly when the last one ends. A frequency
+//	of 0 is a rest. When a pin has no notes it plays the square wave set
+//	by softToneWrite (), or, if that's 0, is parked until it's given
+//	something to do. With nothing but parked pins, the thread sleeps
+//	until it's woken.
+//
+//	A new frequency from softToneWrite () takes effect at the end of the
+//	current cycle, as does the first note queued on a pin that's not
+//	already playing notes. A pin that's silent starts on the next mS, so
+//	pins started together line up and their edges share bank writes.
+
 #include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
 #include <pthread.h>
 
 #include "wiringPi.h"
 #include "softTone.h"
 
-#define	MAX_PINS	64
+#ifndef	TRUE
+#  define	TRUE	(1==1)
+#  define	FALSE	(!TRUE)
+#endif
+
+#define	MAX_CHANNELS	64
+#define	QUEUE_SIZE	64		// Notes per pin
+
+#define	MAX_FREQ	20000		// Top of what you can hear
+
+#define	GRID_NS		1000000		// Where silent pins start
+
+struct softToneNote
+{
+  int freq ;
+  int duration ;			// mS
+  int duty ;				// %
+} ;
+
+struct softToneChannel
+{
+  int      pin ;
+  int      bank ;
+  uint32_t mask ;			// 0 if it's not an on-board pin
+  int      freq ;			// From softToneWrite ()
 
-#define	PULSE_TIME	100
+  struct softToneNote queue [QUEUE_SIZE] ;
+  int      head ;
+  int      queued ;
+  int      playing ;			// A note from the queue, not freq
 
-static int freqs         [MAX_PINS] ;
-static pthread_t threads [MAX_PINS] ;
+  int      fall ;			// Next edge is the end of the mark
+  uint64_t period ;			// nS, 0 for silence
+  uint64_t mark ;
+  uint64_t start ;			// Start of this cycle
+  uint64_t end ;			// End of this note, WPI_NEVER for freq
+  uint64_t next ;			// When the next edge is due, WPI_NEVER if parked
+} ;
 
-static int newPin = -1 ;
+static pthread_mutex_t toneLock = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t  toneCond ;
+static int             toneRunning = FALSE ;
+
+static struct softToneChannel channels [MAX_CHANNELS] ;
+static int                    numChannels = 0 ;
+
+
+/*
+ * findChannel:
+ *	The channel on a pin, or NULL.
+ *	Called with the lock held.
+ *********************************************************************************
+ */
+
+static struct softToneChannel *findChannel (int pin)
+{
+  int i ;
+
+  for (i = 0 ; i < numChannels ; ++i)
+    if (channels [i].pin == pin)
+      return &channels [i] ;
+
+  return NULL ;
+}
+
+
+/*
+ * softToneStart:
+ *	Start the next note on a channel at the given time, or go back to
+ *	its softToneWrite () frequency if there are none left.
+ *********************************************************************************
+ */
+
+static void softToneStart (struct softToneChannel *ch, uint64_t at)
+{
+  struct softToneNote *note ;
+  int freq, duty ;
+
+  if (ch->queued > 0)
+  {
+    note     = &ch->queue [ch->head] ;
+    ch->head = (ch->head + 1) % QUEUE_SIZE ;
+    --ch->queued ;
+
+    freq        = note->freq ;
+    duty        = note->duty ;
+    ch->end     = at + (uint64_t)note->duration * 1000000 ;
+    ch->playing = TRUE ;
+  }
+  else
+  {
+    freq        = ch->freq ;
+    duty        = 50 ;
+    ch->end     = WPI_NEVER ;
+    ch->playing = FALSE ;
+  }
+
+  ch->start  = at ;
+  ch->next   = at ;
+  ch->period = (freq == 0) ? 0 : 1000000000 / (uint64_t)freq ;
+  ch->mark   = (ch->period * duty) / 100 ;
+}
+
+
+/*
+ * softToneEdge:
+ *	Move a channel on past the edge that's due, returning the level to
+ *	write. Silence is written once, and lasts until the end of the note,
+ *	or for ever (parked) if it's not a note.
+ *********************************************************************************
+ */
+
+static int softToneEdge (struct softToneChannel *ch, uint64_t now)
+{
+  if (ch->fall)
+  {
+    ch->fall = FALSE ;
+    ch->next = ch->start + ch->period ;
+    if (ch->next > ch->end)
+      ch->next = ch->end ;
+    return LOW ;
+  }
+
+// Start of a cycle, or of the next note. If we've fallen a long way
+//	behind, skip the cycles (and notes) we've missed rather than trying
+//	to catch up with them.
+
+  for (;;)
+  {
+    if (ch->next >= ch->end)
+      softToneStart (ch, ch->end) ;
+
+    if ((ch->period == 0) || (ch->next + ch->period > now))
+      break ;
+
+    ch->next += ((now - ch->next) / ch->period) * ch->period ;
+    if (ch->next < ch->end)
+      break ;
+  }
+
+  ch->start = ch->next ;
+
+  if ((ch->period == 0) || (ch->mark == 0))
+  {
+    ch->next = ch->end ;
+    return LOW ;
+  }
+
+  if (ch->mark >= ch->period)
+  {
+    ch->next = ch->end ;
+    return HIGH ;
+  }
+
+  ch->fall = TRUE ;
+  ch->next = ch->start + ch->mark ;
+  if (ch->next > ch->end)
+    ch->next = ch->end ;
+
+  return HIGH ;
+}
 
 
 /*
  * softToneThread:
- *	Thread to do the actual PWM output
+ *	Thread to do the actual tone output, for all the pins.
  *********************************************************************************
  */
 
 static PI_THREAD (softToneThread)
 {
-  int pin, freq, halfPeriod ;
-  struct sched_param param ;
+  struct softToneChannel *ch ;
+  struct wpiBatch batch ;
+  uint64_t when, now ;
+  int i ;
 
-  param.sched_priority = sched_get_priority_max (SCHED_RR) ;
-  pthread_setschedparam (pthread_self (), SCHED_RR, &param) ;
+  (void)piHiPri (90) ;
+  (void)delayThreshold () ;		// Calibrate now, not with the lock held
 
-  pin    = newPin ;
-  newPin = -1 ;
-
-  piHiPri (50) ;
+  pthread_mutex_lock (&toneLock) ;
 
   for (;;)
   {
-    freq = freqs [pin] ;
-    if (freq == 0)
-      delay (1) ;
-    else
-    {
-      halfPeriod = 500000 / freq ;
+    when = WPI_NEVER ;
+    for (i = 0 ; i < numChannels ; ++i)
+      if (channels [i].next < when)
+	when = channels [i].next ;
+
+// Not due yet? Wait, but look again if anything changes
+
+    if (!wpiWaitUntil (&toneCond, &toneLock, when))
+      continue ;
 
-      digitalWrite (pin, HIGH) ;
-      delayMicroseconds (halfPeriod) ;
+// Do all the edges for this time
 
-      digitalWrite (pin, LOW) ;
-      delayMicroseconds (halfPeriod) ;
+    wpiBatchClear (&batch) ;
+    now = nanos () ;
+
+    for (i = 0 ; i < numChannels ; ++i)
+    {
+      ch = &channels [i] ;
+      if (ch->next == when)
+	wpiBatchAdd (&batch, ch->pin, ch->bank, ch->mask, softToneEdge (ch, now)) ;
     }
+
+    (void)wpiBatchWrite (&batch) ;
   }
 
   return NULL ;
 }
 
 
+/*
+ * softToneBreak:
+ *	Bring what a channel's playing to an end when its current cycle
+ *	does (now, if it's silent), unless it's playing notes, so something
+ *	new can start.
+ *	Called with the lock held.
+ *********************************************************************************
+ */
+
+static void softToneBreak (struct softToneChannel *ch)
+{
+  if (ch->end != WPI_NEVER)	// Notes: it'll get there
+    return ;
+
+  ch->end = (ch->period == 0) ? (nanos () / GRID_NS + 1) * GRID_NS : ch->start + ch->period ;
+  if (ch->next > ch->end)
+    ch->next = ch->end ;
+
+  pthread_cond_signal (&toneCond) ;
+}
+
+
 /*
  * softToneWrite:
- *	Write a frequency value to the given pin
+ *	Write a frequency value to the given pin. It's played whenever the
+ *	pin has no notes queued.
  *********************************************************************************
  */
 
 void softToneWrite (int pin, int freq)
 {
-  pin &= 63 ;
+  struct softToneChannel *ch ;
 
   /**/ if (freq < 0)
     freq = 0 ;
-  else if (freq > 5000)	// Max 5KHz
-    freq = 5000 ;
+  else if (freq > MAX_FREQ)
+    freq = MAX_FREQ ;
+
+  pthread_mutex_lock (&toneLock) ;
 
-  freqs [pin] = freq ;
+  if (((ch = findChannel (pin)) != NULL) && (ch->freq != freq))
+  {
+    ch->freq = freq ;
+    softToneBreak (ch) ;
+  }
+
+  pthread_mutex_unlock (&toneLock) ;
+}
+
+
+/*
+ * softToneQueue:
+ *	Add a note to the end of a pin's queue: freq Hz (0 for a rest) for
+ *	duration mS, high for duty % of each cycle. It's played without any
+ *	more from us, starting when the one before it ends.
+ *	Returns 0, or -1 with errno set: EINVAL for a bad note or a pin
+ *	that's not been created, EAGAIN if the queue's full.
+ *********************************************************************************
+ */
+
+int softToneQueue (int pin, int freq, int duration, int duty)
+{
+  struct softToneChannel *ch ;
+  struct softToneNote *note ;
+
+  if ((freq < 0) || (freq > MAX_FREQ) || (duration <= 0) || (duty < 0) || (duty > 100))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  pthread_mutex_lock (&toneLock) ;
+
+  if ((ch = findChannel (pin)) == NULL)
+  {
+    pthread_mutex_unlock (&toneLock) ;
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  if (ch->queued == QUEUE_SIZE)
+  {
+    pthread_mutex_unlock (&toneLock) ;
+    errno = EAGAIN ;
+    return -1 ;
+  }
+
+  note = &ch->queue [(ch->head + ch->queued++) % QUEUE_SIZE] ;
+  note->freq     = freq ;
+  note->duration = duration ;
+  note->duty     = duty ;
+
+  softToneBreak (ch) ;
+
+  pthread_mutex_unlock (&toneLock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * softTonePending:
+ *	How many notes a pin has still to play, including the one it's
+ *	playing now; -1 if it's not been created.
+ *********************************************************************************
+ */
+
+int softTonePending (int pin)
+{
+  struct softToneChannel *ch ;
+  int pending = -1 ;
+
+  pthread_mutex_lock (&toneLock) ;
+    if ((ch = findChannel (pin)) != NULL)
+      pending = ch->queued + (ch->playing ? 1 : 0) ;
+  pthread_mutex_unlock (&toneLock) ;
+
+  return pending ;
+}
+
+
+/*
+ * softToneClear:
+ *	Throw away a pin's notes, including the one it's playing, and go
+ *	back to its softToneWrite () frequency straight away.
+ *********************************************************************************
+ */
+
+void softToneClear (int pin)
+{
+  struct softToneChannel *ch ;
+
+  pthread_mutex_lock (&toneLock) ;
+
+  if ((ch = findChannel (pin)) != NULL)
+  {
+    ch->queued  = 0 ;
+    ch->playing = FALSE ;
+    ch->fall    = FALSE ;
+    ch->end     = nanos () ;
+    ch->next    = ch->end ;
+    pthread_cond_signal (&toneCond) ;
+  }
+
+  pthread_mutex_unlock (&toneLock) ;
 }
 
 
 /*
  * softToneCreate:
- *	Create a new tone thread.
+ *	Create a new tone channel, starting the thread if it's the first.
  *********************************************************************************
  */
 
 int softToneCreate (int pin)
 {
-  int res ;
+  struct softToneChannel *ch ;
+  uint32_t setMask [2], clrMask [2] ;
   pthread_t myThread ;
+  int res ;
 
   pinMode      (pin, OUTPUT) ;
   digitalWrite (pin, LOW) ;
 
-  if (threads [pin] != 0)
+  pthread_mutex_lock (&toneLock) ;
+
+  if ((findChannel (pin) != NULL) || (numChannels == MAX_CHANNELS))
+  {
+    pthread_mutex_unlock (&toneLock) ;
     return -1 ;
+  }
 
-  freqs [pin] = 0 ;
+  if (!toneRunning)
+  {
+    wpiWaitInit (&toneCond) ;
 
-  newPin = pin ;
-  res    = pthread_create (&myThread, NULL, softToneThread, NULL) ;
+    if ((res = pthread_create (&myThread, NULL, softToneThread, NULL)) != 0)
+    {
+      pthread_cond_destroy (&toneCond) ;
+      pthread_mutex_unlock (&toneLock) ;
+      return res ;
+    }
+    pthread_detach (myThread) ;
+    toneRunning = TRUE ;
+  }
 
-  while (newPin != -1)
-    delay (1) ;
+  ch = &channels [numChannels++] ;
+
+  ch->pin     = pin ;
+  ch->bank    = 0 ;
+  ch->mask    = 0 ;
+  ch->freq    = 0 ;
+  ch->head    = 0 ;
+  ch->queued  = 0 ;
+  ch->playing = FALSE ;
+  ch->fall    = FALSE ;
+  ch->period  = 0 ;
+  ch->mark    = 0 ;
+  ch->start   = 0 ;
+  ch->end     = WPI_NEVER ;
+  ch->next    = WPI_NEVER ;	// Parked: silent
+
+  if (digitalPinsToMask (&pin, 1, 0, setMask, clrMask) == 0)
+  {
+    ch->bank = (clrMask [1] != 0) ? 1 : 0 ;
+    ch->mask = clrMask [ch->bank] ;
+  }
 
-  threads [pin] = myThread ;
+  pthread_mutex_unlock (&toneLock) ;
 
-  return res ;
+  return 0 ;
 }
 
 
 /*
  * softToneStop:
- *	Stop an existing softTone thread
+ *	Stop the tone on a pin, throwing away any notes, and leave it low
  *********************************************************************************
  */
 
 void softToneStop (int pin)
 {
-  if (threads [pin] != 0)
+  struct softToneChannel *ch ;
+
+  pthread_mutex_lock (&toneLock) ;
+
+  if ((ch = findChannel (pin)) == NULL)
   {
-    pthread_cancel (threads [pin]) ;
-    pthread_join   (threads [pin], NULL) ;
-    threads [pin] = 0 ;
-    digitalWrite (pin, LOW) ;
+    pthread_mutex_unlock (&toneLock) ;
+    return ;
   }
+
+  *ch = channels [--numChannels] ;
+
+  pthread_cond_signal  (&toneCond) ;
+  pthread_mutex_unlock (&toneLock) ;
+
+  digitalWrite (pin, LOW) ;
 }
@@ -5,7 +5,7 @@
  *	one (or 2) GPIO pins and a piezeo "speaker" element.
  *	(Or a high impedance speaker, but don'y blame me if you blow-up
  *	the GPIO pins!)
- *	Copyright (c) 2012 Gordon Henderson
+ *	Copyright (c) 2012-2015 Gordon Henderson
  ***********************************************************************
  * This file is part of wiringPi:
  *	https://projects.drogon.net/raspberry-pi/wiringpi/
@@ -30,9 +30,12 @@
 extern "C" {
 #endif
 
-extern int  softToneCreate (int pin) ;
-extern void softToneStop   (int pin) ;
-extern void softToneWrite  (int pin, int freq) ;
+extern int  softToneCreate  (int pin) ;
+extern void softToneStop    (int pin) ;
+extern void softToneWrite   (int pin, int freq) ;
+extern int  softToneQueue   (int pin, int freq, int duration, int duty) ;
+extern int  softTonePending (int pin) ;
+extern void softToneClear   (int pin) ;
 
 #ifdef __cplusplus
 }
@@ -55,6 +55,7 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <poll.h>
@@ -69,11 +70,14 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/ioctl.h>
+#include <sys/epoll.h>
 
 #include "softPwm.h"
 #include "softTone.h"
 
 #include "wiringPi.h"
+#include "wiringPiSim.h"
+#include "wiringPiChip.h"
 
 #ifndef	TRUE
 #define	TRUE	(1==1)
@@ -85,6 +89,8 @@
 #define	ENV_DEBUG	"WIRINGPI_DEBUG"
 #define	ENV_CODES	"WIRINGPI_CODES"
 #define	ENV_GPIOMEM	"WIRINGPI_GPIOMEM"
+#define	ENV_SIM		"WIRINGPI_SIM"
+#define	ENV_GPIOCHIP	"WIRINGPI_GPIOCHIP"
 
 
 // Mask for the bottom 64 pins which belong to the Raspberry Pi
@@ -176,30 +182,52 @@ static volatile unsigned int GPIO_PWM ;
 #define	PWM1_SERIAL     0x0200  // Run in serial mode
 #define	PWM1_ENABLE     0x0100  // Channel Enable
 
-// Timer
-//	Word offsets
+// System Timer
+//	Word offsets. A free-running 64-bit counter at 1MHz.
 
-#define	TIMER_LOAD	(0x400 >> 2)
-#define	TIMER_VALUE	(0x404 >> 2)
-#define	TIMER_CONTROL	(0x408 >> 2)
-#define	TIMER_IRQ_CLR	(0x40C >> 2)
-#define	TIMER_IRQ_RAW	(0x410 >> 2)
-#define	TIMER_IRQ_MASK	(0x414 >> 2)
-#define	TIMER_RELOAD	(0x418 >> 2)
-#define	TIMER_PRE_DIV	(0x41C >> 2)
-#define	TIMER_COUNTER	(0x420 >> 2)
+#define	TIMER_CS	0
+#define	TIMER_CLO	1
+#define	TIMER_CHI	2
 
-// Locals to hold pointers to the hardware
+// wpiContext:
+//	Everything needed to get at one lot of GPIO pins - see the _ctx
+//	functions. The normal API uses defaultCtx, set up by wiringPiSetup*
+//	Other contexts always use BCM_GPIO pin numbers.
 
-static volatile uint32_t *gpio ;
-static volatile uint32_t *pwm ;
-static volatile uint32_t *clk ;
+struct wpiContext
+{
+  int                mode ;		// WPI_MODE_
+  volatile uint32_t *gpio ;		// Registers, when memory mapped (or simulated)
+  struct wpiSim     *sim ;		// The simulator, if that's what it is
+  struct wpiChip    *chip ;		// gpiochip mode
+  int               *pinToGpio ;	// Pin number translation
+  int               *physToGpio ;
+  int                sysFds [64] ;	// Sys mode: /sys/class/gpio/gpioX/value
+} ;
+
+static struct wpiContext defaultCtx =
+{
+  WPI_MODE_UNINITIALISED, NULL, NULL, NULL, NULL, NULL,
+  {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  },
+} ;
+
+// Locals to hold pointers to the rest of the hardware
+
+static volatile uint32_t *pwm ;		// These 3 are mapped when first
+static volatile uint32_t *clk ;		//	needed - see periMapped ()
 static volatile uint32_t *pads ;
 
-#ifdef	USE_TIMER
-static volatile uint32_t *timer ;
-static volatile uint32_t *timerIrqRaw ;
-#endif
+static volatile uint32_t *timer = NULL ;	// Only with /dev/mem
+
+// The /dev/mem (or gpiomem) file, kept open for the lazy mappings
+
+static int memFd = -1 ;
+static pthread_mutex_t periMutex = PTHREAD_MUTEX_INITIALIZER ;
 
 
 // Data for use with the boardId functions.
@@ -282,14 +310,20 @@ const int piMemorySize [8] =
 } ;
 
 // Time for easy calculations
+//	All from CLOCK_MONOTONIC, so they don't jump when the wall clock is set
+
+static uint64_t epochMilli, epochMicro, epochNano ;
+static uint64_t epochTimer ;
 
-static uint64_t epochMilli, epochMicro ;
+// delayUntil () busy-waits for the last this many nS, as the kernel
+//	can't wake us up any closer than that. Measured once, by
+//	delayThreshold (), when first needed, or by delayCalibrate ()
+//	when asked. delayMicroseconds () doesn't use it.
 
-// Misc
+#define	CALIBRATE_SAMPLES	20
 
-static int wiringPiMode = WPI_MODE_UNINITIALISED ;
-static volatile int    pinPass = -1 ;
-static pthread_mutex_t pinMutex ;
+static unsigned int   spinThreshold = 100000 ;
+static pthread_once_t spinOnce      = PTHREAD_ONCE_INIT ;
 
 // Debugging & Return codes
 
@@ -300,21 +334,78 @@ int wiringPiReturnCodes = FALSE ;
 
 int wiringPiTryGpioMem  = FALSE ;
 
-// sysFds:
-//	Map a file descriptor from the /sys/class/gpio/gpioX/value
+// Use simulated hardware?
 
-static int sysFds [64] =
+int wiringPiSimulate    = FALSE ;
+
+// simSync:
+//	Make the simulated hardware (if any) act on our register writes now,
+//	rather than when its model thread next gets round to it. Only used
+//	in the slower functions where a sequence of writes matters. Pin
+//	writes don't need it: on the simulator they go to wiringPiSimWrite ()
+//	rather than GPSET/GPCLR.
+
+static inline void ctxSimSync (struct wpiContext *ctx)
 {
-  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-} ;
+  if (ctx->sim != NULL)
+    wiringPiSimSync (ctx->sim) ;
+}
+
+static inline void simSync (void)
+{
+  ctxSimSync (&defaultCtx) ;
+}
+
+// periMapped:
+//	Map the PWM, clock and pads blocks the first time something needs
+//	them - most programs never do, so why pay for it at setup time?
+//	Returns FALSE if they can't be had (e.g. /dev/gpiomem only maps the
+//	GPIO, and Sys mode has nothing at all).
+
+static int periMap (void) ;
+
+static inline int periMapped (void)
+{
+  if (pwm != NULL)
+    return TRUE ;
+
+  return periMap () ;
+}
+
+// pudKnown: pudUp: pudDown:
+//	The pull-up/down registers can't be read back, so we remember what
+//	we've set them to, for wpiStateSave ()
+
+static uint32_t pudKnown [2] ;
+static uint32_t pudUp    [2] ;
+static uint32_t pudDown  [2] ;
+
+static void pudCycle (struct wpiContext *ctx, int pud, uint32_t mask0, uint32_t mask1) ;
 
 // ISR Data
 
 static void (*isrFunctions [64])(void) ;
 
+// ISR dispatcher: One thread and one epoll set for all the pins,
+//	with the table indexed by BCM_GPIO pin. In gpiochip mode all the
+//	pins share one file descriptor, so that goes in with a tag of its own.
+
+#define	ISR_CHIP	64
+
+struct isrDispatchStruct
+{
+  void (*function)(int pin, void *userData) ;
+  void  *userData ;
+  struct wpiEventRing *ring ;		// Capture the events here instead
+  int    pin ;				// As the user gave it to us
+  uint32_t seq ;			// Edge count, when the kernel doesn't keep one
+} ;
+
+static struct isrDispatchStruct isrDispatch [64] ;
+static pthread_mutex_t isrMutex   = PTHREAD_MUTEX_INITIALIZER ;
+static int             isrEpollFd = -1 ;
+static int             isrChipAdded = FALSE ;
+
 
 // Doing it the Arduino way with lookup tables...
 //	Yes, it's probably more innefficient than all the bit-twidling, but it
@@ -324,8 +415,6 @@ static void (*isrFunctions [64])(void) ;
 //	Take a Wiring pin (0 through X) and re-map it to the BCM_GPIO pin
 //	Cope for 3 different board revisions here.
 
-static int *pinToGpio ;
-
 // Revision 1, 1.1:
 
 static int pinToGpioR1 [64] =
@@ -369,8 +458,6 @@ static int pinToGpioR2 [64] =
 //	Cope for 2 different board revisions here.
 //	Also add in the P5 connector, so the P5 pins are 3,4,5,6, so 53,54,55,56
 
-static int *physToGpio ;
-
 static int physToGpioR1 [64] =
 {
   -1,		// 0
@@ -461,6 +548,7 @@ static uint8_t gpioToShift [] =
   0,3,6,9,12,15,18,21,24,27,
   0,3,6,9,12,15,18,21,24,27,
   0,3,6,9,12,15,18,21,24,27,
+  0,3,6,9,12,15,18,21,24,27,
 } ;
 
 
@@ -493,7 +581,6 @@ static uint8_t gpioToGPLEV [] =
 } ;
 
 
-#ifdef notYetReady
 // gpioToEDS
 //	(Word) offset to the Event Detect Status
 
@@ -520,7 +607,24 @@ static uint8_t gpioToFEN [] =
   22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,22,
   23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,23,
 } ;
-#endif
+
+// gpioToAREN
+//	(Word) offset to the Asynchronous Rising edge ENable register
+
+static uint8_t gpioToAREN [] =
+{
+  31,31,31,31,31,31,31,31,31,31,31,31,31,31,31,31,31,31,31,31,31,31,31,31,31,31,31,31,31,31,31,31,
+  32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,
+} ;
+
+// gpioToAFEN
+//	(Word) offset to the Asynchronous Falling edge ENable register
+
+static uint8_t gpioToAFEN [] =
+{
+  34,34,34,34,34,34,34,34,34,34,34,34,34,34,34,34,34,34,34,34,34,34,34,34,34,34,34,34,34,34,34,34,
+  35,35,35,35,35,35,35,35,35,35,35,35,35,35,35,35,35,35,35,35,35,35,35,35,35,35,35,35,35,35,35,35,
+} ;
 
 
 // GPPUD:
@@ -681,24 +785,61 @@ static void piBoardRevOops (const char *why)
   exit (EXIT_FAILURE) ;
 }
 
-int piBoardRev (void)
+/*
+ * piRevision:
+ *	Find the board's revision code, as a string of hex digits, and keep it
+ *	so we only have to do this once, however many times we're asked.
+ *	The firmware puts it in the device tree, which is quick to read. If
+ *	that's not there, then /proc/cpuinfo, which is much slower - there we
+ *	also check it's a Pi while we're about it.
+ *	Also works out if it's a Pi v2.
+ *********************************************************************************
+ */
+
+static const char *piRevision (void)
 {
-  FILE *cpuFd ;
+  static char revision [20] = "" ;
+  FILE *fd ;
+  uint8_t dt [4] ;
+  uint32_t value ;
   char line [120] ;
   char *c ;
-  static int  boardRev = -1 ;
 
-  if (boardRev != -1)	// No point checking twice
-    return boardRev ;
+  if (revision [0] != 0)
+    return revision ;
+
+// Device tree: A big-endian 32-bit number
+
+  if ((fd = fopen ("/proc/device-tree/system/linux,revision", "r")) != NULL)
+  {
+    if (fread (dt, 1, 4, fd) == 4)
+    {
+      value = ((uint32_t)dt [0] << 24) | ((uint32_t)dt [1] << 16) | ((uint32_t)dt [2] << 8) | (uint32_t)dt [3] ;
+      snprintf (revision, sizeof (revision), "%04x", value) ;
+
+// New style codes have the processor in them: BCM2836 and up mean a v2
+
+      if (((value & (1 << 23)) != 0) && (((value >> 12) & 0x0F) != 0))
+	piModel2 = TRUE ;
+    }
+    fclose (fd) ;
+
+    if (revision [0] != 0)
+    {
+      if (wiringPiDebug)
+	printf ("piRevision: Device tree revision: %s\n", revision) ;
+      return revision ;
+    }
+  }
 
-  if ((cpuFd = fopen ("/proc/cpuinfo", "r")) == NULL)
+  if ((fd = fopen ("/proc/cpuinfo", "r")) == NULL)
     piBoardRevOops ("Unable to open /proc/cpuinfo") ;
 
 // Start by looking for the Architecture to make sure we're really running
 //	on a Pi. I'm getting fed-up with people whinging at me because
 //	they can't get it to work on weirdFruitPi boards...
 
-  while (fgets (line, 120, cpuFd) != NULL)
+  while (fgets (line, 120, fd) != NULL)
     if (strncmp (line, "Hardware", 8) == 0)
       break ;
 
@@ -706,16 +847,12 @@ int piBoardRev (void)
     piBoardRevOops ("No hardware line") ;
 
   if (wiringPiDebug)
-    printf ("piboardRev: Hardware: %s\n", line) ;
+    printf ("piRevision: Hardware: %s\n", line) ;
 
 // See if it's BCM2708 or BCM2709
 
-  if (strstr (line, "BCM2709") != NULL)	// Pi v2 - no point doing anything more at this point
-  {
+  if (strstr (line, "BCM2709") != NULL)
     piModel2 = TRUE ;
-    fclose (cpuFd) ;
-    return boardRev = 2 ;
-  }
   else if (strstr (line, "BCM2708") == NULL)
   {
     fprintf (stderr, "Unable to determine hardware version. I see: %s,\n", line) ;
@@ -727,17 +864,14 @@ int piBoardRev (void)
     exit (EXIT_FAILURE) ;
   }
 
-// Now do the rest of it as before - we just need to see if it's an older
-//	Rev 1 as anything else is rev 2.
-
 // Isolate the Revision line
 
-  rewind (cpuFd) ;
-  while (fgets (line, 120, cpuFd) != NULL)
+  rewind (fd) ;
+  while (fgets (line, 120, fd) != NULL)
     if (strncmp (line, "Revision", 8) == 0)
       break ;
 
-  fclose (cpuFd) ;
+  fclose (fd) ;
 
   if (strncmp (line, "Revision", 8) != 0)
     piBoardRevOops ("No \"Revision\" line") ;
@@ -748,7 +882,7 @@ int piBoardRev (void)
     *c = 0 ;
   
   if (wiringPiDebug)
-    printf ("piboardRev: Revision string: %s\n", line) ;
+    printf ("piRevision: Revision string: %s\n", line) ;
 
 // Scan to the first character of the revision number
 
@@ -768,6 +902,27 @@ int piBoardRev (void)
   if (!isxdigit (*c))
     piBoardRevOops ("Bogus \"Revision\" line (no hex digit at start of revision)") ;
 
+  snprintf (revision, sizeof (revision), "%s", c) ;
+
+  return revision ;
+}
+
+int piBoardRev (void)
+{
+  const char *c ;
+  static int  boardRev = -1 ;
+
+  if (boardRev != -1)	// No point checking twice
+    return boardRev ;
+
+  if (getenv (ENV_SIM) != NULL)	// Simulated hardware looks like a Pi 2
+  {
+    piModel2 = TRUE ;
+    return boardRev = 2 ;
+  }
+
+  c = piRevision () ;
+
 // Make sure its long enough
 
   if (strlen (c) < 4)
@@ -864,9 +1019,7 @@ int piBoardRev (void)
 
 void piBoardId (int *model, int *rev, int *mem, int *maker, int *warranty)
 {
-  FILE *cpuFd ;
-  char line [120] ;
-  char *c ;
+  const char *c ;
   unsigned int revision ;
   int bRev, bType, bProc, bMfg, bMem, bWarranty ;
 
@@ -875,46 +1028,19 @@ void piBoardId (int *model, int *rev, int *mem, int *maker, int *warranty)
 
   (void)piBoardRev () ;	// Call this first to make sure all's OK. Don't care about the result.
 
-  if ((cpuFd = fopen ("/proc/cpuinfo", "r")) == NULL)
-    piBoardRevOops ("Unable to open /proc/cpuinfo") ;
-
-  while (fgets (line, 120, cpuFd) != NULL)
-    if (strncmp (line, "Revision", 8) == 0)
-      break ;
-
-  fclose (cpuFd) ;
-
-  if (strncmp (line, "Revision", 8) != 0)
-    piBoardRevOops ("No \"Revision\" line") ;
+  if (getenv (ENV_SIM) != NULL)
+  {
+    *model = PI_MODEL_2 ; *rev = PI_VERSION_1_1 ; *mem = 2 ; *maker = PI_MAKER_SONY ; *warranty = 0 ;
+    return ;
+  }
 
-// Chomp trailing CR/NL
+  c = piRevision () ;
 
-  for (c = &line [strlen (line) - 1] ; (*c == '\n') || (*c == '\r') ; --c)
-    *c = 0 ;
-  
   if (wiringPiDebug)
-    printf ("piboardId: Revision string: %s\n", line) ;
+    printf ("piboardId: Revision string: %s\n", c) ;
 
 // Need to work out if it's using the new or old encoding scheme:
 
-// Scan to the first character of the revision number
-
-  for (c = line ; *c ; ++c)
-    if (*c == ':')
-      break ;
-
-  if (*c != ':')
-    piBoardRevOops ("Bogus \"Revision\" line (no colon)") ;
-
-// Chomp spaces
-
-  ++c ;
-  while (isspace (*c))
-    ++c ;
-
-  if (!isxdigit (*c))
-    piBoardRevOops ("Bogus \"Revision\" line (no hex digit at start of revision)") ;
-
   revision = (unsigned int)strtol (c, NULL, 16) ; // Hex number with no leading 0x
 
 // Check for new way:
@@ -996,7 +1122,7 @@ void piBoardId (int *model, int *rev, int *mem, int *maker, int *warranty)
 
 int wpiPinToGpio (int wpiPin)
 {
-  return pinToGpio [wpiPin & 63] ;
+  return defaultCtx.pinToGpio [wpiPin & 63] ;
 }
 
 
@@ -1009,7 +1135,7 @@ int wpiPinToGpio (int wpiPin)
 
 int physPinToGpio (int physPin)
 {
-  return physToGpio [physPin & 63] ;
+  return defaultCtx.physToGpio [physPin & 63] ;
 }
 
 
@@ -1023,9 +1149,9 @@ void setPadDrive (int group, int value)
 {
   uint32_t wrVal ;
 
-  if ((wiringPiMode == WPI_MODE_PINS) || (wiringPiMode == WPI_MODE_PHYS) || (wiringPiMode == WPI_MODE_GPIO))
+  if ((defaultCtx.mode == WPI_MODE_PINS) || (defaultCtx.mode == WPI_MODE_PHYS) || (defaultCtx.mode == WPI_MODE_GPIO))
   {
-    if (RASPBERRY_PI_PERI_BASE == 0)	// Ignore for now
+    if (!periMapped ())		// Not with /dev/gpiomem
       return ;
 
     if ((group < 0) || (group > 2))
@@ -1056,17 +1182,17 @@ int getAlt (int pin)
 
   pin &= 63 ;
 
-  /**/ if (wiringPiMode == WPI_MODE_PINS)
-    pin = pinToGpio [pin] ;
-  else if (wiringPiMode == WPI_MODE_PHYS)
-    pin = physToGpio [pin] ;
-  else if (wiringPiMode != WPI_MODE_GPIO)
+  /**/ if (defaultCtx.mode == WPI_MODE_PINS)
+    pin = defaultCtx.pinToGpio [pin] ;
+  else if (defaultCtx.mode == WPI_MODE_PHYS)
+    pin = defaultCtx.physToGpio [pin] ;
+  else if (defaultCtx.mode != WPI_MODE_GPIO)
     return 0 ;
 
   fSel    = gpioToGPFSEL [pin] ;
   shift   = gpioToShift  [pin] ;
 
-  alt = (*(gpio + fSel) >> shift) & 7 ;
+  alt = (*(defaultCtx.gpio + fSel) >> shift) & 7 ;
 
   return alt ;
 }
@@ -1080,8 +1206,11 @@ int getAlt (int pin)
 
 void pwmSetMode (int mode)
 {
-  if ((wiringPiMode == WPI_MODE_PINS) || (wiringPiMode == WPI_MODE_PHYS) || (wiringPiMode == WPI_MODE_GPIO))
+  if ((defaultCtx.mode == WPI_MODE_PINS) || (defaultCtx.mode == WPI_MODE_PHYS) || (defaultCtx.mode == WPI_MODE_GPIO))
   {
+    if (!periMapped ())		// Not with /dev/gpiomem
+      return ;
+
     if (mode == PWM_MODE_MS)
       *(pwm + PWM_CONTROL) = PWM0_ENABLE | PWM1_ENABLE | PWM0_MS_MODE | PWM1_MS_MODE ;
     else
@@ -1099,9 +1228,9 @@ void pwmSetMode (int mode)
 
 void pwmSetRange (unsigned int range)
 {
-  if ((wiringPiMode == WPI_MODE_PINS) || (wiringPiMode == WPI_MODE_PHYS) || (wiringPiMode == WPI_MODE_GPIO))
+  if ((defaultCtx.mode == WPI_MODE_PINS) || (defaultCtx.mode == WPI_MODE_PHYS) || (defaultCtx.mode == WPI_MODE_GPIO))
   {
-    if (RASPBERRY_PI_PERI_BASE == 0)	// Ignore for now
+    if (!periMapped ())		// Not with /dev/gpiomem
       return ;
 
     *(pwm + PWM0_RANGE) = range ; delayMicroseconds (10) ;
@@ -1123,9 +1252,9 @@ void pwmSetClock (int divisor)
   uint32_t pwm_control ;
   divisor &= 4095 ;
 
-  if ((wiringPiMode == WPI_MODE_PINS) || (wiringPiMode == WPI_MODE_PHYS) || (wiringPiMode == WPI_MODE_GPIO))
+  if ((defaultCtx.mode == WPI_MODE_PINS) || (defaultCtx.mode == WPI_MODE_PHYS) || (defaultCtx.mode == WPI_MODE_GPIO))
   {
-    if (RASPBERRY_PI_PERI_BASE == 0)	// Ignore for now
+    if (!periMapped ())		// Not with /dev/gpiomem
       return ;
 
     if (wiringPiDebug)
@@ -1173,14 +1302,14 @@ void gpioClockSet (int pin, int freq)
 
   pin &= 63 ;
 
-  /**/ if (wiringPiMode == WPI_MODE_PINS)
-    pin = pinToGpio [pin] ;
-  else if (wiringPiMode == WPI_MODE_PHYS)
-    pin = physToGpio [pin] ;
-  else if (wiringPiMode != WPI_MODE_GPIO)
+  /**/ if (defaultCtx.mode == WPI_MODE_PINS)
+    pin = defaultCtx.pinToGpio [pin] ;
+  else if (defaultCtx.mode == WPI_MODE_PHYS)
+    pin = defaultCtx.physToGpio [pin] ;
+  else if (defaultCtx.mode != WPI_MODE_GPIO)
     return ;
   
-  if (RASPBERRY_PI_PERI_BASE == 0)	// Ignore for now
+  if (!periMapped ())		// Not with /dev/gpiomem
     return ;
 
   divi = 19200000 / freq ;
@@ -1200,170 +1329,541 @@ void gpioClockSet (int pin, int freq)
 
 
 /*
- * wiringPiFindNode:
- *      Locate our device node
+ * wpiStateSave:
+ *	Take a copy of the GPIO set-up: function selects, levels, pull-up/downs
+ *	(the ones we know), PWM, clocks and pad drive, straight from the
+ *	registers. PWM, clocks and pads aren't there with /dev/gpiomem - see
+ *	state->valid for what we got.
+ *	Returns 0, or -1 if the pins aren't memory mapped (Sys and gpiochip
+ *	modes).
  *********************************************************************************
  */
 
-struct wiringPiNodeStruct *wiringPiFindNode (int pin)
+int wpiStateSave (struct wpiState *state)
 {
-  struct wiringPiNodeStruct *node = wiringPiNodes ;
+  int i ;
 
-  while (node != NULL)
-    if ((pin >= node->pinBase) && (pin <= node->pinMax))
-      return node ;
-    else
-      node = node->next ;
+  memset (state, 0, sizeof (struct wpiState)) ;
 
-  return NULL ;
-}
+  if ((defaultCtx.mode != WPI_MODE_PINS) && (defaultCtx.mode != WPI_MODE_PHYS) && (defaultCtx.mode != WPI_MODE_GPIO))
+    return -1 ;
 
+  for (i = 0 ; i < 6 ; ++i)
+    state->fsel [i] = *(defaultCtx.gpio + i) ;
 
-/*
- * wiringPiNewNode:
- *	Create a new GPIO node into the wiringPi handling system
- *********************************************************************************
- */
+  for (i = 0 ; i < 2 ; ++i)
+  {
+    state->level    [i] = *(defaultCtx.gpio + gpioToGPLEV [i << 5]) ;
+    state->pudKnown [i] = pudKnown [i] ;
+    state->pudUp    [i] = pudUp    [i] ;
+    state->pudDown  [i] = pudDown  [i] ;
+  }
+  state->valid = WPI_STATE_GPIO ;
 
-static void pinModeDummy             (struct wiringPiNodeStruct *node, int pin, int mode)  { return ; }
-static void pullUpDnControlDummy     (struct wiringPiNodeStruct *node, int pin, int pud)   { return ; }
-static int  digitalReadDummy         (struct wiringPiNodeStruct *node, int pin)            { return LOW ; }
-static void digitalWriteDummy        (struct wiringPiNodeStruct *node, int pin, int value) { return ; }
-static void pwmWriteDummy            (struct wiringPiNodeStruct *node, int pin, int value) { return ; }
-static int  analogReadDummy          (struct wiringPiNodeStruct *node, int pin)            { return 0 ; }
-static void analogWriteDummy         (struct wiringPiNodeStruct *node, int pin, int value) { return ; }
+  if (!periMapped ())
+    return 0 ;
 
-struct wiringPiNodeStruct *wiringPiNewNode (int pinBase, int numPins)
-{
-  int    pin ;
-  struct wiringPiNodeStruct *node ;
+  state->pwm [0] = *(pwm + PWM_CONTROL) ;
+  state->pwm [1] = *(pwm + PWM0_RANGE) ;
+  state->pwm [2] = *(pwm + PWM0_DATA) ;
+  state->pwm [3] = *(pwm + PWM1_RANGE) ;
+  state->pwm [4] = *(pwm + PWM1_DATA) ;
+  state->pwmClk [0] = *(clk + PWMCLK_CNTL) & 0x00FFFFFF ;
+  state->pwmClk [1] = *(clk + PWMCLK_DIV)  & 0x00FFFFFF ;
 
-// Minimum pin base is 64
+  for (i = 0 ; i < 3 ; ++i)
+  {
+    state->gpClk [i][0] = *(clk + 28 + i * 2) & 0x00FFFFFF ;
+    state->gpClk [i][1] = *(clk + 29 + i * 2) & 0x00FFFFFF ;
+    state->pads  [i]    = *(pads + 11 + i) & 0x1F ;
+  }
 
-  if (pinBase < 64)
-    (void)wiringPiFailure (WPI_FATAL, "wiringPiNewNode: pinBase of %d is < 64\n", pinBase) ;
+  state->valid |= WPI_STATE_PWM | WPI_STATE_CLK | WPI_STATE_PADS ;
 
-// Check all pins in-case there is overlap:
+  return 0 ;
+}
 
-  for (pin = pinBase ; pin < (pinBase + numPins) ; ++pin)
-    if (wiringPiFindNode (pin) != NULL)
-      (void)wiringPiFailure (WPI_FATAL, "wiringPiNewNode: Pin %d overlaps with existing definition\n", pin) ;
 
-  node = (struct wiringPiNodeStruct *)calloc (sizeof (struct wiringPiNodeStruct), 1) ;	// calloc zeros
-  if (node == NULL)
-    (void)wiringPiFailure (WPI_FATAL, "wiringPiNewNode: Unable to allocate memory: %s\n", strerror (errno)) ;
+/*
+ * clockRestore:
+ *	Put a clock generator back how it was, if it's changed. It has to be
+ *	stopped to change the divisor - see pwmSetClock ()
+ *********************************************************************************
+ */
 
-  node->pinBase         = pinBase ;
-  node->pinMax          = pinBase + numPins - 1 ;
-  node->pinMode         = pinModeDummy ;
-  node->pullUpDnControl = pullUpDnControlDummy ;
-  node->digitalRead     = digitalReadDummy ;
-  node->digitalWrite    = digitalWriteDummy ;
-  node->pwmWrite        = pwmWriteDummy ;
-  node->analogRead      = analogReadDummy ;
-  node->analogWrite     = analogWriteDummy ;
-  node->next            = wiringPiNodes ;
-  wiringPiNodes         = node ;
+static void clockRestore (int ctlReg, int divReg, uint32_t ctl, uint32_t div)
+{
+  if (((*(clk + ctlReg) & 0x00FFFF7F) == (ctl & 0x00FFFF7F)) && ((*(clk + divReg) & 0x00FFFFFF) == div))
+    return ;
 
-  return node ;
+  *(clk + ctlReg) = BCM_PASSWORD | (ctl & 0x0F) ;		// Stop, same source
+    delayMicroseconds (110) ;
+  while ((*(clk + ctlReg) & 0x80) != 0)
+    delayMicroseconds (1) ;
+
+  *(clk + divReg) = BCM_PASSWORD | (div & 0x00FFFFFF) ;
+  *(clk + ctlReg) = BCM_PASSWORD | (ctl & 0x00FFFF7F) ;
 }
 
 
-#ifdef notYetReady
 /*
- * pinED01:
- * pinED10:
- *	Enables edge-detect mode on a pin - from a 0 to a 1 or 1 to 0
- *	Pin must already be in input mode with appropriate pull up/downs set.
+ * wpiStateRestore:
+ *	Put things back the way wpiStateSave () found them, writing only what
+ *	has changed, and in an order that shouldn't glitch the outputs: the
+ *	levels first, then pulls, pads, clocks and PWM, and the function
+ *	selects last of all.
+ *	Returns 0, or -1 if the pins aren't memory mapped.
  *********************************************************************************
  */
 
-void pinEnableED01Pi (int pin)
+int wpiStateRestore (const struct wpiState *state)
 {
-  pin = pinToGpio [pin & 63] ;
+  uint32_t outputs [2], bits, pwmControl ;
+  int i, pin, pud ;
+
+  if ((defaultCtx.mode != WPI_MODE_PINS) && (defaultCtx.mode != WPI_MODE_PHYS) && (defaultCtx.mode != WPI_MODE_GPIO))
+    return -1 ;
+
+  if ((state->valid & WPI_STATE_GPIO) != 0)
+  {
+
+// Output latches for the pins that are to be outputs
+
+    outputs [0] = outputs [1] = 0 ;
+    for (pin = 0 ; pin < 54 ; ++pin)
+      if (((state->fsel [pin / 10] >> ((pin % 10) * 3)) & 7) == 1)
+	outputs [pin >> 5] |= 1 << (pin & 31) ;
+
+    for (i = 0 ; i < 2 ; ++i)
+      digitalWriteBank (i, outputs [i] & state->level [i], outputs [i] & ~state->level [i]) ;
+
+// Pull-up/downs: only the ones we knew about, and only if they're different
+
+    for (pud = PUD_OFF ; pud <= PUD_UP ; ++pud)
+    {
+      for (i = 0 ; i < 2 ; ++i)
+      {
+	/**/ if (pud == PUD_UP)
+	  outputs [i] = state->pudKnown [i] & state->pudUp [i] ;
+	else if (pud == PUD_DOWN)
+	  outputs [i] = state->pudKnown [i] & state->pudDown [i] ;
+	else
+	  outputs [i] = state->pudKnown [i] & ~(state->pudUp [i] | state->pudDown [i]) ;
+
+	bits = (pud == PUD_UP) ? pudUp [i] : (pud == PUD_DOWN) ? pudDown [i] : ~(pudUp [i] | pudDown [i]) ;
+	outputs [i] &= ~(pudKnown [i] & bits) ;
+      }
+      if ((outputs [0] | outputs [1]) != 0)
+	pudCycle (&defaultCtx, pud, outputs [0], outputs [1]) ;
+    }
+  }
+
+  if (periMapped ())
+  {
+    if ((state->valid & WPI_STATE_PADS) != 0)
+      for (i = 0 ; i < 3 ; ++i)
+	if ((*(pads + 11 + i) & 0x1F) != state->pads [i])
+	  *(pads + 11 + i) = BCM_PASSWORD | state->pads [i] ;
+
+    if ((state->valid & WPI_STATE_CLK) != 0)
+      for (i = 0 ; i < 3 ; ++i)
+	clockRestore (28 + i * 2, 29 + i * 2, state->gpClk [i][0], state->gpClk [i][1]) ;
+
+    if ((state->valid & WPI_STATE_PWM) != 0)
+    {
+      pwmControl = *(pwm + PWM_CONTROL) ;
+      if ((pwmControl != state->pwm [0]) ||
+	  (*(pwm + PWM0_RANGE) != state->pwm [1]) || (*(pwm + PWM0_DATA) != state->pwm [2]) ||
+	  (*(pwm + PWM1_RANGE) != state->pwm [3]) || (*(pwm + PWM1_DATA) != state->pwm [4]) ||
+	  ((*(clk + PWMCLK_CNTL) & 0x00FFFF7F) != (state->pwmClk [0] & 0x00FFFF7F)) ||
+	  ((*(clk + PWMCLK_DIV)  & 0x00FFFFFF) != state->pwmClk [1]))
+      {
+	*(pwm + PWM_CONTROL) = 0 ;				// Stop PWM
+	clockRestore (PWMCLK_CNTL, PWMCLK_DIV, state->pwmClk [0], state->pwmClk [1]) ;
+	*(pwm + PWM0_RANGE) = state->pwm [1] ; delayMicroseconds (10) ;
+	*(pwm + PWM0_DATA)  = state->pwm [2] ;
+	*(pwm + PWM1_RANGE) = state->pwm [3] ; delayMicroseconds (10) ;
+	*(pwm + PWM1_DATA)  = state->pwm [4] ;
+	*(pwm + PWM_CONTROL) = state->pwm [0] ;
+      }
+    }
+  }
+
+// Function selects last, so pins come up with everything else in place
+
+  if ((state->valid & WPI_STATE_GPIO) != 0)
+  {
+    for (i = 0 ; i < 6 ; ++i)
+      if (*(defaultCtx.gpio + i) != state->fsel [i])
+	*(defaultCtx.gpio + i) = state->fsel [i] ;
+    simSync () ;
+  }
+
+  return 0 ;
 }
-#endif
 
 
 /*
- *********************************************************************************
- * Core Functions
+ * stateFields:
+ *	The text form of a struct wpiState: one line per field, the name then
+ *	the value(s) in hex. Lines starting with # are ignored.
  *********************************************************************************
  */
 
+static const struct
+{
+  const char *name ;
+  size_t      offset ;
+  int         count ;
+} stateFields [] =
+{
+  { "valid",    offsetof (struct wpiState, valid),    1 },
+  { "fsel",     offsetof (struct wpiState, fsel),     6 },
+  { "level",    offsetof (struct wpiState, level),    2 },
+  { "pudknown", offsetof (struct wpiState, pudKnown), 2 },
+  { "pudup",    offsetof (struct wpiState, pudUp),    2 },
+  { "puddown",  offsetof (struct wpiState, pudDown),  2 },
+  { "pwm",      offsetof (struct wpiState, pwm),      5 },
+  { "pwmclk",   offsetof (struct wpiState, pwmClk),   2 },
+  { "gpclk",    offsetof (struct wpiState, gpClk),    6 },
+  { "pads",     offsetof (struct wpiState, pads),     3 },
+  { NULL,       0,                                    0 },
+} ;
+
+
 /*
- * pinModeAlt:
- *	This is an un-documented special to let you set any pin to any mode
+ * wpiStateFormat:
+ *	Turn a saved state into text. Works like snprintf: returns the length
+ *	it needed, which may be more than size.
  *********************************************************************************
  */
 
-void pinModeAlt (int pin, int mode)
+int wpiStateFormat (const struct wpiState *state, char *buf, int size)
 {
-  int fSel, shift ;
+  const uint32_t *values ;
+  int field, i, len = 0 ;
 
-  if ((pin & PI_GPIO_MASK) == 0)		// On-board pin
-  {
-    /**/ if (wiringPiMode == WPI_MODE_PINS)
-      pin = pinToGpio [pin] ;
-    else if (wiringPiMode == WPI_MODE_PHYS)
-      pin = physToGpio [pin] ;
-    else if (wiringPiMode != WPI_MODE_GPIO)
-      return ;
+  if ((size > 0) && (buf != NULL))
+    *buf = 0 ;
 
-    fSel  = gpioToGPFSEL [pin] ;
-    shift = gpioToShift  [pin] ;
+#define	STATE_APPEND(...)	len += snprintf ((len < size) ? buf + len : NULL, (len < size) ? (size_t)(size - len) : 0, __VA_ARGS__)
+
+  STATE_APPEND ("# wiringPi GPIO state\n") ;
 
-    *(gpio + fSel) = (*(gpio + fSel) & ~(7 << shift)) | ((mode & 0x7) << shift) ;
+  for (field = 0 ; stateFields [field].name != NULL ; ++field)
+  {
+    values = (const uint32_t *)((const char *)state + stateFields [field].offset) ;
+    STATE_APPEND ("%s", stateFields [field].name) ;
+    for (i = 0 ; i < stateFields [field].count ; ++i)
+      STATE_APPEND (" %08X", values [i]) ;
+    STATE_APPEND ("\n") ;
   }
+
+#undef	STATE_APPEND
+
+  return len ;
 }
 
 
 /*
- * pinMode:
- *	Sets the mode of a pin to be input, output or PWM output
+ * wpiStateParse:
+ *	Turn the text from wpiStateFormat () back into a state.
+ *	Returns 0, or -1 if it's not right.
  *********************************************************************************
  */
 
-void pinMode (int pin, int mode)
+int wpiStateParse (struct wpiState *state, const char *text)
 {
-  int    fSel, shift, alt ;
-  struct wiringPiNodeStruct *node = wiringPiNodes ;
-  int origPin = pin ;
+  char name [16] ;
+  uint32_t *values ;
+  const char *p ;
+  char *end ;
+  int field, i, len ;
 
-  if ((pin & PI_GPIO_MASK) == 0)		// On-board pin
-  {
-    /**/ if (wiringPiMode == WPI_MODE_PINS)
-      pin = pinToGpio [pin] ;
-    else if (wiringPiMode == WPI_MODE_PHYS)
-      pin = physToGpio [pin] ;
-    else if (wiringPiMode != WPI_MODE_GPIO)
-      return ;
+  memset (state, 0, sizeof (struct wpiState)) ;
 
-    softPwmStop  (origPin) ;
-    softToneStop (origPin) ;
+  for (p = text ; *p != 0 ; )
+  {
+    while ((*p == ' ') || (*p == '\t') || (*p == '\n') || (*p == '\r'))
+      ++p ;
 
-    fSel    = gpioToGPFSEL [pin] ;
-    shift   = gpioToShift  [pin] ;
+    if (*p == 0)
+      break ;
 
-    /**/ if (mode == INPUT)
-      *(gpio + fSel) = (*(gpio + fSel) & ~(7 << shift)) ; // Sets bits to zero = input
-    else if (mode == OUTPUT)
-      *(gpio + fSel) = (*(gpio + fSel) & ~(7 << shift)) | (1 << shift) ;
-    else if (mode == SOFT_PWM_OUTPUT)
-      softPwmCreate (origPin, 0, 100) ;
-    else if (mode == SOFT_TONE_OUTPUT)
-      softToneCreate (origPin) ;
-    else if (mode == PWM_TONE_OUTPUT)
+    if (*p == '#')
     {
-      if (RASPBERRY_PI_PERI_BASE == 0)	// Ignore for now
-	return ;
+      while ((*p != 0) && (*p != '\n'))
+	++p ;
+      continue ;
+    }
 
-      pinMode (origPin, PWM_OUTPUT) ;	// Call myself to enable PWM mode
+    for (len = 0 ; isalpha (p [len]) && (len < (int)sizeof (name) - 1) ; ++len)
+      name [len] = tolower (p [len]) ;
+    name [len] = 0 ;
+    p += len ;
+
+    for (field = 0 ; stateFields [field].name != NULL ; ++field)
+      if (strcmp (name, stateFields [field].name) == 0)
+	break ;
+
+    if (stateFields [field].name == NULL)
+      return -1 ;
+
+    values = (uint32_t *)((char *)state + stateFields [field].offset) ;
+    for (i = 0 ; i < stateFields [field].count ; ++i)
+    {
+      while ((*p == ' ') || (*p == '\t'))
+	++p ;
+      values [i] = (uint32_t)strtoul (p, &end, 16) ;
+      if (end == p)
+	return -1 ;
+      p = end ;
+    }
+  }
+
+  return ((state->valid & WPI_STATE_GPIO) != 0) ? 0 : -1 ;
+}
+
+
+/*
+ * wiringPiFindNode:
+ *      Locate our device node
+ *	Extension pins are found via a 2-level table of 256-pin pages indexed
+ *	by the pin number, so a lookup costs the same however many nodes
+ *	there are. The wiringPiNodes linked list is still the master copy
+ *	(the gpio program walks it) and is only searched for pins beyond
+ *	the range of the table.
+ *********************************************************************************
+ */
+
+#define	NODE_PAGE_BITS	8
+#define	NODE_PAGE_SIZE	(1 << NODE_PAGE_BITS)
+#define	NODE_MAP_PINS	(1 << 20)
+
+static struct wiringPiNodeStruct ***nodePages = NULL ;
+static unsigned int                 nodeNumPages = 0 ;
+
+struct wiringPiNodeStruct *wiringPiFindNode (int pin)
+{
+  struct wiringPiNodeStruct *node ;
+  unsigned int page = (unsigned int)pin >> NODE_PAGE_BITS ;
+
+  if (page < nodeNumPages)
+  {
+    if (nodePages [page] == NULL)
+      return NULL ;
+    return nodePages [page][pin & (NODE_PAGE_SIZE - 1)] ;
+  }
+
+  if ((unsigned int)pin < NODE_MAP_PINS)	// Nothing mapped up here
+    return NULL ;
+
+  for (node = wiringPiNodes ; node != NULL ; node = node->next)
+    if ((pin >= node->pinBase) && (pin <= node->pinMax))
+      return node ;
+
+  return NULL ;
+}
+
+
+/*
+ * nodeMapAdd:
+ *	Enter the pins of a new node into the page table
+ *********************************************************************************
+ */
+
+static void nodeMapAdd (struct wiringPiNodeStruct *node)
+{
+  struct wiringPiNodeStruct ***newPages ;
+  unsigned int numPages, page ;
+  int pin, pinMax ;
+
+  pinMax = node->pinMax ;
+  if (pinMax >= NODE_MAP_PINS)
+    pinMax = NODE_MAP_PINS - 1 ;
+
+  if (node->pinBase > pinMax)			// Entirely beyond the table
+    return ;
+
+  numPages = ((unsigned int)pinMax >> NODE_PAGE_BITS) + 1 ;
+  if (numPages > nodeNumPages)
+  {
+    newPages = (struct wiringPiNodeStruct ***)realloc (nodePages, numPages * sizeof (*nodePages)) ;
+    if (newPages == NULL)
+      (void)wiringPiFailure (WPI_FATAL, "wiringPiNewNode: Unable to allocate memory: %s\n", strerror (errno)) ;
+    memset (newPages + nodeNumPages, 0, (numPages - nodeNumPages) * sizeof (*nodePages)) ;
+    nodePages    = newPages ;
+    nodeNumPages = numPages ;
+  }
+
+  for (pin = node->pinBase ; pin <= pinMax ; ++pin)
+  {
+    page = (unsigned int)pin >> NODE_PAGE_BITS ;
+    if (nodePages [page] == NULL)
+      if ((nodePages [page] = (struct wiringPiNodeStruct **)calloc (NODE_PAGE_SIZE, sizeof (**nodePages))) == NULL)
+	(void)wiringPiFailure (WPI_FATAL, "wiringPiNewNode: Unable to allocate memory: %s\n", strerror (errno)) ;
+    nodePages [page][pin & (NODE_PAGE_SIZE - 1)] = node ;
+  }
+}
+
+
+/*
+ * wiringPiNewNode:
+ *	Create a new GPIO node into the wiringPi handling system
+ *********************************************************************************
+ */
+
+static void pinModeDummy             (struct wiringPiNodeStruct *node, int pin, int mode)  { return ; }
+static void pullUpDnControlDummy     (struct wiringPiNodeStruct *node, int pin, int pud)   { return ; }
+static int  digitalReadDummy         (struct wiringPiNodeStruct *node, int pin)            { return LOW ; }
+static void digitalWriteDummy        (struct wiringPiNodeStruct *node, int pin, int value) { return ; }
+static void pwmWriteDummy            (struct wiringPiNodeStruct *node, int pin, int value) { return ; }
+static int  analogReadDummy          (struct wiringPiNodeStruct *node, int pin)            { return 0 ; }
+static void analogWriteDummy         (struct wiringPiNodeStruct *node, int pin, int value) { return ; }
+
+static unsigned int digitalRead8Dummy (struct wiringPiNodeStruct *node, int pin)
+{
+  unsigned int data = 0 ;
+  int bit ;
+
+  for (bit = 0 ; (bit < 8) && ((pin + bit) <= node->pinMax) ; ++bit)
+    if (node->digitalRead (node, pin + bit) != LOW)
+      data |= 1 << bit ;
+
+  return data ;
+}
+
+struct wiringPiNodeStruct *wiringPiNewNode (int pinBase, int numPins)
+{
+  struct wiringPiNodeStruct *node ;
+
+// Minimum pin base is 64
+
+  if (pinBase < 64)
+    (void)wiringPiFailure (WPI_FATAL, "wiringPiNewNode: pinBase of %d is < 64\n", pinBase) ;
+
+// Check the existing nodes in-case there is overlap:
+
+  for (node = wiringPiNodes ; node != NULL ; node = node->next)
+    if ((pinBase <= node->pinMax) && ((pinBase + numPins - 1) >= node->pinBase))
+      (void)wiringPiFailure (WPI_FATAL, "wiringPiNewNode: Pins %d-%d overlap with existing definition\n", pinBase, pinBase + numPins - 1) ;
+
+  node = (struct wiringPiNodeStruct *)calloc (sizeof (struct wiringPiNodeStruct), 1) ;	// calloc zeros
+  if (node == NULL)
+    (void)wiringPiFailure (WPI_FATAL, "wiringPiNewNode: Unable to allocate memory: %s\n", strerror (errno)) ;
+
+  node->pinBase         = pinBase ;
+  node->pinMax          = pinBase + numPins - 1 ;
+  node->pinMode         = pinModeDummy ;
+  node->pullUpDnControl = pullUpDnControlDummy ;
+  node->digitalRead     = digitalReadDummy ;
+  node->digitalWrite    = digitalWriteDummy ;
+  node->digitalRead8    = digitalRead8Dummy ;
+  node->pwmWrite        = pwmWriteDummy ;
+  node->analogRead      = analogReadDummy ;
+  node->analogWrite     = analogWriteDummy ;
+  node->next            = wiringPiNodes ;
+  wiringPiNodes         = node ;
+
+  nodeMapAdd (node) ;
+
+  return node ;
+}
+
+
+/*
+ *********************************************************************************
+ * Core Functions
+ *********************************************************************************
+ */
+
+/*
+ * pinModeAlt:
+ *	This is an un-documented special to let you set any pin to any mode
+ *********************************************************************************
+ */
+
+void pinModeAlt (int pin, int mode)
+{
+  int fSel, shift ;
+
+  if ((pin & PI_GPIO_MASK) == 0)		// On-board pin
+  {
+    /**/ if (defaultCtx.mode == WPI_MODE_PINS)
+      pin = defaultCtx.pinToGpio [pin] ;
+    else if (defaultCtx.mode == WPI_MODE_PHYS)
+      pin = defaultCtx.physToGpio [pin] ;
+    else if (defaultCtx.mode != WPI_MODE_GPIO)
+      return ;
+
+    fSel  = gpioToGPFSEL [pin] ;
+    shift = gpioToShift  [pin] ;
+
+    *(defaultCtx.gpio + fSel) = (*(defaultCtx.gpio + fSel) & ~(7 << shift)) | ((mode & 0x7) << shift) ;
+    simSync () ;
+  }
+}
+
+
+/*
+ * pinMode:
+ *	Sets the mode of a pin to be input, output or PWM output
+ *********************************************************************************
+ */
+
+void pinMode (int pin, int mode)
+{
+  int    fSel, shift, alt ;
+  struct wiringPiNodeStruct *node = wiringPiNodes ;
+  int origPin = pin ;
+
+  if ((pin & PI_GPIO_MASK) == 0)		// On-board pin
+  {
+    /**/ if (defaultCtx.mode == WPI_MODE_PINS)
+      pin = defaultCtx.pinToGpio [pin] ;
+    else if (defaultCtx.mode == WPI_MODE_PHYS)
+      pin = defaultCtx.physToGpio [pin] ;
+    else if (defaultCtx.mode == WPI_MODE_GPIO_CHIP)	// Only the digital modes
+    {
+      softPwmStop  (origPin) ;
+      softToneStop (origPin) ;
+
+      /**/ if (mode == SOFT_PWM_OUTPUT)
+	softPwmCreate (origPin, 0, 100) ;
+      else if (mode == SOFT_TONE_OUTPUT)
+	softToneCreate (origPin) ;
+      else
+	(void)wpiChipMode (defaultCtx.chip, pin, mode) ;
+      return ;
+    }
+    else if (defaultCtx.mode != WPI_MODE_GPIO)
+      return ;
+
+    softPwmStop  (origPin) ;
+    softToneStop (origPin) ;
+
+    fSel    = gpioToGPFSEL [pin] ;
+    shift   = gpioToShift  [pin] ;
+
+    /**/ if (mode == INPUT)
+      *(defaultCtx.gpio + fSel) = (*(defaultCtx.gpio + fSel) & ~(7 << shift)) ; // Sets bits to zero = input
+    else if (mode == OUTPUT)
+      *(defaultCtx.gpio + fSel) = (*(defaultCtx.gpio + fSel) & ~(7 << shift)) | (1 << shift) ;
+    else if (mode == SOFT_PWM_OUTPUT)
+      softPwmCreate (origPin, 0, 100) ;
+    else if (mode == SOFT_TONE_OUTPUT)
+      softToneCreate (origPin) ;
+    else if (mode == PWM_TONE_OUTPUT)
+    {
+      if (!periMapped ())		// Not with /dev/gpiomem
+	return ;
+
+      pinMode (origPin, PWM_OUTPUT) ;	// Call myself to enable PWM mode
       pwmSetMode (PWM_MODE_MS) ;
     }
     else if (mode == PWM_OUTPUT)
     {
-      if (RASPBERRY_PI_PERI_BASE == 0)	// Ignore for now
+      if (!periMapped ())		// Not with /dev/gpiomem
 	return ;
 
       if ((alt = gpioToPwmALT [pin]) == 0)	// Not a hardware capable PWM pin
@@ -1371,7 +1871,7 @@ void pinMode (int pin, int mode)
 
 // Set pin to PWM mode
 
-      *(gpio + fSel) = (*(gpio + fSel) & ~(7 << shift)) | (alt << shift) ;
+      *(defaultCtx.gpio + fSel) = (*(defaultCtx.gpio + fSel) & ~(7 << shift)) | (alt << shift) ;
       delayMicroseconds (110) ;		// See comments in pwmSetClockWPi
 
       pwmSetMode  (PWM_MODE_BAL) ;	// Pi default mode
@@ -1380,7 +1880,7 @@ void pinMode (int pin, int mode)
     }
     else if (mode == GPIO_CLOCK)
     {
-      if (RASPBERRY_PI_PERI_BASE == 0)	// Ignore for now
+      if (!periMapped ())		// Not with /dev/gpiomem
 	return ;
 
       if ((alt = gpioToGpClkALT0 [pin]) == 0)	// Not a GPIO_CLOCK pin
@@ -1388,10 +1888,11 @@ void pinMode (int pin, int mode)
 
 // Set pin to GPIO_CLOCK mode and set the clock frequency to 100KHz
 
-      *(gpio + fSel) = (*(gpio + fSel) & ~(7 << shift)) | (alt << shift) ;
+      *(defaultCtx.gpio + fSel) = (*(defaultCtx.gpio + fSel) & ~(7 << shift)) | (alt << shift) ;
       delayMicroseconds (110) ;
       gpioClockSet      (pin, 100000) ;
     }
+    simSync () ;
   }
   else
   {
@@ -1402,6 +1903,149 @@ void pinMode (int pin, int mode)
 }
 
 
+/*
+ * fselBulk:
+ *	Set the function select bits for a list of on-board pins, reading and
+ *	writing each GPFSEL register once. alt says the modes are raw ALT
+ *	selections (for pinModeAltBulk), otherwise only INPUT and OUTPUT are
+ *	done here and anything else goes to pinMode () as it comes.
+ *	Later entries for the same pin win, whichever way they're done.
+ *********************************************************************************
+ */
+
+static void fselBulk (const struct wpiPinMode *pins, int numPins, int alt)
+{
+  uint32_t mask [6], value [6] ;
+  int i, pin, gpio, fSel, shift, bits ;
+
+  memset (mask,  0, sizeof (mask)) ;
+  memset (value, 0, sizeof (value)) ;
+
+  for (i = 0 ; i < numPins ; ++i)
+  {
+    pin  = pins [i].pin ;
+    gpio = -1 ;
+
+    if ((pin & PI_GPIO_MASK) == 0)
+    {
+      /**/ if (defaultCtx.mode == WPI_MODE_PINS)
+	gpio = defaultCtx.pinToGpio [pin] ;
+      else if (defaultCtx.mode == WPI_MODE_PHYS)
+	gpio = defaultCtx.physToGpio [pin] ;
+      else
+	gpio = pin ;
+
+      if (gpio > 53)
+	gpio = -1 ;
+    }
+
+    if (!alt)
+    {
+      if ((gpio < 0) || ((pins [i].mode != INPUT) && (pins [i].mode != OUTPUT)))
+      {
+
+// Done now, so drop anything gathered for this pin earlier in the list,
+//	or it would be written over the top of this afterwards
+
+	if (gpio >= 0)
+	{
+	  mask  [gpioToGPFSEL [gpio]] &= ~(7 << gpioToShift [gpio]) ;
+	  value [gpioToGPFSEL [gpio]] &= ~(7 << gpioToShift [gpio]) ;
+	}
+	pinMode (pin, pins [i].mode) ;
+	continue ;
+      }
+      softPwmStop  (pin) ;
+      softToneStop (pin) ;
+    }
+    else if (gpio < 0)
+      continue ;
+
+    fSel  = gpioToGPFSEL [gpio] ;
+    shift = gpioToShift  [gpio] ;
+    bits  = alt ? (pins [i].mode & 7) : (pins [i].mode == OUTPUT ? 1 : 0) ;
+
+    mask  [fSel] |= 7 << shift ;
+    value [fSel]  = (value [fSel] & ~(7 << shift)) | (bits << shift) ;
+  }
+
+  for (fSel = 0 ; fSel < 6 ; ++fSel)
+    if (mask [fSel] != 0)
+      *(defaultCtx.gpio + fSel) = (*(defaultCtx.gpio + fSel) & ~mask [fSel]) | value [fSel] ;
+
+  simSync () ;
+}
+
+
+/*
+ * pinModeBulk:
+ *	Set the modes of a list of pins. INPUT and OUTPUT on on-board pins are
+ *	gathered up so each function select register is only read and written
+ *	once, the rest are done one at a time by pinMode (). Where the pins
+ *	aren't memory mapped (Sys and gpiochip modes), it's all pinMode ().
+ *********************************************************************************
+ */
+
+void pinModeBulk (const struct wpiPinMode *pins, int numPins)
+{
+  int i ;
+
+  if ((defaultCtx.mode == WPI_MODE_PINS) || (defaultCtx.mode == WPI_MODE_PHYS) || (defaultCtx.mode == WPI_MODE_GPIO))
+    fselBulk (pins, numPins, FALSE) ;
+  else
+    for (i = 0 ; i < numPins ; ++i)
+      pinMode (pins [i].pin, pins [i].mode) ;
+}
+
+
+/*
+ * pinModeAltBulk:
+ *	As pinModeAlt (), for a list of pins, with one read and write of
+ *	each function select register involved.
+ *********************************************************************************
+ */
+
+void pinModeAltBulk (const struct wpiPinMode *pins, int numPins)
+{
+  if ((defaultCtx.mode == WPI_MODE_PINS) || (defaultCtx.mode == WPI_MODE_PHYS) || (defaultCtx.mode == WPI_MODE_GPIO))
+    fselBulk (pins, numPins, TRUE) ;
+}
+
+
+/*
+ * pudCycle:
+ *	Run the GPPUD sequence once for all the pins in the masks (BCM_GPIO
+ *	order, one per bank) - the clock registers take any number of pins.
+ *	Only the default context's settings are remembered for wpiStateSave ()
+ *********************************************************************************
+ */
+
+static void pudCycle (struct wpiContext *ctx, int pud, uint32_t mask0, uint32_t mask1)
+{
+  if (ctx == &defaultCtx)
+  {
+    pudKnown [0] |= mask0 ;
+    pudKnown [1] |= mask1 ;
+    pudUp    [0]  = (pudUp   [0] & ~mask0) | (((pud & 3) == PUD_UP)   ? mask0 : 0) ;
+    pudUp    [1]  = (pudUp   [1] & ~mask1) | (((pud & 3) == PUD_UP)   ? mask1 : 0) ;
+    pudDown  [0]  = (pudDown [0] & ~mask0) | (((pud & 3) == PUD_DOWN) ? mask0 : 0) ;
+    pudDown  [1]  = (pudDown [1] & ~mask1) | (((pud & 3) == PUD_DOWN) ? mask1 : 0) ;
+  }
+
+  *(ctx->gpio + GPPUD) = pud & 3 ;			delayMicroseconds (5) ;
+  if (mask0 != 0) *(ctx->gpio + gpioToPUDCLK [ 0]) = mask0 ;
+  if (mask1 != 0) *(ctx->gpio + gpioToPUDCLK [32]) = mask1 ;
+  delayMicroseconds (5) ;
+  ctxSimSync (ctx) ;
+
+  *(ctx->gpio + GPPUD) = 0 ;				delayMicroseconds (5) ;
+  if (mask0 != 0) *(ctx->gpio + gpioToPUDCLK [ 0]) = 0 ;
+  if (mask1 != 0) *(ctx->gpio + gpioToPUDCLK [32]) = 0 ;
+  delayMicroseconds (5) ;
+  ctxSimSync (ctx) ;
+}
+
+
 /*
  * pullUpDownCtrl:
  *	Control the internal pull-up/down resistors on a GPIO pin
@@ -1417,18 +2061,22 @@ void pullUpDnControl (int pin, int pud)
 
   if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
   {
-    /**/ if (wiringPiMode == WPI_MODE_PINS)
-      pin = pinToGpio [pin] ;
-    else if (wiringPiMode == WPI_MODE_PHYS)
-      pin = physToGpio [pin] ;
-    else if (wiringPiMode != WPI_MODE_GPIO)
+    /**/ if (defaultCtx.mode == WPI_MODE_PINS)
+      pin = defaultCtx.pinToGpio [pin] ;
+    else if (defaultCtx.mode == WPI_MODE_PHYS)
+      pin = defaultCtx.physToGpio [pin] ;
+    else if (defaultCtx.mode == WPI_MODE_GPIO_CHIP)
+    {
+      (void)wpiChipPud (defaultCtx.chip, pin, pud) ;
+      return ;
+    }
+    else if (defaultCtx.mode != WPI_MODE_GPIO)
       return ;
 
-    *(gpio + GPPUD)              = pud & 3 ;		delayMicroseconds (5) ;
-    *(gpio + gpioToPUDCLK [pin]) = 1 << (pin & 31) ;	delayMicroseconds (5) ;
-    
-    *(gpio + GPPUD)              = 0 ;			delayMicroseconds (5) ;
-    *(gpio + gpioToPUDCLK [pin]) = 0 ;			delayMicroseconds (5) ;
+    if (pin < 32)
+      pudCycle (&defaultCtx, pud, 1 << pin, 0) ;
+    else
+      pudCycle (&defaultCtx, pud, 0, 1 << (pin & 31)) ;
   }
   else						// Extension module
   {
@@ -1440,517 +2088,2063 @@ void pullUpDnControl (int pin, int pud)
 
 
 /*
- * digitalRead:
- *	Read the value of a given Pin, returning HIGH or LOW
+ * pinMode_ctx: pullUpDnControl_ctx:
+ *	As pinMode () and pullUpDnControl (), for a context. Other than the
+ *	default one, contexts only do INPUT and OUTPUT - the PWM, clocks and
+ *	the soft drivers all belong to the default context.
+ *********************************************************************************
+ */
+
+void pinMode_ctx (struct wpiContext *ctx, int pin, int mode)
+{
+  int fSel, shift ;
+
+  if (ctx == &defaultCtx)
+  {
+    pinMode (pin, mode) ;
+    return ;
+  }
+
+  if ((pin < 0) || (pin > 53) || ((mode != INPUT) && (mode != OUTPUT)))
+    return ;
+
+  /**/ if (ctx->mode == WPI_MODE_GPIO_CHIP)
+    (void)wpiChipMode (ctx->chip, pin, mode) ;
+  else if (ctx->mode == WPI_MODE_GPIO)
+  {
+    fSel  = gpioToGPFSEL [pin] ;
+    shift = gpioToShift  [pin] ;
+    *(ctx->gpio + fSel) = (*(ctx->gpio + fSel) & ~(7 << shift)) | ((mode == OUTPUT ? 1 : 0) << shift) ;
+    ctxSimSync (ctx) ;
+  }
+}
+
+void pullUpDnControl_ctx (struct wpiContext *ctx, int pin, int pud)
+{
+  if (ctx == &defaultCtx)
+  {
+    pullUpDnControl (pin, pud) ;
+    return ;
+  }
+
+  if ((pin < 0) || (pin > 53))
+    return ;
+
+  /**/ if (ctx->mode == WPI_MODE_GPIO_CHIP)
+    (void)wpiChipPud (ctx->chip, pin, pud) ;
+  else if (ctx->mode == WPI_MODE_GPIO)
+  {
+    if (pin < 32)
+      pudCycle (ctx, pud, 1 << pin, 0) ;
+    else
+      pudCycle (ctx, pud, 0, 1 << (pin & 31)) ;
+  }
+}
+
+
+/*
+ * pullUpDnControlBulk:
+ *	Set the pull-up/downs for a list of pins, the mode being the PUD_
+ *	setting. On-board pins are grouped by setting, and each group done
+ *	in one GPPUD cycle across both banks - so at most 3 cycles, rather
+ *	than one per pin. Later entries for the same pin win.
+ *	Anything else goes through pullUpDnControl () one at a time.
+ *********************************************************************************
+ */
+
+void pullUpDnControlBulk (const struct wpiPinMode *pins, int numPins)
+{
+  uint32_t masks [3][2] ;
+  uint32_t bit ;
+  int i, pin, pud, bank ;
+
+  if ((defaultCtx.mode != WPI_MODE_PINS) && (defaultCtx.mode != WPI_MODE_PHYS) && (defaultCtx.mode != WPI_MODE_GPIO))
+  {
+    for (i = 0 ; i < numPins ; ++i)
+      pullUpDnControl (pins [i].pin, pins [i].mode) ;
+    return ;
+  }
+
+  memset (masks, 0, sizeof (masks)) ;
+
+  for (i = 0 ; i < numPins ; ++i)
+  {
+    pin = pins [i].pin ;
+
+    if ((pin & PI_GPIO_MASK) != 0)
+    {
+      pullUpDnControl (pin, pins [i].mode) ;
+      continue ;
+    }
+
+    /**/ if (defaultCtx.mode == WPI_MODE_PINS)
+      pin = defaultCtx.pinToGpio [pin] ;
+    else if (defaultCtx.mode == WPI_MODE_PHYS)
+      pin = defaultCtx.physToGpio [pin] ;
+
+    if ((pin < 0) || (pin > 53) || ((pins [i].mode & 3) > PUD_UP))
+      continue ;
+
+    bank = pin >> 5 ;
+    bit  = 1 << (pin & 31) ;
+
+    for (pud = PUD_OFF ; pud <= PUD_UP ; ++pud)
+      masks [pud][bank] &= ~bit ;
+    masks [pins [i].mode & 3][bank] |= bit ;
+  }
+
+  for (pud = PUD_OFF ; pud <= PUD_UP ; ++pud)
+    if ((masks [pud][0] | masks [pud][1]) != 0)
+      pudCycle (&defaultCtx, pud, masks [pud][0], masks [pud][1]) ;
+}
+
+
+/*
+ * digitalRead: digitalRead_ctx:
+ *	Read the value of a given Pin, returning HIGH or LOW
+ *********************************************************************************
+ */
+
+static inline int ctxDigitalRead (struct wpiContext *ctx, int pin)
+{
+  char c ;
+  struct wiringPiNodeStruct *node = wiringPiNodes ;
+
+  if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
+  {
+    /**/ if (ctx->mode == WPI_MODE_GPIO_SYS)	// Sys mode
+    {
+      if (ctx->sysFds [pin] == -1)
+	return LOW ;
+
+      lseek  (ctx->sysFds [pin], 0L, SEEK_SET) ;
+      read   (ctx->sysFds [pin], &c, 1) ;
+      return (c == '0') ? LOW : HIGH ;
+    }
+    else if (ctx->mode == WPI_MODE_GPIO_CHIP)	// Char device mode
+      return wpiChipRead (ctx->chip, pin) ;
+    else if (ctx->mode == WPI_MODE_PINS)
+      pin = ctx->pinToGpio [pin] ;
+    else if (ctx->mode == WPI_MODE_PHYS)
+      pin = ctx->physToGpio [pin] ;
+    else if (ctx->mode != WPI_MODE_GPIO)
+      return LOW ;
+
+    if ((*(ctx->gpio + gpioToGPLEV [pin]) & (1 << (pin & 31))) != 0)
+      return HIGH ;
+    else
+      return LOW ;
+  }
+  else
+  {
+    if ((node = wiringPiFindNode (pin)) == NULL)
+      return LOW ;
+    return node->digitalRead (node, pin) ;
+  }
+}
+
+int digitalRead (int pin)
+{
+  return ctxDigitalRead (&defaultCtx, pin) ;
+}
+
+int digitalRead_ctx (struct wpiContext *ctx, int pin)
+{
+  return ctxDigitalRead (ctx, pin) ;
+}
+
+
+/*
+ * digitalWrite: digitalWrite_ctx:
+ *	Set an output bit
+ *********************************************************************************
+ */
+
+static inline void ctxDigitalWrite (struct wpiContext *ctx, int pin, int value)
+{
+  struct wiringPiNodeStruct *node = wiringPiNodes ;
+
+  if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
+  {
+    /**/ if (ctx->mode == WPI_MODE_GPIO_SYS)	// Sys mode
+    {
+      if (ctx->sysFds [pin] != -1)
+      {
+	if (value == LOW)
+	  write (ctx->sysFds [pin], "0\n", 2) ;
+	else
+	  write (ctx->sysFds [pin], "1\n", 2) ;
+      }
+      return ;
+    }
+    else if (ctx->mode == WPI_MODE_GPIO_CHIP)	// Char device mode
+    {
+      wpiChipWrite (ctx->chip, pin, value) ;
+      return ;
+    }
+    else if (ctx->mode == WPI_MODE_PINS)
+      pin = ctx->pinToGpio [pin] ;
+    else if (ctx->mode == WPI_MODE_PHYS)
+      pin = ctx->physToGpio [pin] ;
+    else if (ctx->mode != WPI_MODE_GPIO)
+      return ;
+
+    /**/ if (ctx->sim != NULL)
+      wiringPiSimWrite (ctx->sim, pin >> 5, (value == LOW) ? 0 : 1 << (pin & 31), (value == LOW) ? 1 << (pin & 31) : 0) ;
+    else if (value == LOW)
+      *(ctx->gpio + gpioToGPCLR [pin]) = 1 << (pin & 31) ;
+    else
+      *(ctx->gpio + gpioToGPSET [pin]) = 1 << (pin & 31) ;
+  }
+  else
+  {
+    if ((node = wiringPiFindNode (pin)) != NULL)
+      node->digitalWrite (node, pin, value) ;
+  }
+}
+
+void digitalWrite (int pin, int value)
+{
+  ctxDigitalWrite (&defaultCtx, pin, value) ;
+}
+
+void digitalWrite_ctx (struct wpiContext *ctx, int pin, int value)
+{
+  ctxDigitalWrite (ctx, pin, value) ;
+}
+
+
+/*
+ * pwmWrite:
+ *	Set an output PWM value
+ *********************************************************************************
+ */
+
+void pwmWrite (int pin, int value)
+{
+  struct wiringPiNodeStruct *node = wiringPiNodes ;
+
+  if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
+  {
+    if (!periMapped ())		// Not with /dev/gpiomem
+      return ;
+
+    /**/ if (defaultCtx.mode == WPI_MODE_PINS)
+      pin = defaultCtx.pinToGpio [pin] ;
+    else if (defaultCtx.mode == WPI_MODE_PHYS)
+      pin = defaultCtx.physToGpio [pin] ;
+    else if (defaultCtx.mode != WPI_MODE_GPIO)
+      return ;
+
+    *(pwm + gpioToPwmPort [pin]) = value ;
+  }
+  else
+  {
+    if ((node = wiringPiFindNode (pin)) != NULL)
+      node->pwmWrite (node, pin, value) ;
+  }
+}
+
+
+/*
+ * analogRead:
+ *	Read the analog value of a given Pin. 
+ *	There is no on-board Pi analog hardware,
+ *	so this needs to go to a new node.
+ *********************************************************************************
+ */
+
+int analogRead (int pin)
+{
+  struct wiringPiNodeStruct *node = wiringPiNodes ;
+
+  if ((node = wiringPiFindNode (pin)) == NULL)
+    return 0 ;
+  else
+    return node->analogRead (node, pin) ;
+}
+
+
+/*
+ * analogWrite:
+ *	Write the analog value to the given Pin. 
+ *	There is no on-board Pi analog hardware,
+ *	so this needs to go to a new node.
+ *********************************************************************************
+ */
+
+void analogWrite (int pin, int value)
+{
+  struct wiringPiNodeStruct *node = wiringPiNodes ;
+
+  if ((node = wiringPiFindNode (pin)) == NULL)
+    return ;
+
+  node->analogWrite (node, pin, value) ;
+}
+
+
+/*
+ * wpiPinOpen:
+ *	Do all the pin number translation and register lookups for a pin
+ *	once, so that wpiPinRead () and wpiPinWrite () can go straight to
+ *	the hardware (or the extension node) in a tight loop.
+ *	Returns -1 if the pin is not on-board and not part of any node.
+ *********************************************************************************
+ */
+
+int wpiPinOpen (int pin, struct wpiPinHandle *handle)
+{
+  int gpioPin = pin ;
+
+  memset (handle, 0, sizeof (struct wpiPinHandle)) ;
+  handle->pin = pin ;
+
+  if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
+  {
+    /**/ if ((defaultCtx.mode == WPI_MODE_GPIO_SYS) || (defaultCtx.mode == WPI_MODE_GPIO_CHIP))	// Nothing to map
+      return 0 ;
+    else if (defaultCtx.mode == WPI_MODE_PINS)
+      gpioPin = defaultCtx.pinToGpio [pin] ;
+    else if (defaultCtx.mode == WPI_MODE_PHYS)
+      gpioPin = defaultCtx.physToGpio [pin] ;
+    else if (defaultCtx.mode != WPI_MODE_GPIO)
+      return -1 ;
+
+    if ((gpioPin < 0) || (gpioPin > 53))
+      return -1 ;
+
+    handle->mask = 1 << (gpioPin & 31) ;
+    handle->lev  = defaultCtx.gpio + gpioToGPLEV [gpioPin] ;
+    if (defaultCtx.sim == NULL)			// The simulator takes its writes via digitalWrite ()
+    {
+      handle->set = defaultCtx.gpio + gpioToGPSET [gpioPin] ;
+      handle->clr = defaultCtx.gpio + gpioToGPCLR [gpioPin] ;
+    }
+
+    if ((gpioToPwmPort [gpioPin] != 0) && periMapped ())
+      handle->pwm = pwm + gpioToPwmPort [gpioPin] ;
+  }
+  else
+  {
+    if ((handle->node = wiringPiFindNode (pin)) == NULL)
+      return -1 ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * pwmToneWrite:
+ *	Pi Specific.
+ *      Output the given frequency on the Pi's PWM pin
+ *********************************************************************************
+ */
+
+void pwmToneWrite (int pin, int freq)
+{
+  int range ;
+
+  if (!periMapped ())		// Not with /dev/gpiomem
+    return ;
+
+  if (freq == 0)
+    pwmWrite (pin, 0) ;             // Off
+  else
+  {
+    range = 600000 / freq ;
+    pwmSetRange (range) ;
+    pwmWrite    (pin, freq / 2) ;
+  }
+}
+
+
+
+/*
+ * digitalWriteByte:
+ *	Pi Specific
+ *	Write an 8-bit byte to the first 8 GPIO pins - try to do it as
+ *	fast as possible.
+ *	However it still needs 2 operations to set the bits, so any external
+ *	hardware must not rely on seeing a change as there will be a change 
+ *	to set the outputs bits to zero, then another change to set the 1's
+ *********************************************************************************
+ */
+
+void digitalWriteByte (int value)
+{
+  uint32_t pinSet = 0 ;
+  uint32_t pinClr = 0 ;
+  int mask = 1 ;
+  int pin ;
+
+  /**/ if (defaultCtx.mode == WPI_MODE_GPIO_SYS)
+  {
+    for (pin = 0 ; pin < 8 ; ++pin)
+    {
+      digitalWrite (pin, value & mask) ;
+      mask <<= 1 ;
+    }
+    return ;
+  }
+  else
+  {
+    for (pin = 0 ; pin < 8 ; ++pin)
+    {
+      if ((value & mask) == 0)
+	pinClr |= (1 << defaultCtx.pinToGpio [pin]) ;
+      else
+	pinSet |= (1 << defaultCtx.pinToGpio [pin]) ;
+
+      mask <<= 1 ;
+    }
+
+    /**/ if (defaultCtx.mode == WPI_MODE_GPIO_CHIP)
+      wpiChipWriteLines (defaultCtx.chip, pinSet, pinClr) ;
+    else if (defaultCtx.sim != NULL)
+      wiringPiSimWrite (defaultCtx.sim, 0, pinSet, pinClr) ;
+    else
+    {
+      *(defaultCtx.gpio + gpioToGPCLR [0]) = pinClr ;
+      *(defaultCtx.gpio + gpioToGPSET [0]) = pinSet ;
+    }
+  }
+}
+
+
+/*
+ * digitalPinsToMask:
+ *	Pi Specific
+ *	Translate a list of pins in the current pin numbering scheme into
+ *	set and clear masks for the two GPIO banks. Bit N of value is the
+ *	state for pins [N], so up to 64 pins can be given at once.
+ *	Do this once, outside your loop, then use digitalWriteBanks ()
+ *	to update them all with (at most) 4 register writes.
+ *	Returns -1 if any of the pins are not on-board GPIO pins (they're
+ *	left out of the masks), 0 otherwise.
+ *********************************************************************************
+ */
+
+int digitalPinsToMask (const int *pins, int numPins, uint64_t value, uint32_t setMask [2], uint32_t clrMask [2])
+{
+  int i, pin ;
+  int res = 0 ;
+
+  setMask [0] = setMask [1] = 0 ;
+  clrMask [0] = clrMask [1] = 0 ;
+
+  if (numPins > 64)
+    numPins = 64 ;
+
+  for (i = 0 ; i < numPins ; ++i)
+  {
+    pin = pins [i] ;
+
+    if ((pin & PI_GPIO_MASK) != 0)
+    {
+      res = -1 ;
+      continue ;
+    }
+
+    /**/ if (defaultCtx.mode == WPI_MODE_PINS)
+      pin = defaultCtx.pinToGpio [pin] ;
+    else if (defaultCtx.mode == WPI_MODE_PHYS)
+      pin = defaultCtx.physToGpio [pin] ;
+    else if (defaultCtx.mode == WPI_MODE_UNINITIALISED)
+      pin = -1 ;
+
+    if ((pin < 0) || (pin > 53))
+    {
+      res = -1 ;
+      continue ;
+    }
+
+    if ((value & ((uint64_t)1 << i)) == 0)
+      clrMask [pin >> 5] |= 1 << (pin & 31) ;
+    else
+      setMask [pin >> 5] |= 1 << (pin & 31) ;
+  }
+
+  return res ;
+}
+
+
+/*
+ * digitalWriteBank: digitalWriteBank_ctx:
+ *	Pi Specific
+ *	Set and clear any number of pins in one GPIO bank. The masks are in
+ *	BCM_GPIO order, e.g. from digitalPinsToMask (). As with
+ *	digitalWriteByte, the clears happen before the sets.
+ *********************************************************************************
+ */
+
+static inline void ctxDigitalWriteBank (struct wpiContext *ctx, int bank, uint32_t setMask, uint32_t clrMask)
+{
+  int pin ;
+
+  bank &= 1 ;
+
+  /**/ if (ctx->mode == WPI_MODE_GPIO_SYS)
+  {
+    for (pin = 0 ; pin < 32 ; ++pin)
+    {
+      /**/ if ((clrMask & (1 << pin)) != 0)
+	digitalWrite_ctx (ctx, (bank << 5) + pin, LOW) ;
+      else if ((setMask & (1 << pin)) != 0)
+	digitalWrite_ctx (ctx, (bank << 5) + pin, HIGH) ;
+    }
+  }
+  else if (ctx->mode == WPI_MODE_GPIO_CHIP)
+    wpiChipWriteLines (ctx->chip, (uint64_t)setMask << (bank << 5), (uint64_t)clrMask << (bank << 5)) ;
+  else if (ctx->sim != NULL)
+    wiringPiSimWrite (ctx->sim, bank, setMask, clrMask) ;
+  else if (ctx->mode != WPI_MODE_UNINITIALISED)
+  {
+    if (clrMask != 0)
+      *(ctx->gpio + gpioToGPCLR [bank << 5]) = clrMask ;
+    if (setMask != 0)
+      *(ctx->gpio + gpioToGPSET [bank << 5]) = setMask ;
+  }
+}
+
+void digitalWriteBank (int bank, uint32_t setMask, uint32_t clrMask)
+{
+  ctxDigitalWriteBank (&defaultCtx, bank, setMask, clrMask) ;
+}
+
+void digitalWriteBank_ctx (struct wpiContext *ctx, int bank, uint32_t setMask, uint32_t clrMask)
+{
+  ctxDigitalWriteBank (ctx, bank, setMask, clrMask) ;
+}
+
+
+/*
+ * digitalWriteBanks: digitalWriteBanks_ctx:
+ *	Pi Specific
+ *	Update both GPIO banks in one go.
+ *********************************************************************************
+ */
+
+static inline void ctxDigitalWriteBanks (struct wpiContext *ctx, const uint32_t setMask [2], const uint32_t clrMask [2])
+{
+  if (ctx->mode == WPI_MODE_GPIO_CHIP)	// One ioctl does the lot
+  {
+    wpiChipWriteLines (ctx->chip,
+	((uint64_t)setMask [1] << 32) | setMask [0],
+	((uint64_t)clrMask [1] << 32) | clrMask [0]) ;
+    return ;
+  }
+
+  ctxDigitalWriteBank (ctx, 0, setMask [0], clrMask [0]) ;
+  ctxDigitalWriteBank (ctx, 1, setMask [1], clrMask [1]) ;
+}
+
+void digitalWriteBanks (const uint32_t setMask [2], const uint32_t clrMask [2])
+{
+  ctxDigitalWriteBanks (&defaultCtx, setMask, clrMask) ;
+}
+
+void digitalWriteBanks_ctx (struct wpiContext *ctx, const uint32_t setMask [2], const uint32_t clrMask [2])
+{
+  ctxDigitalWriteBanks (ctx, setMask, clrMask) ;
+}
+
+
+/*
+ * digitalWritePins:
+ *	Write a set of pins at once: bit N of value goes to pins [N].
+ *	On-board pins are gathered into bank writes, anything else goes
+ *	the long way round, via digitalWrite ().
+ *	If you're doing this in a loop with the same pins, then it's faster
+ *	to call digitalPinsToMask () once and digitalWriteBanks () after that.
+ *********************************************************************************
+ */
+
+void digitalWritePins (const int *pins, int numPins, uint64_t value)
+{
+  uint32_t setMask [2], clrMask [2] ;
+  int i ;
+
+  if (numPins > 64)
+    numPins = 64 ;
+
+  if (digitalPinsToMask (pins, numPins, value, setMask, clrMask) != 0)
+  {
+    for (i = 0 ; i < numPins ; ++i)
+      if ((pins [i] & PI_GPIO_MASK) != 0)
+	digitalWrite (pins [i], (value & ((uint64_t)1 << i)) == 0 ? LOW : HIGH) ;
+  }
+
+  digitalWriteBanks (setMask, clrMask) ;
+}
+
+
+/*
+ * digitalReadBank: digitalReadBank_ctx:
+ *	Pi Specific
+ *	Return the raw level register for a GPIO bank in one read. The bits
+ *	are in BCM_GPIO order - bank 0 is BCM_GPIO 0-31, bank 1 is 32-53.
+ *********************************************************************************
+ */
+
+static inline uint32_t ctxDigitalReadBank (struct wpiContext *ctx, int bank)
+{
+  uint32_t data = 0 ;
+  int pin ;
+
+  bank &= 1 ;
+
+  /**/ if (ctx->mode == WPI_MODE_GPIO_SYS)
+  {
+    for (pin = 0 ; pin < 32 ; ++pin)
+      if (digitalRead_ctx (ctx, (bank << 5) + pin) != LOW)
+	data |= 1 << pin ;
+    return data ;
+  }
+  else if (ctx->mode == WPI_MODE_GPIO_CHIP)
+    return (uint32_t)(wpiChipReadLines (ctx->chip) >> (bank << 5)) ;
+  else if (ctx->mode == WPI_MODE_UNINITIALISED)
+    return 0 ;
+
+  return *(ctx->gpio + gpioToGPLEV [bank << 5]) ;
+}
+
+uint32_t digitalReadBank (int bank)
+{
+  return ctxDigitalReadBank (&defaultCtx, bank) ;
+}
+
+uint32_t digitalReadBank_ctx (struct wpiContext *ctx, int bank)
+{
+  return ctxDigitalReadBank (ctx, bank) ;
+}
+
+
+/*
+ * digitalReadBanks: digitalReadBanks_ctx:
+ *	Pi Specific
+ *	Snapshot both GPIO banks. Use this rather than lots of digitalRead ()
+ *	calls when you want a consistent view of many inputs.
+ *********************************************************************************
+ */
+
+static inline void ctxDigitalReadBanks (struct wpiContext *ctx, uint32_t levels [2])
+{
+  uint64_t lines ;
+
+  if (ctx->mode == WPI_MODE_GPIO_CHIP)	// One ioctl does the lot
+  {
+    lines = wpiChipReadLines (ctx->chip) ;
+    levels [0] = (uint32_t)lines ;
+    levels [1] = (uint32_t)(lines >> 32) ;
+    return ;
+  }
+
+  levels [0] = ctxDigitalReadBank (ctx, 0) ;
+  levels [1] = ctxDigitalReadBank (ctx, 1) ;
+}
+
+void digitalReadBanks (uint32_t levels [2])
+{
+  ctxDigitalReadBanks (&defaultCtx, levels) ;
+}
+
+void digitalReadBanks_ctx (struct wpiContext *ctx, uint32_t levels [2])
+{
+  ctxDigitalReadBanks (ctx, levels) ;
+}
+
+
+/*
+ * digitalReadByte:
+ *	Pi Specific
+ *	Read an 8-bit byte from the first 8 GPIO pins - the opposite of
+ *	digitalWriteByte. All 8 pins are sampled at the same instant.
+ *********************************************************************************
+ */
+
+unsigned int digitalReadByte (void)
+{
+  uint32_t raw ;
+  unsigned int data = 0 ;
+  int pin ;
+
+  /**/ if (defaultCtx.mode == WPI_MODE_GPIO_SYS)
+  {
+    for (pin = 0 ; pin < 8 ; ++pin)
+      if (digitalRead (defaultCtx.pinToGpio [pin]) != LOW)
+	data |= 1 << pin ;
+  }
+  else if (defaultCtx.mode != WPI_MODE_UNINITIALISED)
+  {
+    raw = digitalReadBank (0) ;
+    for (pin = 0 ; pin < 8 ; ++pin)
+      if ((raw & (1 << defaultCtx.pinToGpio [pin])) != 0)
+	data |= 1 << pin ;
+  }
+
+  return data ;
+}
+
+
+/*
+ * digitalRead8:
+ *	Read 8 consecutive pins at once, starting at the given pin. Bit 0 of
+ *	the result is the first pin.
+ *	Extension modules can supply their own function to do this in one
+ *	transaction, otherwise it's 8 calls to their digitalRead.
+ *********************************************************************************
+ */
+
+unsigned int digitalRead8 (int pin)
+{
+  struct wiringPiNodeStruct *node ;
+  uint32_t levels [2] ;
+  unsigned int data = 0 ;
+  int bit, gpioPin ;
+
+  if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
+  {
+    if (defaultCtx.mode == WPI_MODE_GPIO_SYS)
+    {
+      for (bit = 0 ; (bit < 8) && (pin + bit < 64) ; ++bit)
+	if (digitalRead (pin + bit) != LOW)
+	  data |= 1 << bit ;
+      return data ;
+    }
+
+    digitalReadBanks (levels) ;
+
+    for (bit = 0 ; (bit < 8) && (pin + bit < 64) ; ++bit)
+    {
+      gpioPin = pin + bit ;
+
+      /**/ if (defaultCtx.mode == WPI_MODE_PINS)
+	gpioPin = defaultCtx.pinToGpio [gpioPin] ;
+      else if (defaultCtx.mode == WPI_MODE_PHYS)
+	gpioPin = defaultCtx.physToGpio [gpioPin] ;
+
+      if ((gpioPin < 0) || (gpioPin > 53))
+	continue ;
+
+      if ((levels [gpioPin >> 5] & (1 << (gpioPin & 31))) != 0)
+	data |= 1 << bit ;
+    }
+    return data ;
+  }
+  else
+  {
+    if ((node = wiringPiFindNode (pin)) == NULL)
+      return 0 ;
+    return node->digitalRead8 (node, pin) ;
+  }
+}
+
+
+/*
+ * edgeDetectGpio:
+ *	Turn a pin in the current numbering into a BCM_GPIO pin we can do
+ *	edge detection on with the registers, or -1.
+ *********************************************************************************
+ */
+
+static int edgeDetectGpio (int pin)
+{
+  if ((pin & PI_GPIO_MASK) != 0)
+    return -1 ;
+
+  /**/ if (defaultCtx.mode == WPI_MODE_PINS)
+    pin = defaultCtx.pinToGpio [pin] ;
+  else if (defaultCtx.mode == WPI_MODE_PHYS)
+    pin = defaultCtx.physToGpio [pin] ;
+  else if (defaultCtx.mode != WPI_MODE_GPIO)
+    return -1 ;
+
+  if ((pin < 0) || (pin > 53))
+    return -1 ;
+
+  return pin ;
+}
+
+
+/*
+ * edgeEnable:
+ *	Set or clear the bits in one of the edge detect enable registers
+ *********************************************************************************
+ */
+
+static inline void edgeEnable (int reg, uint32_t mask, int on)
+{
+  if (on)
+    *(defaultCtx.gpio + reg) |=  mask ;
+  else
+    *(defaultCtx.gpio + reg) &= ~mask ;
+}
+
+
+/*
+ * pinEdgeDetect:
+ *	Pi Specific.
+ *	Set the hardware edge detectors for a pin - any of ED_RISING,
+ *	ED_FALLING, ED_ASYNC_RISING and ED_ASYNC_FALLING or'd together,
+ *	or ED_NONE to turn them off. The synchronous ones sample on the
+ *	system clock, the asynchronous ones catch even shorter pulses.
+ *	Pin must already be in input mode with appropriate pull up/downs set.
+ *	Any edge already recorded for the pin is cleared.
+ *
+ *	Note that these also interrupt the ARM, where the kernel owns the
+ *	GPIO interrupt. Don't use them on a pin the kernel is also watching
+ *	(e.g. via wiringPiISR), and poll often.
+ *********************************************************************************
+ */
+
+void pinEdgeDetect (int pin, int modes)
+{
+  uint32_t mask ;
+
+  if ((pin = edgeDetectGpio (pin)) < 0)
+    return ;
+
+  mask = 1 << (pin & 31) ;
+
+  edgeEnable (gpioToREN  [pin], mask, modes & ED_RISING) ;
+  edgeEnable (gpioToFEN  [pin], mask, modes & ED_FALLING) ;
+  edgeEnable (gpioToAREN [pin], mask, modes & ED_ASYNC_RISING) ;
+  edgeEnable (gpioToAFEN [pin], mask, modes & ED_ASYNC_FALLING) ;
+
+  *(defaultCtx.gpio + gpioToEDS [pin]) = mask ;	// Writing a 1 clears it
+}
+
+
+/*
+ * edgeDetectBank:
+ *	Pi Specific.
+ *	Return which of the pins in mask (in BCM_GPIO bit order, as with the
+ *	other bank functions) have seen an edge since we last looked, and
+ *	clear them. One read and (if anything fired) one write.
+ *	Pins not in the mask are left for next time.
+ *********************************************************************************
+ */
+
+uint32_t edgeDetectBank (int bank, uint32_t mask)
+{
+  uint32_t fired ;
+
+  if ((defaultCtx.mode != WPI_MODE_PINS) && (defaultCtx.mode != WPI_MODE_PHYS) && (defaultCtx.mode != WPI_MODE_GPIO))
+    return 0 ;
+
+  bank &= 1 ;
+
+  if ((fired = *(defaultCtx.gpio + gpioToEDS [bank << 5]) & mask) != 0)
+    *(defaultCtx.gpio + gpioToEDS [bank << 5]) = fired ;
+
+  return fired ;
+}
+
+
+/*
+ * edgeDetectPins:
+ *	Pi Specific.
+ *	The polling helper: Bit N of the result is set if pins [N] has seen
+ *	an edge since we last looked, and those are cleared.
+ *	If you're doing this in a loop, then it's faster to work out the mask
+ *	once with digitalPinsToMask () and call edgeDetectBank () after that.
+ *********************************************************************************
+ */
+
+uint64_t edgeDetectPins (const int *pins, int numPins)
+{
+  uint32_t want [2], fired [2] ;
+  uint64_t result = 0 ;
+  int i, gpioPin ;
+  int gpioPins [64] ;
+
+  if (numPins > 64)
+    numPins = 64 ;
+
+  want [0] = want [1] = 0 ;
+
+  for (i = 0 ; i < numPins ; ++i)
+    if ((gpioPins [i] = edgeDetectGpio (pins [i])) >= 0)
+      want [gpioPins [i] >> 5] |= 1 << (gpioPins [i] & 31) ;
+
+  fired [0] = (want [0] != 0) ? edgeDetectBank (0, want [0]) : 0 ;
+  fired [1] = (want [1] != 0) ? edgeDetectBank (1, want [1]) : 0 ;
+
+  for (i = 0 ; i < numPins ; ++i)
+  {
+    if ((gpioPin = gpioPins [i]) < 0)
+      continue ;
+    if ((fired [gpioPin >> 5] & (1 << (gpioPin & 31))) != 0)
+      result |= (uint64_t)1 << i ;
+  }
+
+  return result ;
+}
+
+
+/*
+ * waitForInterrupt:
+ *	Pi Specific.
+ *	Wait for Interrupt on a GPIO pin.
+ *	This is actually done via the /sys/class/gpio interface regardless of
+ *	the wiringPi access mode in-use. Maybe sometime it might get a better
+ *	way for a bit more efficiency.
+ *********************************************************************************
+ */
+
+int waitForInterrupt (int pin, int mS)
+{
+  int fd, x ;
+  uint8_t c ;
+  struct pollfd polls ;
+
+  /**/ if (defaultCtx.mode == WPI_MODE_PINS)
+    pin = defaultCtx.pinToGpio [pin] ;
+  else if (defaultCtx.mode == WPI_MODE_PHYS)
+    pin = defaultCtx.physToGpio [pin] ;
+  else if (defaultCtx.mode == WPI_MODE_GPIO_CHIP)
+    return wpiChipWait (defaultCtx.chip, pin, mS) ;
+
+  if ((fd = defaultCtx.sysFds [pin]) == -1)
+    return -2 ;
+
+// Setup poll structure
+
+  polls.fd     = fd ;
+  polls.events = POLLPRI ;	// Urgent data!
+
+// Wait for it ...
+
+  x = poll (&polls, 1, mS) ;
+
+// Do a dummy read to clear the interrupt
+//	A one character read appars to be enough.
+//	Followed by a seek to reset it.
+
+  (void)read (fd, &c, 1) ;
+  lseek (fd, 0, SEEK_SET) ;
+
+  return x ;
+}
+
+
+/*
+ * sysfsWrite:
+ *	Write a string to one of the /sys/class/gpio files
+ *********************************************************************************
+ */
+
+static int sysfsWrite (const char *fName, const char *value)
+{
+  int fd, res, err ;
+
+  if ((fd = open (fName, O_WRONLY | O_CLOEXEC)) < 0)
+    return -1 ;
+
+  res = write (fd, value, strlen (value)) ;
+  err = errno ;
+  close (fd) ;
+  errno = err ;
+
+  return (res < 0) ? -1 : 0 ;
+}
+
+
+/*
+ * sysfsEdge:
+ *	Export a pin and set it to be an input with the given edge, as the
+ *	gpio program's "edge" command does, but without running it.
+ *	Exporting may need root, or membership of the gpio group - if we
+ *	can't, then it fails and the caller can try the gpio program.
+ *********************************************************************************
+ */
+
+static int sysfsEdge (int bcmGpioPin, const char *modeS)
+{
+  char fName [64] ;
+  char value [16] ;
+  int  tries ;
+
+  sprintf (fName, "/sys/class/gpio/gpio%d", bcmGpioPin) ;
+  if (access (fName, F_OK) != 0)
+  {
+    sprintf (value, "%d\n", bcmGpioPin) ;
+    if ((sysfsWrite ("/sys/class/gpio/export", value) != 0) && (errno != EBUSY))
+      return -1 ;
+  }
+
+// A newly exported pin may not be ours until udev has been round to change
+//	its group, so give it a little while.
+
+  sprintf (fName, "/sys/class/gpio/gpio%d/direction", bcmGpioPin) ;
+  for (tries = 0 ; sysfsWrite (fName, "in\n") != 0 ; ++tries)
+  {
+    if (((errno != EACCES) && (errno != ENOENT)) || (tries == 100))
+      return -1 ;
+    delay (1) ;
+  }
+
+  sprintf (fName, "/sys/class/gpio/gpio%d/edge", bcmGpioPin) ;
+  sprintf (value, "%s\n", modeS) ;
+
+  return sysfsWrite (fName, value) ;
+}
+
+
+/*
+ * isrSetup:
+ *	Set the edge on a pin and get it ready for us to wait on.
+ *	Returns the BCM_GPIO pin number, or -1.
+ *********************************************************************************
+ */
+
+static int isrSetup (const char *who, int pin, int mode)
+{
+  const char *modeS ;
+  char fName   [64] ;
+  char  pinS [8] ;
+  pid_t pid ;
+  int   count, i ;
+  char  c ;
+  int   bcmGpioPin ;
+
+  if ((pin < 0) || (pin > 63))
+    return wiringPiFailure (WPI_FATAL, "%s: pin must be 0-63 (%d)\n", who, pin) ;
+
+  /**/ if (defaultCtx.mode == WPI_MODE_UNINITIALISED)
+    return wiringPiFailure (WPI_FATAL, "%s: wiringPi has not been initialised. Unable to continue.\n", who) ;
+  else if (defaultCtx.mode == WPI_MODE_PINS)
+    bcmGpioPin = defaultCtx.pinToGpio [pin] ;
+  else if (defaultCtx.mode == WPI_MODE_PHYS)
+    bcmGpioPin = defaultCtx.physToGpio [pin] ;
+  else
+    bcmGpioPin = pin ;
+
+  if ((bcmGpioPin < 0) || (bcmGpioPin > 63))
+    return wiringPiFailure (WPI_FATAL, "%s: pin %d is not a GPIO pin\n", who, pin) ;
+
+// Now export the pin and set the right edge
+//	In gpiochip mode it's just a re-configure of the lines we hold,
+//	otherwise we do it via /sys/class/gpio ourselves.
+//	If we're not allowed to, we fall back to using the gpio program,
+//	so it assumes a full installation of wiringPi. It's a bit 'clunky',
+//	but it is a way that will work when we're running in "Sys" mode,
+//	as a non-root user. (without sudo)
+
+  /**/ if (mode == INT_EDGE_FALLING)
+    modeS = "falling" ;
+  else if (mode == INT_EDGE_RISING)
+    modeS = "rising" ;
+  else
+    modeS = "both" ;
+
+  if (defaultCtx.mode == WPI_MODE_GPIO_CHIP)
+  {
+    if (wpiChipEdge (defaultCtx.chip, bcmGpioPin, mode) < 0)
+      return wiringPiFailure (WPI_FATAL, "%s: unable to set the edge for pin %d: %s\n", who, bcmGpioPin, strerror (errno)) ;
+  }
+  else if ((mode != INT_EDGE_SETUP) && (sysfsEdge (bcmGpioPin, modeS) != 0))
+  {
+    if (wiringPiDebug)
+      printf ("%s: Unable to set the edge for pin %d directly (%s), using the gpio program\n", who, bcmGpioPin, strerror (errno)) ;
+
+    sprintf (pinS, "%d", bcmGpioPin) ;
+
+    if ((pid = fork ()) < 0)	// Fail
+      return wiringPiFailure (WPI_FATAL, "%s: fork failed: %s\n", who, strerror (errno)) ;
+
+    if (pid == 0)	// Child, exec
+    {
+      /**/ if (access ("/usr/local/bin/gpio", X_OK) == 0)
+      {
+	execl ("/usr/local/bin/gpio", "gpio", "edge", pinS, modeS, (char *)NULL) ;
+	return wiringPiFailure (WPI_FATAL, "%s: execl failed: %s\n", who, strerror (errno)) ;
+      }
+      else if (access ("/usr/bin/gpio", X_OK) == 0)
+      {
+	execl ("/usr/bin/gpio", "gpio", "edge", pinS, modeS, (char *)NULL) ;
+	return wiringPiFailure (WPI_FATAL, "%s: execl failed: %s\n", who, strerror (errno)) ;
+      }
+      else
+	return wiringPiFailure (WPI_FATAL, "%s: Can't find gpio program\n", who) ;
+    }
+    else		// Parent, wait
+      wait (NULL) ;
+  }
+
+// Now pre-open the /sys/class node - but it may already be open if
+//	we are in Sys mode...
+
+  if (defaultCtx.mode != WPI_MODE_GPIO_CHIP)
+  {
+    if (defaultCtx.sysFds [bcmGpioPin] == -1)
+    {
+      sprintf (fName, "/sys/class/gpio/gpio%d/value", bcmGpioPin) ;
+      if ((defaultCtx.sysFds [bcmGpioPin] = open (fName, O_RDWR)) < 0)
+	return wiringPiFailure (WPI_FATAL, "%s: unable to open %s: %s\n", who, fName, strerror (errno)) ;
+    }
+
+// Clear any initial pending interrupt
+
+    ioctl (defaultCtx.sysFds [bcmGpioPin], FIONREAD, &count) ;
+    for (i = 0 ; i < count ; ++i)
+      read (defaultCtx.sysFds [bcmGpioPin], &c, 1) ;
+  }
+
+  return bcmGpioPin ;
+}
+
+
+/*
+ * interruptHandler:
+ *	This is a thread and gets started to wait for the interrupt we're
+ *	hoping to catch. It will call the user-function when the interrupt
+ *	fires.
+ *********************************************************************************
+ */
+
+static void *interruptHandler (void *arg)
+{
+  int myPin = (int)(intptr_t)arg ;
+
+  (void)piHiPri (55) ;	// Only effective if we run as root
+
+  for (;;)
+    if (waitForInterrupt (myPin, -1) > 0)
+      isrFunctions [myPin] () ;
+
+  return NULL ;
+}
+
+
+/*
+ * wiringPiISR:
+ *	Pi Specific.
+ *	Take the details and create an interrupt handler that will do a call-
+ *	back to the user supplied function.
+ *	This uses a thread per pin - see wiringPiISRex () for a lighter way.
+ *********************************************************************************
+ */
+
+int wiringPiISR (int pin, int mode, void (*function)(void))
+{
+  pthread_t threadId ;
+
+  if (isrSetup ("wiringPiISR", pin, mode) < 0)
+    return -1 ;
+
+  isrFunctions [pin] = function ;
+
+  if (pthread_create (&threadId, NULL, interruptHandler, (void *)(intptr_t)pin) != 0)
+    return wiringPiFailure (WPI_FATAL, "wiringPiISR: Unable to create thread: %s\n", strerror (errno)) ;
+
+  return 0 ;
+}
+
+
+/*
+ * isrCall:
+ *	Hand an edge on a BCM_GPIO pin to whoever wants it - either queue
+ *	it up, or call the user function.
+ *********************************************************************************
+ */
+
+static void isrCall (int gpioPin, struct wpiEdgeEvent *event)
+{
+  void (*function)(int pin, void *userData) ;
+  void *userData ;
+  struct wpiEventRing *ring ;
+
+  pthread_mutex_lock (&isrMutex) ;
+    function   = isrDispatch [gpioPin].function ;
+    userData   = isrDispatch [gpioPin].userData ;
+    ring       = isrDispatch [gpioPin].ring ;
+    event->pin = isrDispatch [gpioPin].pin ;
+  pthread_mutex_unlock (&isrMutex) ;
+
+  /**/ if (ring != NULL)
+    (void)wpiEventRingPush (ring, event) ;
+  else if (function != NULL)
+    function (event->pin, userData) ;
+}
+
+
+/*
+ * isrDispatcher:
+ *	The thread behind wiringPiISRex (). It waits on all the pins at once
+ *	and calls the user functions in turn, so keep them short.
+ *********************************************************************************
+ */
+
+static void *isrDispatcher (void *arg)
+{
+  struct epoll_event  events [16] ;
+  struct wpiEdgeEvent edges  [16] ;
+  struct timespec ts ;
+  int n, i, j, count, pin ;
+  uint8_t c ;
+
+  (void)piHiPri (55) ;	// Only effective if we run as root
+
+  for (;;)
+  {
+    if ((n = epoll_wait (isrEpollFd, events, 16, -1)) < 0)
+    {
+      if (errno == EINTR)
+	continue ;
+      return NULL ;
+    }
+
+    for (i = 0 ; i < n ; ++i)
+    {
+      pin = events [i].data.u32 ;
+
+      if (pin == ISR_CHIP)		// gpiochip: Read the events to find the pins
+      {
+	if (defaultCtx.chip == NULL)	// Given back by another wiringPiSetup*
+	  continue ;
+
+	while ((count = wpiChipEvents (defaultCtx.chip, edges, 16)) > 0)
+	  for (j = 0 ; j < count ; ++j)
+	    if ((edges [j].pin >= 0) && (edges [j].pin < 64))
+	      isrCall (edges [j].pin, &edges [j]) ;
+      }
+      else				// sysfs: Clear it by reading the value
+      {
+	clock_gettime (CLOCK_MONOTONIC, &ts) ;
+	c = '0' ;
+	lseek (defaultCtx.sysFds [pin], 0, SEEK_SET) ;	// Rewind first: the last read left us at the end
+	(void)read (defaultCtx.sysFds [pin], &c, 1) ;
+
+// All we know is the level now, so the edge is the one that got us here.
+//	With INT_EDGE_BOTH that's a guess from the level, which is wrong if
+//	the pin has changed again since.
+
+	edges [0].level = (c == '0') ? LOW : HIGH ;
+	edges [0].edge  = (c == '0') ? INT_EDGE_FALLING : INT_EDGE_RISING ;
+	edges [0].ns    = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec ;
+	edges [0].seq   = ++isrDispatch [pin].seq ;
+	isrCall (pin, &edges [0]) ;
+      }
+    }
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * isrRegister:
+ *	Add a pin to the dispatcher, starting it if need be.
+ *	In gpiochip mode, don't mix this with waitForInterrupt/wiringPiISR -
+ *	all the pins share one source of events and this will take them.
+ *********************************************************************************
+ */
+
+static int isrRegister (const char *who, int pin, int mode,
+	void (*function)(int pin, void *userData), void *userData, struct wpiEventRing *ring)
+{
+  struct epoll_event event ;
+  pthread_t threadId ;
+  int bcmGpioPin, res ;
+
+  if ((bcmGpioPin = isrSetup (who, pin, mode)) < 0)
+    return -1 ;
+
+  pthread_mutex_lock (&isrMutex) ;
+
+  if (isrEpollFd == -1)
+  {
+    if ((isrEpollFd = epoll_create1 (EPOLL_CLOEXEC)) < 0)
+    {
+      isrEpollFd = -1 ;
+      pthread_mutex_unlock (&isrMutex) ;
+      return wiringPiFailure (WPI_FATAL, "%s: Unable to create epoll set: %s\n", who, strerror (errno)) ;
+    }
+
+    if ((res = pthread_create (&threadId, NULL, isrDispatcher, NULL)) != 0)
+    {
+      close (isrEpollFd) ;
+      isrEpollFd = -1 ;
+      pthread_mutex_unlock (&isrMutex) ;
+      return wiringPiFailure (WPI_FATAL, "%s: Unable to create thread: %s\n", who, strerror (res)) ;
+    }
+  }
+
+  isrDispatch [bcmGpioPin].function = function ;
+  isrDispatch [bcmGpioPin].userData = userData ;
+  isrDispatch [bcmGpioPin].ring     = ring ;
+  isrDispatch [bcmGpioPin].pin      = pin ;
+
+  memset (&event, 0, sizeof (event)) ;
+  res = 0 ;
+
+  if (defaultCtx.mode == WPI_MODE_GPIO_CHIP)
+  {
+    if (!isrChipAdded)
+    {
+      event.events   = EPOLLIN ;
+      event.data.u32 = ISR_CHIP ;
+      if ((res = epoll_ctl (isrEpollFd, EPOLL_CTL_ADD, wpiChipFd (defaultCtx.chip), &event)) == 0)
+	isrChipAdded = TRUE ;
+    }
+  }
+  else
+  {
+    event.events   = EPOLLPRI | EPOLLERR ;
+    event.data.u32 = bcmGpioPin ;
+    if ((res = epoll_ctl (isrEpollFd, EPOLL_CTL_ADD, defaultCtx.sysFds [bcmGpioPin], &event)) < 0)
+      if (errno == EEXIST)
+	res = 0 ;
+  }
+
+  pthread_mutex_unlock (&isrMutex) ;
+
+  if (res < 0)
+    return wiringPiFailure (WPI_FATAL, "%s: Unable to add pin %d: %s\n", who, pin, strerror (errno)) ;
+
+  return 0 ;
+}
+
+
+/*
+ * wiringPiISRex:
+ *	Pi Specific.
+ *	As wiringPiISR, but all the pins are handled by one thread and the
+ *	function is called with the pin number and the userData pointer, so
+ *	one function can look after many pins.
+ *	Calling it again for the same pin replaces the function.
+ *	In sysfs mode the kernel doesn't say which edge it was, so with
+ *	INT_EDGE_BOTH the edge (and level) passed on is inferred from the
+ *	level read after the interrupt.
+ *********************************************************************************
+ */
+
+int wiringPiISRex (int pin, int mode, void (*function)(int pin, void *userData), void *userData)
+{
+  return isrRegister ("wiringPiISRex", pin, mode, function, userData, NULL) ;
+}
+
+
+/*
+ * wiringPiISRCapture:
+ *	Pi Specific.
+ *	Rather than calling a function, put every edge on the pin into the
+ *	ring (see wiringPiEvents.c) with its level, time and sequence number.
+ *	Any number of pins can share a ring, as the dispatcher thread is the
+ *	only thing that feeds it, but only one thread should be reading it.
+ *	Use wiringPiISRexCancel () to stop.
+ *********************************************************************************
+ */
+
+int wiringPiISRCapture (int pin, int mode, struct wpiEventRing *ring)
+{
+  return isrRegister ("wiringPiISRCapture", pin, mode, NULL, NULL, ring) ;
+}
+
+
+/*
+ * wiringPiISRexCancel:
+ *	Stop calling the function for a pin set up with wiringPiISRex ()
+ *	or capturing its edges for wiringPiISRCapture ()
+ *********************************************************************************
+ */
+
+void wiringPiISRexCancel (int pin)
+{
+  int bcmGpioPin ;
+
+  if ((pin < 0) || (pin > 63))
+    return ;
+
+  /**/ if (defaultCtx.mode == WPI_MODE_PINS)
+    bcmGpioPin = defaultCtx.pinToGpio [pin] ;
+  else if (defaultCtx.mode == WPI_MODE_PHYS)
+    bcmGpioPin = defaultCtx.physToGpio [pin] ;
+  else
+    bcmGpioPin = pin ;
+
+  if ((bcmGpioPin < 0) || (bcmGpioPin > 63))
+    return ;
+
+  pthread_mutex_lock (&isrMutex) ;
+    isrDispatch [bcmGpioPin].function = NULL ;
+    isrDispatch [bcmGpioPin].userData = NULL ;
+    isrDispatch [bcmGpioPin].ring     = NULL ;
+    if ((isrEpollFd != -1) && (defaultCtx.mode != WPI_MODE_GPIO_CHIP) && (defaultCtx.sysFds [bcmGpioPin] != -1))
+      (void)epoll_ctl (isrEpollFd, EPOLL_CTL_DEL, defaultCtx.sysFds [bcmGpioPin], NULL) ;
+  pthread_mutex_unlock (&isrMutex) ;
+}
+
+
+/*
+ * timerRead64:
+ *	Read the 64-bit system timer. The two halves can't be read at once,
+ *	so if the top half changes while we're reading the bottom, go again.
+ *********************************************************************************
+ */
+
+static inline uint64_t timerRead64 (void)
+{
+  uint32_t hi, lo ;
+
+  do
+  {
+    hi = *(timer + TIMER_CHI) ;
+    lo = *(timer + TIMER_CLO) ;
+  }
+  while (hi != *(timer + TIMER_CHI)) ;
+
+  return ((uint64_t)hi << 32) | lo ;
+}
+
+
+/*
+ * monotonicNow:
+ *	The monotonic clock in nanoseconds, from whenever it started
+ *	(not our epoch)
+ *********************************************************************************
+ */
+
+static inline uint64_t monotonicNow (void)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  return (uint64_t)ts.tv_sec * (uint64_t)1000000000 + (uint64_t)ts.tv_nsec ;
+}
+
+
+/*
+ * sleepUntil:
+ *	Sleep until the monotonic clock reaches the given time, carrying on
+ *	if a signal wakes us early.
+ *********************************************************************************
+ */
+
+static void sleepUntil (uint64_t when)
+{
+  struct timespec wake ;
+
+  wake.tv_sec  = (time_t)(when / 1000000000) ;
+  wake.tv_nsec = (long)  (when % 1000000000) ;
+
+  while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR)
+    ;
+}
+
+
+/*
+ * initialiseEpoch:
+ *	Initialise our start-of-time variables to be the current monotonic
+ *	time in milliseconds, microseconds and nanoseconds.
+ *********************************************************************************
+ */
+
+static void initialiseEpoch (void)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  epochMilli = (uint64_t)ts.tv_sec * (uint64_t)1000       + (uint64_t)(ts.tv_nsec / 1000000) ;
+  epochMicro = (uint64_t)ts.tv_sec * (uint64_t)1000000    + (uint64_t)(ts.tv_nsec / 1000) ;
+  epochNano  = (uint64_t)ts.tv_sec * (uint64_t)1000000000 + (uint64_t)(ts.tv_nsec) ;
+
+  if (timer != NULL)
+    epochTimer = timerRead64 () ;
+}
+
+
+/*
+ * delay:
+ *	Wait for some number of milliseconds
+ *********************************************************************************
+ */
+
+void delay (unsigned int howLong)
+{
+  struct timespec sleeper, dummy ;
+
+  sleeper.tv_sec  = (time_t)(howLong / 1000) ;
+  sleeper.tv_nsec = (long)(howLong % 1000) * 1000000 ;
+
+  nanosleep (&sleeper, &dummy) ;
+}
+
+
+/*
+ * delayMicroseconds:
+ *	This is somewhat intersting. It seems that on the Pi, a single call
+ *	to nanosleep takes some 80 to 130 microseconds anyway, so while
+ *	obeying the standards (may take longer), it's not always what we
+ *	want!
+ *
+ *	So what I'll do now is if the delay is less than 100uS we'll do it
+ *	in a hard loop, watching a built-in counter on the ARM chip. This is
+ *	somewhat sub-optimal in that it uses 100% CPU, something not an issue
+ *	in a microcontroller, but under a multi-tasking, multi-user OS, it's
+ *	wastefull, however we've no real choice )-:
+ *
+ *      Plan B: It seems all might not be well with that plan, so changing it
+ *      to use gettimeofday () and poll on that instead...
+ *	... and now the monotonic clock, so a clock change can't upset it.
+ *	If we have the system timer mapped (i.e. /dev/mem) then we're back to
+ *	watching that - it's the cheapest thing there is to read.
+ *********************************************************************************
+ */
+
+void delayMicrosecondsHard (unsigned int howLong)
+{
+  uint64_t tEnd ;
+  uint32_t start ;
+
+  if (timer != NULL)
+  {
+    start = *(timer + TIMER_CLO) ;
+    while ((*(timer + TIMER_CLO) - start) < howLong)
+      ;
+    return ;
+  }
+
+  tEnd = nanos () + (uint64_t)howLong * 1000 ;
+  while (nanos () < tEnd)
+    ;
+}
+
+void delayMicroseconds (unsigned int howLong)
+{
+  struct timespec sleeper ;
+  unsigned int uSecs = howLong % 1000000 ;
+  unsigned int wSecs = howLong / 1000000 ;
+
+  /**/ if (howLong ==   0)
+    return ;
+  else if (howLong  < 100)
+    delayMicrosecondsHard (howLong) ;
+  else
+  {
+    sleeper.tv_sec  = wSecs ;
+    sleeper.tv_nsec = (long)(uSecs * 1000L) ;
+    nanosleep (&sleeper, NULL) ;
+  }
+}
+
+
+/*
+ * delayUntil:
+ *	Wait until nanos () reaches the deadline. This sleeps against the
+ *	absolute time, so it doesn't matter how long we took to get here,
+ *	then spins for the last little bit the kernel can't be trusted with.
+ *	Returns straight away if the deadline has gone.
  *********************************************************************************
  */
 
-int digitalRead (int pin)
+void delayUntil (uint64_t deadline)
 {
-  char c ;
-  struct wiringPiNodeStruct *node = wiringPiNodes ;
+  uint64_t now = nanos () ;
+  unsigned int threshold = __atomic_load_n (&spinThreshold, __ATOMIC_RELAXED) ;
 
-  if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
-  {
-    /**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)	// Sys mode
-    {
-      if (sysFds [pin] == -1)
-	return LOW ;
+  if (deadline <= now)
+    return ;
 
-      lseek  (sysFds [pin], 0L, SEEK_SET) ;
-      read   (sysFds [pin], &c, 1) ;
-      return (c == '0') ? LOW : HIGH ;
-    }
-    else if (wiringPiMode == WPI_MODE_PINS)
-      pin = pinToGpio [pin] ;
-    else if (wiringPiMode == WPI_MODE_PHYS)
-      pin = physToGpio [pin] ;
-    else if (wiringPiMode != WPI_MODE_GPIO)
-      return LOW ;
+  if (deadline - now > threshold)
+    sleepUntil (deadline - threshold + epochNano) ;
 
-    if ((*(gpio + gpioToGPLEV [pin]) & (1 << (pin & 31))) != 0)
-      return HIGH ;
-    else
-      return LOW ;
-  }
-  else
-  {
-    if ((node = wiringPiFindNode (pin)) == NULL)
-      return LOW ;
-    return node->digitalRead (node, pin) ;
-  }
+  while (nanos () < deadline)
+    ;
 }
 
 
 /*
- * digitalWrite:
- *	Set an output bit
+ * periodicNext:
+ *	For loops that need to run every period nanoseconds: call this once
+ *	per time round and it waits for the start of the next period. As the
+ *	deadlines are absolute, they don't drift, however long the loop takes.
+ *	Start with state->next = 0. If we've fallen behind by one or more
+ *	whole periods, they're skipped (and counted) rather than run back to
+ *	back. Returns the number skipped this time.
  *********************************************************************************
  */
 
-void digitalWrite (int pin, int value)
+int periodicNext (struct wpiPeriodic *state, uint64_t period)
 {
-  struct wiringPiNodeStruct *node = wiringPiNodes ;
+  uint64_t now = nanos () ;
+  int missed = 0 ;
 
-  if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
-  {
-    /**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)	// Sys mode
-    {
-      if (sysFds [pin] != -1)
-      {
-	if (value == LOW)
-	  write (sysFds [pin], "0\n", 2) ;
-	else
-	  write (sysFds [pin], "1\n", 2) ;
-      }
-      return ;
-    }
-    else if (wiringPiMode == WPI_MODE_PINS)
-      pin = pinToGpio [pin] ;
-    else if (wiringPiMode == WPI_MODE_PHYS)
-      pin = physToGpio [pin] ;
-    else if (wiringPiMode != WPI_MODE_GPIO)
-      return ;
+  if (period == 0)
+    return 0 ;
 
-    if (value == LOW)
-      *(gpio + gpioToGPCLR [pin]) = 1 << (pin & 31) ;
-    else
-      *(gpio + gpioToGPSET [pin]) = 1 << (pin & 31) ;
+  if (state->next == 0)
+  {
+    (void)delayThreshold () ;
+    state->next = now = nanos () ;
   }
-  else
+
+  state->next += period ;
+
+  if (state->next <= now)
   {
-    if ((node = wiringPiFindNode (pin)) != NULL)
-      node->digitalWrite (node, pin, value) ;
+    missed = (int)((now - state->next) / period) + 1 ;
+    state->next     += (uint64_t)missed * period ;
+    state->overruns += missed ;
   }
+
+  delayUntil (state->next) ;
+
+  return missed ;
 }
 
 
 /*
- * pwmWrite:
- *	Set an output PWM value
+ * spinMeasure:
+ *	Measure how late the kernel wakes us from a short sleep, and return
+ *	that (plus a bit) in nS.
  *********************************************************************************
  */
 
-void pwmWrite (int pin, int value)
+static unsigned int spinMeasure (void)
 {
-  struct wiringPiNodeStruct *node = wiringPiNodes ;
+  uint64_t late [CALIBRATE_SAMPLES], target, t ;
+  int i, j ;
 
-  if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
+  for (i = 0 ; i < CALIBRATE_SAMPLES ; ++i)
   {
-    if (RASPBERRY_PI_PERI_BASE == 0)	// Ignore for now
-      return ;
-
-    /**/ if (wiringPiMode == WPI_MODE_PINS)
-      pin = pinToGpio [pin] ;
-    else if (wiringPiMode == WPI_MODE_PHYS)
-      pin = physToGpio [pin] ;
-    else if (wiringPiMode != WPI_MODE_GPIO)
-      return ;
+    target = monotonicNow () + 50000 ;
+    sleepUntil (target) ;
+    t = monotonicNow () - target ;
 
-    *(pwm + gpioToPwmPort [pin]) = value ;
-  }
-  else
-  {
-    if ((node = wiringPiFindNode (pin)) != NULL)
-      node->pwmWrite (node, pin, value) ;
+    for (j = i ; (j > 0) && (late [j - 1] > t) ; --j)	// Keep them sorted
+      late [j] = late [j - 1] ;
+    late [j] = t ;
   }
+
+// Go by the 90th percentile so one bad wake-up doesn't skew it
+
+  t  = late [CALIBRATE_SAMPLES * 9 / 10] ;
+  t += t / 4 + 2000 ;
+
+  /**/ if (t < 2000)
+    t = 2000 ;
+  else if (t > 1000000)
+    t = 1000000 ;
+
+  return (unsigned int)t ;
 }
 
 
 /*
- * analogRead:
- *	Read the analog value of a given Pin. 
- *	There is no on-board Pi analog hardware,
- *	so this needs to go to a new node.
+ * delayCalibrate:
+ *	Measure how late the kernel wakes us from a short sleep and use that
+ *	as the point below which delayUntil () (and so periodicNext () and
+ *	the softPwm/softTone/softServo threads) finishes off by spinning.
+ *	It takes a few mS; it's done once by delayThreshold () when first
+ *	needed, so only call this to measure again, e.g. if the system load
+ *	changes. Until then we spin for the last 100uS.
+ *	Returns the new threshold in nanoseconds.
  *********************************************************************************
  */
 
-int analogRead (int pin)
+unsigned int delayCalibrate (void)
 {
-  struct wiringPiNodeStruct *node = wiringPiNodes ;
+  unsigned int t = spinMeasure () ;
 
-  if ((node = wiringPiFindNode (pin)) == NULL)
-    return 0 ;
-  else
-    return node->analogRead (node, pin) ;
+  __atomic_store_n (&spinThreshold, t, __ATOMIC_RELAXED) ;
+
+  if (wiringPiDebug)
+    printf ("wiringPi: delayUntil () will busy-wait the last %u nS\n", t) ;
+
+  return t ;
 }
 
 
 /*
- * analogWrite:
- *	Write the analog value to the given Pin. 
- *	There is no on-board Pi analog hardware,
- *	so this needs to go to a new node.
+ * delayThreshold:
+ *	The spin threshold delayUntil () uses, calibrated the first time it's
+ *	asked for - however many threads ask at once.
  *********************************************************************************
  */
 
-void analogWrite (int pin, int value)
+static void spinCalibrate (void)
 {
-  struct wiringPiNodeStruct *node = wiringPiNodes ;
+  (void)delayCalibrate () ;
+}
 
-  if ((node = wiringPiFindNode (pin)) == NULL)
-    return ;
+unsigned int delayThreshold (void)
+{
+  (void)pthread_once (&spinOnce, spinCalibrate) ;
 
-  node->analogWrite (node, pin, value) ;
+  return __atomic_load_n (&spinThreshold, __ATOMIC_RELAXED) ;
 }
 
 
 /*
- * pwmToneWrite:
- *	Pi Specific.
- *      Output the given frequency on the Pi's PWM pin
+ * wpiWaitInit: wpiWaitUntil:
+ *	For the threads that write pins at given times (softPwm, softTone,
+ *	digitalWriteAt): wait, with the lock held, for the earliest time
+ *	anything is due (WPI_NEVER if nothing is). This sleeps on the
+ *	condition until just before then, so it can be woken early if
+ *	something new turns up, then lets go of the lock and spins the rest
+ *	of the way, like delayUntil ().
+ *	Returns TRUE if when is due now, and the lock hasn't been let go,
+ *	otherwise FALSE: something may have changed, so look again.
+ *	The condition must be set up with wpiWaitInit (), and the thread
+ *	should call delayThreshold () before it takes the lock, as the first
+ *	call takes a few mS.
  *********************************************************************************
  */
 
-void pwmToneWrite (int pin, int freq)
+void wpiWaitInit (pthread_cond_t *cond)
 {
-  int range ;
+  pthread_condattr_t attr ;
 
-  if (RASPBERRY_PI_PERI_BASE == 0)	// Ignore for now
-    return ;
+  pthread_condattr_init     (&attr) ;
+  pthread_condattr_setclock (&attr, CLOCK_MONOTONIC) ;
+  pthread_cond_init         (cond, &attr) ;
+  pthread_condattr_destroy  (&attr) ;
+}
 
-  if (freq == 0)
-    pwmWrite (pin, 0) ;             // Off
-  else
+int wpiWaitUntil (pthread_cond_t *cond, pthread_mutex_t *lock, uint64_t when)
+{
+  struct timespec until ;
+  unsigned int threshold ;
+  uint64_t now, wake ;
+
+  if (when == WPI_NEVER)
   {
-    range = 600000 / freq ;
-    pwmSetRange (range) ;
-    pwmWrite    (pin, freq / 2) ;
+    pthread_cond_wait (cond, lock) ;
+    return FALSE ;
+  }
+
+  now = nanos () ;
+  if (when <= now)
+    return TRUE ;
+
+  threshold = delayThreshold () ;
+
+  if (when > now + threshold)
+  {
+    (void)clock_gettime (CLOCK_MONOTONIC, &until) ;	// The condition uses the raw clock, not nanos ()
+    wake = (uint64_t)until.tv_sec * 1000000000 + until.tv_nsec + (when - threshold - now) ;
+    until.tv_sec  = (time_t)(wake / 1000000000) ;
+    until.tv_nsec = (long)  (wake % 1000000000) ;
+    (void)pthread_cond_timedwait (cond, lock, &until) ;
+    return FALSE ;
   }
-}
 
+  pthread_mutex_unlock (lock) ;
+    delayUntil (when) ;
+  pthread_mutex_lock   (lock) ;
+
+  return FALSE ;
+}
 
 
 /*
- * digitalWriteByte:
- *	Pi Specific
- *	Write an 8-bit byte to the first 8 GPIO pins - try to do it as
- *	fast as possible.
- *	However it still needs 2 operations to set the bits, so any external
- *	hardware must not rely on seeing a change as there will be a change 
- *	to set the outputs bits to zero, then another change to set the 1's
+ * wpiBatchClear: wpiBatchAdd: wpiBatchWrite:
+ *	Gather up the writes that are due at one time, so that the on-board
+ *	pins (given by bank and mask, from digitalPinsToMask ()) all change
+ *	in one digitalWriteBanks (). Pins with a mask of 0 aren't on-board
+ *	and are written there and then. If a pin's added twice, the last
+ *	one wins.
+ *	wpiBatchWrite () returns TRUE if it wrote to the banks.
  *********************************************************************************
  */
 
-void digitalWriteByte (int value)
+void wpiBatchClear (struct wpiBatch *batch)
 {
-  uint32_t pinSet = 0 ;
-  uint32_t pinClr = 0 ;
-  int mask = 1 ;
-  int pin ;
+  batch->setMask [0] = batch->setMask [1] = 0 ;
+  batch->clrMask [0] = batch->clrMask [1] = 0 ;
+  batch->onBoard = FALSE ;
+}
 
-  /**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)
+void wpiBatchAdd (struct wpiBatch *batch, int pin, int bank, uint32_t mask, int value)
+{
+  if (mask == 0)
+    digitalWrite (pin, value) ;
+  else if (value == LOW)
   {
-    for (pin = 0 ; pin < 8 ; ++pin)
-    {
-      digitalWrite (pin, value & mask) ;
-      mask <<= 1 ;
-    }
-    return ;
+    batch->clrMask [bank] |=  mask ;
+    batch->setMask [bank] &= ~mask ;
+    batch->onBoard = TRUE ;
   }
   else
   {
-    for (pin = 0 ; pin < 8 ; ++pin)
-    {
-      if ((value & mask) == 0)
-	pinClr |= (1 << pinToGpio [pin]) ;
-      else
-	pinSet |= (1 << pinToGpio [pin]) ;
+    batch->setMask [bank] |=  mask ;
+    batch->clrMask [bank] &= ~mask ;
+    batch->onBoard = TRUE ;
+  }
+}
 
-      mask <<= 1 ;
-    }
+int wpiBatchWrite (const struct wpiBatch *batch)
+{
+  if (!batch->onBoard)
+    return FALSE ;
 
-    *(gpio + gpioToGPCLR [0]) = pinClr ;
-    *(gpio + gpioToGPSET [0]) = pinSet ;
-  }
+  digitalWriteBanks (batch->setMask, batch->clrMask) ;
+  return TRUE ;
 }
 
 
 /*
- * waitForInterrupt:
- *	Pi Specific.
- *	Wait for Interrupt on a GPIO pin.
- *	This is actually done via the /sys/class/gpio interface regardless of
- *	the wiringPi access mode in-use. Maybe sometime it might get a better
- *	way for a bit more efficiency.
+ * millis:
+ *	Return a number of milliseconds as an unsigned int.
+ *	This wraps after 49 days - see millis64 ()
  *********************************************************************************
  */
 
-int waitForInterrupt (int pin, int mS)
+unsigned int millis (void)
 {
-  int fd, x ;
-  uint8_t c ;
-  struct pollfd polls ;
-
-  /**/ if (wiringPiMode == WPI_MODE_PINS)
-    pin = pinToGpio [pin] ;
-  else if (wiringPiMode == WPI_MODE_PHYS)
-    pin = physToGpio [pin] ;
-
-  if ((fd = sysFds [pin]) == -1)
-    return -2 ;
-
-// Setup poll structure
-
-  polls.fd     = fd ;
-  polls.events = POLLPRI ;	// Urgent data!
-
-// Wait for it ...
+  return (uint32_t)millis64 () ;
+}
 
-  x = poll (&polls, 1, mS) ;
 
-// Do a dummy read to clear the interrupt
-//	A one character read appars to be enough.
-//	Followed by a seek to reset it.
+/*
+ * micros:
+ *	Return a number of microseconds as an unsigned int.
+ *	This wraps after 71 minutes - see micros64 ()
+ *	With the system timer it's a single read of its bottom half.
+ *********************************************************************************
+ */
 
-  (void)read (fd, &c, 1) ;
-  lseek (fd, 0, SEEK_SET) ;
+unsigned int micros (void)
+{
+  if (timer != NULL)
+    return *(timer + TIMER_CLO) - (uint32_t)epochTimer ;
 
-  return x ;
+  return (uint32_t)micros64 () ;
 }
 
 
 /*
- * interruptHandler:
- *	This is a thread and gets started to wait for the interrupt we're
- *	hoping to catch. It will call the user-function when the interrupt
- *	fires.
+ * millis64: micros64: nanos:
+ *	Return the time since wiringPi was set up, as 64-bit numbers which
+ *	won't wrap. These use clock_gettime (CLOCK_MONOTONIC) which doesn't
+ *	normally need a system call, and we avoid 64-bit divides as they
+ *	are slow on the ARM.
+ *	micros64 uses the system timer instead when it's mapped, which
+ *	doesn't need a call at all. (It's not adjusted by NTP, so over a
+ *	long time it can drift a little from the others)
  *********************************************************************************
  */
 
-static void *interruptHandler (void *arg)
+uint64_t millis64 (void)
 {
-  int myPin ;
+  struct timespec ts ;
 
-  (void)piHiPri (55) ;	// Only effective if we run as root
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  return (uint64_t)ts.tv_sec * (uint64_t)1000 + (uint64_t)(ts.tv_nsec / 1000000) - epochMilli ;
+}
+
+uint64_t micros64 (void)
+{
+  struct timespec ts ;
 
-  myPin   = pinPass ;
-  pinPass = -1 ;
+  if (timer != NULL)
+    return timerRead64 () - epochTimer ;
 
-  for (;;)
-    if (waitForInterrupt (myPin, -1) > 0)
-      isrFunctions [myPin] () ;
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  return (uint64_t)ts.tv_sec * (uint64_t)1000000 + (uint64_t)(ts.tv_nsec / 1000) - epochMicro ;
+}
 
-  return NULL ;
+uint64_t nanos (void)
+{
+  return monotonicNow () - epochNano ;
 }
 
 
 /*
- * wiringPiISR:
- *	Pi Specific.
- *	Take the details and create an interrupt handler that will do a call-
- *	back to the user supplied function.
+ * wiringPiSetupMem:
+ *	Map the real hardware via /dev/gpiomem or /dev/mem
  *********************************************************************************
  */
 
-int wiringPiISR (int pin, int mode, void (*function)(void))
+static int wiringPiSetupMem (void)
 {
-  pthread_t threadId ;
-  const char *modeS ;
-  char fName   [64] ;
-  char  pinS [8] ;
-  pid_t pid ;
-  int   count, i ;
-  char  c ;
-  int   bcmGpioPin ;
+  int fd ;
 
-  if ((pin < 0) || (pin > 63))
-    return wiringPiFailure (WPI_FATAL, "wiringPiISR: pin must be 0-63 (%d)\n", pin) ;
-
-  /**/ if (wiringPiMode == WPI_MODE_UNINITIALISED)
-    return wiringPiFailure (WPI_FATAL, "wiringPiISR: wiringPi has not been initialised. Unable to continue.\n") ;
-  else if (wiringPiMode == WPI_MODE_PINS)
-    bcmGpioPin = pinToGpio [pin] ;
-  else if (wiringPiMode == WPI_MODE_PHYS)
-    bcmGpioPin = physToGpio [pin] ;
-  else
-    bcmGpioPin = pin ;
+  if (memFd != -1)			// Been here before
+  {
+    close (memFd) ;
+    memFd = -1 ;
+  }
 
-// Now export the pin and set the right edge
-//	We're going to use the gpio program to do this, so it assumes
-//	a full installation of wiringPi. It's a bit 'clunky', but it
-//	is a way that will work when we're running in "Sys" mode, as
-//	a non-root user. (without sudo)
+// Open the master /dev/ memory control device
+
+//	See if /dev/gpiomem exists and we can open it...
 
-  if (mode != INT_EDGE_SETUP)
+  if (wiringPiTryGpioMem)
   {
-    /**/ if (mode == INT_EDGE_FALLING)
-      modeS = "falling" ;
-    else if (mode == INT_EDGE_RISING)
-      modeS = "rising" ;
-    else
-      modeS = "both" ;
+    if ((fd = open ("/dev/gpiomem", O_RDWR | O_SYNC | O_CLOEXEC) ) < 0)
+      return wiringPiFailure (WPI_ALMOST, "wiringPiSetup: Unable to open /dev/gpiomem: %s\n", strerror (errno)) ;
+    RASPBERRY_PI_PERI_BASE = 0 ;
+  }
 
-    sprintf (pinS, "%d", bcmGpioPin) ;
+//	... otherwise fall back to the original /dev/mem which requires root level access
 
-    if ((pid = fork ()) < 0)	// Fail
-      return wiringPiFailure (WPI_FATAL, "wiringPiISR: fork failed: %s\n", strerror (errno)) ;
+  else
+  {
 
-    if (pid == 0)	// Child, exec
-    {
-      /**/ if (access ("/usr/local/bin/gpio", X_OK) == 0)
-      {
-	execl ("/usr/local/bin/gpio", "gpio", "edge", pinS, modeS, (char *)NULL) ;
-	return wiringPiFailure (WPI_FATAL, "wiringPiISR: execl failed: %s\n", strerror (errno)) ;
-      }
-      else if (access ("/usr/bin/gpio", X_OK) == 0)
-      {
-	execl ("/usr/bin/gpio", "gpio", "edge", pinS, modeS, (char *)NULL) ;
-	return wiringPiFailure (WPI_FATAL, "wiringPiISR: execl failed: %s\n", strerror (errno)) ;
-      }
-      else
-	return wiringPiFailure (WPI_FATAL, "wiringPiISR: Can't find gpio program\n") ;
-    }
-    else		// Parent, wait
-      wait (NULL) ;
+//	This check is here because people are too stupid to check for themselves or read
+//		error messages.
+
+    if (geteuid () != 0)
+      (void)wiringPiFailure (WPI_FATAL, "wiringPiSetup: Must be root. (Did you forget sudo?)\n") ;
+
+    if ((fd = open ("/dev/mem", O_RDWR | O_SYNC | O_CLOEXEC) ) < 0)
+      return wiringPiFailure (WPI_ALMOST, "wiringPiSetup: Unable to open /dev/mem: %s\n", strerror (errno)) ;
   }
 
-// Now pre-open the /sys/class node - but it may already be open if
-//	we are in Sys mode...
+// Set the offsets into the memory interface.
+
+  GPIO_PADS 	  = RASPBERRY_PI_PERI_BASE + 0x00100000 ;
+  GPIO_CLOCK_BASE = RASPBERRY_PI_PERI_BASE + 0x00101000 ;
+  GPIO_BASE	  = RASPBERRY_PI_PERI_BASE + 0x00200000 ;
+  GPIO_TIMER	  = RASPBERRY_PI_PERI_BASE + 0x00003000 ;
+  GPIO_PWM	  = RASPBERRY_PI_PERI_BASE + 0x0020C000 ;
 
-  if (sysFds [bcmGpioPin] == -1)
-  {
-    sprintf (fName, "/sys/class/gpio/gpio%d/value", bcmGpioPin) ;
-    if ((sysFds [bcmGpioPin] = open (fName, O_RDWR)) < 0)
-      return wiringPiFailure (WPI_FATAL, "wiringPiISR: unable to open %s: %s\n", fName, strerror (errno)) ;
-  }
+// Map the individual hardware components
 
-// Clear any initial pending interrupt
+//	GPIO:
 
-  ioctl (sysFds [bcmGpioPin], FIONREAD, &count) ;
-  for (i = 0 ; i < count ; ++i)
-    read (sysFds [bcmGpioPin], &c, 1) ;
+  defaultCtx.gpio = (uint32_t *)mmap(0, BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, GPIO_BASE) ;
+  if ((int32_t)defaultCtx.gpio == -1)
+    return wiringPiFailure (WPI_ALMOST, "wiringPiSetup: mmap (GPIO) failed: %s\n", strerror (errno)) ;
 
-  isrFunctions [pin] = function ;
+//	PWM, Clock control and the drive pads are left until they're needed
 
-  pthread_mutex_lock (&pinMutex) ;
-    pinPass = pin ;
-    pthread_create (&threadId, NULL, interruptHandler, NULL) ;
-    while (pinPass != -1)
-      delay (1) ;
-  pthread_mutex_unlock (&pinMutex) ;
+  pwm = clk = pads = NULL ;
 
-  return 0 ;
-}
+//	The system timer
+//	/dev/gpiomem only gives us the GPIO, so then we stick with clock_gettime (),
+//	as we do if the kernel won't let us have it (e.g. strict devmem)
 
+  timer = NULL ;
 
-/*
- * initialiseEpoch:
- *	Initialise our start-of-time variable to be the current unix
- *	time in milliseconds and microseconds.
- *********************************************************************************
- */
+  if (RASPBERRY_PI_PERI_BASE != 0)
+  {
+    timer = (uint32_t *)mmap(0, BLOCK_SIZE, PROT_READ, MAP_SHARED, fd, GPIO_TIMER) ;
+    if (timer == MAP_FAILED)
+    {
+      if (wiringPiDebug)
+	printf ("wiringPi: mmap (TIMER) failed: %s\n", strerror (errno)) ;
+      timer = NULL ;
+    }
+  }
 
-static void initialiseEpoch (void)
-{
-  struct timeval tv ;
+  memFd = fd ;
 
-  gettimeofday (&tv, NULL) ;
-  epochMilli = (uint64_t)tv.tv_sec * (uint64_t)1000    + (uint64_t)(tv.tv_usec / 1000) ;
-  epochMicro = (uint64_t)tv.tv_sec * (uint64_t)1000000 + (uint64_t)(tv.tv_usec) ;
+  return 0 ;
 }
 
 
 /*
- * delay:
- *	Wait for some number of milliseconds
+ * periMap:
+ *	Map the PWM, clock and pads blocks - see periMapped ()
  *********************************************************************************
  */
 
-void delay (unsigned int howLong)
+static int periMap (void)
 {
-  struct timespec sleeper, dummy ;
+  volatile uint32_t *newPwm ;
 
-  sleeper.tv_sec  = (time_t)(howLong / 1000) ;
-  sleeper.tv_nsec = (long)(howLong % 1000) * 1000000 ;
+  if ((RASPBERRY_PI_PERI_BASE == 0) || (memFd == -1))
+    return FALSE ;
 
-  nanosleep (&sleeper, &dummy) ;
-}
+  pthread_mutex_lock (&periMutex) ;
 
+  if (pwm == NULL)
+  {
 
-/*
- * delayMicroseconds:
- *	This is somewhat intersting. It seems that on the Pi, a single call
- *	to nanosleep takes some 80 to 130 microseconds anyway, so while
- *	obeying the standards (may take longer), it's not always what we
- *	want!
- *
- *	So what I'll do now is if the delay is less than 100uS we'll do it
- *	in a hard loop, watching a built-in counter on the ARM chip. This is
- *	somewhat sub-optimal in that it uses 100% CPU, something not an issue
- *	in a microcontroller, but under a multi-tasking, multi-user OS, it's
- *	wastefull, however we've no real choice )-:
- *
- *      Plan B: It seems all might not be well with that plan, so changing it
- *      to use gettimeofday () and poll on that instead...
- *********************************************************************************
- */
+//	Clock control (needed for PWM)
 
-void delayMicrosecondsHard (unsigned int howLong)
-{
-  struct timeval tNow, tLong, tEnd ;
+    clk = (uint32_t *)mmap(0, BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, memFd, GPIO_CLOCK_BASE) ;
+    if (clk == MAP_FAILED)
+    {
+      clk = NULL ;
+      pthread_mutex_unlock (&periMutex) ;
+      (void)wiringPiFailure (WPI_ALMOST, "wiringPi: mmap (CLOCK) failed: %s\n", strerror (errno)) ;
+      return FALSE ;
+    }
 
-  gettimeofday (&tNow, NULL) ;
-  tLong.tv_sec  = howLong / 1000000 ;
-  tLong.tv_usec = howLong % 1000000 ;
-  timeradd (&tNow, &tLong, &tEnd) ;
+//	The drive pads
 
-  while (timercmp (&tNow, &tEnd, <))
-    gettimeofday (&tNow, NULL) ;
-}
+    pads = (uint32_t *)mmap(0, BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, memFd, GPIO_PADS) ;
+    if (pads == MAP_FAILED)
+    {
+      pads = NULL ;
+      pthread_mutex_unlock (&periMutex) ;
+      (void)wiringPiFailure (WPI_ALMOST, "wiringPi: mmap (PADS) failed: %s\n", strerror (errno)) ;
+      return FALSE ;
+    }
 
-void delayMicroseconds (unsigned int howLong)
-{
-  struct timespec sleeper ;
-  unsigned int uSecs = howLong % 1000000 ;
-  unsigned int wSecs = howLong / 1000000 ;
+//	PWM - last, as it's the one periMapped () looks at
 
-  /**/ if (howLong ==   0)
-    return ;
-  else if (howLong  < 100)
-    delayMicrosecondsHard (howLong) ;
-  else
-  {
-    sleeper.tv_sec  = wSecs ;
-    sleeper.tv_nsec = (long)(uSecs * 1000L) ;
-    nanosleep (&sleeper, NULL) ;
+    newPwm = (uint32_t *)mmap(0, BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, memFd, GPIO_PWM) ;
+    if (newPwm == MAP_FAILED)
+    {
+      pthread_mutex_unlock (&periMutex) ;
+      (void)wiringPiFailure (WPI_ALMOST, "wiringPi: mmap (PWM) failed: %s\n", strerror (errno)) ;
+      return FALSE ;
+    }
+    __atomic_store_n (&pwm, newPwm, __ATOMIC_RELEASE) ;
+
+    if (wiringPiDebug)
+      printf ("wiringPi: Mapped the PWM, clock and pads blocks\n") ;
   }
+
+  pthread_mutex_unlock (&periMutex) ;
+
+  return TRUE ;
 }
 
 
 /*
- * millis:
- *	Return a number of milliseconds as an unsigned int.
+ * wiringPiSetupSim:
+ *	Use simulated hardware - see wiringPiSim.c
+ *	We only ever need one lot of it, however many times we're called.
  *********************************************************************************
  */
 
-unsigned int millis (void)
+static int wiringPiSetupSim (void)
 {
-  struct timeval tv ;
-  uint64_t now ;
+  if (defaultCtx.sim == NULL)
+    if ((defaultCtx.sim = wiringPiSimCreate (getenv (ENV_SIM))) == NULL)
+      return wiringPiFailure (WPI_ALMOST, "wiringPiSetup: Unable to create simulated hardware: %s\n", strerror (errno)) ;
 
-  gettimeofday (&tv, NULL) ;
-  now  = (uint64_t)tv.tv_sec * (uint64_t)1000 + (uint64_t)(tv.tv_usec / 1000) ;
+  defaultCtx.gpio = wiringPiSimBlock (defaultCtx.sim, WPI_SIM_GPIO) ;
+  pwm  = wiringPiSimBlock (defaultCtx.sim, WPI_SIM_PWM) ;
+  clk  = wiringPiSimBlock (defaultCtx.sim, WPI_SIM_CLK) ;
+  pads = wiringPiSimBlock (defaultCtx.sim, WPI_SIM_PADS) ;
 
-  return (uint32_t)(now - epochMilli) ;
+  return 0 ;
 }
 
 
 /*
- * micros:
- *	Return a number of microseconds as an unsigned int.
+ * releaseChip:
+ *	A gpiochip request holds every line we've used until it's closed, so
+ *	if we're set up again in another mode, give them back for others
+ *	(e.g. sysfs exports) to use.
  *********************************************************************************
  */
 
-unsigned int micros (void)
+static void releaseChip (void)
 {
-  struct timeval tv ;
-  uint64_t now ;
+  if (defaultCtx.chip == NULL)
+    return ;
 
-  gettimeofday (&tv, NULL) ;
-  now  = (uint64_t)tv.tv_sec * (uint64_t)1000000 + (uint64_t)tv.tv_usec ;
+  pthread_mutex_lock (&isrMutex) ;
+    if (isrChipAdded)
+    {
+      (void)epoll_ctl (isrEpollFd, EPOLL_CTL_DEL, wpiChipFd (defaultCtx.chip), NULL) ;
+      isrChipAdded = FALSE ;
+    }
+  pthread_mutex_unlock (&isrMutex) ;
 
-  return (uint32_t)(now - epochMicro) ;
+  wpiChipClose (defaultCtx.chip) ;
+  defaultCtx.chip = NULL ;
 }
 
 
@@ -1967,9 +4161,10 @@ unsigned int micros (void)
 
 int wiringPiSetup (void)
 {
-  int   fd ;
+  int   res ;
   int   boardRev ;
   int   model, rev, mem, maker, overVolted ;
+  uint64_t start = monotonicNow () ;
 
   if (getenv (ENV_DEBUG) != NULL)
     wiringPiDebug = TRUE ;
@@ -1980,24 +4175,31 @@ int wiringPiSetup (void)
   if (getenv (ENV_GPIOMEM) != NULL)
     wiringPiTryGpioMem = TRUE ;
 
+  if (getenv (ENV_SIM) != NULL)
+    wiringPiSimulate = TRUE ;
+
   if (wiringPiDebug)
   {
     printf ("wiringPi: wiringPiSetup called\n") ;
-    if (wiringPiTryGpioMem)
+    /**/ if (wiringPiSimulate)
+      printf ("wiringPi: Using simulated hardware\n") ;
+    else if (wiringPiTryGpioMem)
       printf ("wiringPi: Using /dev/gpiomem\n") ;
   }
 
+  releaseChip () ;
+
   boardRev = piBoardRev () ;
 
   /**/ if (boardRev == 1)	// A, B, Rev 1, 1.1
   {
-     pinToGpio =  pinToGpioR1 ;
-    physToGpio = physToGpioR1 ;
+     defaultCtx.pinToGpio =  pinToGpioR1 ;
+    defaultCtx.physToGpio = physToGpioR1 ;
   }
   else 				// A, B, Rev 2, B+, CM, Pi2
   {
-     pinToGpio =  pinToGpioR2 ;
-    physToGpio = physToGpioR2 ;
+     defaultCtx.pinToGpio =  pinToGpioR2 ;
+    defaultCtx.physToGpio = physToGpioR2 ;
   }
 
   if (piModel2)
@@ -2005,81 +4207,16 @@ int wiringPiSetup (void)
   else
     RASPBERRY_PI_PERI_BASE = 0x20000000 ;
 
-// Open the master /dev/ memory control device
-
-//	See if /dev/gpiomem exists and we can open it...
-
-  if (wiringPiTryGpioMem)
-  {
-    if ((fd = open ("/dev/gpiomem", O_RDWR | O_SYNC | O_CLOEXEC) ) < 0)
-      return wiringPiFailure (WPI_ALMOST, "wiringPiSetup: Unable to open /dev/gpiomem: %s\n", strerror (errno)) ;
-    RASPBERRY_PI_PERI_BASE = 0 ;
-  }
-
-//	... otherwise fall back to the original /dev/mem which requires root level access
-
+  if (wiringPiSimulate)
+    res = wiringPiSetupSim () ;
   else
-  {
-
-//	This check is here because people are too stupid to check for themselves or read
-//		error messages.
-
-    if (geteuid () != 0)
-      (void)wiringPiFailure (WPI_FATAL, "wiringPiSetup: Must be root. (Did you forget sudo?)\n") ;
-
-    if ((fd = open ("/dev/mem", O_RDWR | O_SYNC | O_CLOEXEC) ) < 0)
-      return wiringPiFailure (WPI_ALMOST, "wiringPiSetup: Unable to open /dev/mem: %s\n", strerror (errno)) ;
-  }
-
-// Set the offsets into the memory interface.
-
-  GPIO_PADS 	  = RASPBERRY_PI_PERI_BASE + 0x00100000 ;
-  GPIO_CLOCK_BASE = RASPBERRY_PI_PERI_BASE + 0x00101000 ;
-  GPIO_BASE	  = RASPBERRY_PI_PERI_BASE + 0x00200000 ;
-  GPIO_TIMER	  = RASPBERRY_PI_PERI_BASE + 0x0000B000 ;
-  GPIO_PWM	  = RASPBERRY_PI_PERI_BASE + 0x0020C000 ;
-
-// Map the individual hardware components
-
-//	GPIO:
-
-  gpio = (uint32_t *)mmap(0, BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, GPIO_BASE) ;
-  if ((int32_t)gpio == -1)
-    return wiringPiFailure (WPI_ALMOST, "wiringPiSetup: mmap (GPIO) failed: %s\n", strerror (errno)) ;
-
-//	PWM
-
-  pwm = (uint32_t *)mmap(0, BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, GPIO_PWM) ;
-  if ((int32_t)pwm == -1)
-    return wiringPiFailure (WPI_ALMOST, "wiringPiSetup: mmap (PWM) failed: %s\n", strerror (errno)) ;
- 
-//	Clock control (needed for PWM)
-
-  clk = (uint32_t *)mmap(0, BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, GPIO_CLOCK_BASE) ;
-  if ((int32_t)clk == -1)
-    return wiringPiFailure (WPI_ALMOST, "wiringPiSetup: mmap (CLOCK) failed: %s\n", strerror (errno)) ;
- 
-//	The drive pads
-
-  pads = (uint32_t *)mmap(0, BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, GPIO_PADS) ;
-  if ((int32_t)pads == -1)
-    return wiringPiFailure (WPI_ALMOST, "wiringPiSetup: mmap (PADS) failed: %s\n", strerror (errno)) ;
-
-#ifdef	USE_TIMER
-//	The system timer
-
-  timer = (uint32_t *)mmap(0, BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, GPIO_TIMER) ;
-  if ((int32_t)timer == -1)
-    return wiringPiFailure (WPI_ALMOST, "wiringPiSetup: mmap (TIMER) failed: %s\n", strerror (errno)) ;
+    res = wiringPiSetupMem () ;
 
-// Set the timer to free-running, 1MHz.
-//	0xF9 is 249, the timer divide is base clock / (divide+1)
-//	so base clock is 250MHz / 250 = 1MHz.
+  if (res != 0)
+    return res ;
 
-  *(timer + TIMER_CONTROL) = 0x0000280 ;
-  *(timer + TIMER_PRE_DIV) = 0x00000F9 ;
-  timerIrqRaw = timer + TIMER_IRQ_RAW ;
-#endif
+  if (wiringPiDebug)
+    printf ("wiringPi: %s for micros ()\n", (timer != NULL) ? "Using the system timer" : "Using clock_gettime ()") ;
 
   initialiseEpoch () ;
 
@@ -2087,9 +4224,12 @@ int wiringPiSetup (void)
 
   piBoardId (&model, &rev, &mem, &maker, &overVolted) ;
   if (model == PI_MODEL_CM)
-    wiringPiMode = WPI_MODE_GPIO ;
+    defaultCtx.mode = WPI_MODE_GPIO ;
   else
-    wiringPiMode = WPI_MODE_PINS ;
+    defaultCtx.mode = WPI_MODE_PINS ;
+
+  if (wiringPiDebug)
+    printf ("wiringPi: Setup took %llu uS\n", (unsigned long long)((monotonicNow () - start) / 1000)) ;
 
   return 0 ;
 }
@@ -2111,7 +4251,7 @@ int wiringPiSetupGpio (void)
   if (wiringPiDebug)
     printf ("wiringPi: wiringPiSetupGpio called\n") ;
 
-  wiringPiMode = WPI_MODE_GPIO ;
+  defaultCtx.mode = WPI_MODE_GPIO ;
 
   return 0 ;
 }
@@ -2133,7 +4273,7 @@ int wiringPiSetupPhys (void)
   if (wiringPiDebug)
     printf ("wiringPi: wiringPiSetupPhys called\n") ;
 
-  wiringPiMode = WPI_MODE_PHYS ;
+  defaultCtx.mode = WPI_MODE_PHYS ;
 
   return 0 ;
 }
@@ -2153,6 +4293,7 @@ int wiringPiSetupSys (void)
   int boardRev ;
   int pin ;
   char fName [128] ;
+  uint64_t start = monotonicNow () ;
 
   if (getenv (ENV_DEBUG) != NULL)
     wiringPiDebug = TRUE ;
@@ -2163,17 +4304,19 @@ int wiringPiSetupSys (void)
   if (wiringPiDebug)
     printf ("wiringPi: wiringPiSetupSys called\n") ;
 
+  releaseChip () ;
+
   boardRev = piBoardRev () ;
 
   if (boardRev == 1)
   {
-     pinToGpio =  pinToGpioR1 ;
-    physToGpio = physToGpioR1 ;
+     defaultCtx.pinToGpio =  pinToGpioR1 ;
+    defaultCtx.physToGpio = physToGpioR1 ;
   }
   else
   {
-     pinToGpio =  pinToGpioR2 ;
-    physToGpio = physToGpioR2 ;
+     defaultCtx.pinToGpio =  pinToGpioR2 ;
+    defaultCtx.physToGpio = physToGpioR2 ;
   }
 
 // Open and scan the directory, looking for exported GPIOs, and pre-open
@@ -2182,12 +4325,226 @@ int wiringPiSetupSys (void)
   for (pin = 0 ; pin < 64 ; ++pin)
   {
     sprintf (fName, "/sys/class/gpio/gpio%d/value", pin) ;
-    sysFds [pin] = open (fName, O_RDWR) ;
+    defaultCtx.sysFds [pin] = open (fName, O_RDWR) ;
+  }
+
+  initialiseEpoch () ;
+
+  defaultCtx.mode = WPI_MODE_GPIO_SYS ;
+
+  if (wiringPiDebug)
+    printf ("wiringPi: Setup took %llu uS\n", (unsigned long long)((monotonicNow () - start) / 1000)) ;
+
+  return 0 ;
+}
+
+
+/*
+ * wiringPiSetupGpioChip:
+ *	Must be called once at the start of your program execution.
+ *
+ * Use the GPIO character device (/dev/gpiochip0, or whatever WIRINGPI_GPIOCHIP
+ *	says) - no root needed and nothing to export first. Pins are BCM_GPIO
+ *	numbers, as in Sys mode, but reading or writing any number of them
+ *	at once is a single system call and we can do edges ourselves.
+ *********************************************************************************
+ */
+
+int wiringPiSetupGpioChip (void)
+{
+  const char *path ;
+  int boardRev ;
+
+  if (getenv (ENV_DEBUG) != NULL)
+    wiringPiDebug = TRUE ;
+
+  if (getenv (ENV_CODES) != NULL)
+    wiringPiReturnCodes = TRUE ;
+
+  if ((path = getenv (ENV_GPIOCHIP)) == NULL)
+    path = "/dev/gpiochip0" ;
+
+  if (wiringPiDebug)
+    printf ("wiringPi: wiringPiSetupGpioChip called (%s)\n", path) ;
+
+  boardRev = piBoardRev () ;
+
+  if (boardRev == 1)
+  {
+     defaultCtx.pinToGpio =  pinToGpioR1 ;
+    defaultCtx.physToGpio = physToGpioR1 ;
   }
+  else
+  {
+     defaultCtx.pinToGpio =  pinToGpioR2 ;
+    defaultCtx.physToGpio = physToGpioR2 ;
+  }
+
+  if (defaultCtx.chip == NULL)
+    if ((defaultCtx.chip = wpiChipOpen (path)) == NULL)
+      return wiringPiFailure (WPI_ALMOST, "wiringPiSetupGpioChip: Unable to open %s: %s\n", path, strerror (errno)) ;
 
   initialiseEpoch () ;
 
-  wiringPiMode = WPI_MODE_GPIO_SYS ;
+  defaultCtx.mode = WPI_MODE_GPIO_CHIP ;
 
   return 0 ;
 }
+
+
+/*
+ * wiringPiContextDefault:
+ *	The context the normal (non _ctx) functions use, as set up by one of
+ *	the wiringPiSetup* functions.
+ *********************************************************************************
+ */
+
+struct wpiContext *wiringPiContextDefault (void)
+{
+  return &defaultCtx ;
+}
+
+
+/*
+ * wiringPiContextCreate:
+ *	Make a new context, independent of the default one, so a program (or
+ *	a library inside one) can have more than one way in to the pins at
+ *	once - e.g. the simulator next to the real thing. Pins are always
+ *	BCM_GPIO numbers. mode and device are:
+ *	  WPI_MODE_GPIO:	NULL for /dev/mem (/dev/gpiomem if WIRINGPI_GPIOMEM
+ *				is set), a /dev/ device to map, or "sim" or
+ *				"sim:<file>" for a new simulator
+ *	  WPI_MODE_GPIO_SYS:	device is ignored
+ *	  WPI_MODE_GPIO_CHIP:	the gpiochip device, NULL for the default
+ *	Returns NULL on failure with errno set.
+ *********************************************************************************
+ */
+
+struct wpiContext *wiringPiContextCreate (int mode, const char *device)
+{
+  struct wpiContext *ctx ;
+  volatile uint32_t *gpioMap ;
+  unsigned int base ;
+  char fName [128] ;
+  int fd, pin, err ;
+
+  if ((ctx = (struct wpiContext *)calloc (1, sizeof (struct wpiContext))) == NULL)
+    return NULL ;
+
+  ctx->mode = mode ;
+  for (pin = 0 ; pin < 64 ; ++pin)
+    ctx->sysFds [pin] = -1 ;
+
+  if (piBoardRev () == 1)
+  {
+    ctx->pinToGpio  = pinToGpioR1 ;
+    ctx->physToGpio = physToGpioR1 ;
+  }
+  else
+  {
+    ctx->pinToGpio  = pinToGpioR2 ;
+    ctx->physToGpio = physToGpioR2 ;
+  }
+
+  /**/ if (mode == WPI_MODE_GPIO)
+  {
+    if ((device != NULL) && (strncmp (device, "sim", 3) == 0) && ((device [3] == 0) || (device [3] == ':')))
+    {
+      if ((ctx->sim = wiringPiSimCreate ((device [3] == ':') ? device + 4 : NULL)) == NULL)
+      {
+	free (ctx) ;
+	return NULL ;
+      }
+      ctx->gpio = wiringPiSimBlock (ctx->sim, WPI_SIM_GPIO) ;
+      return ctx ;
+    }
+
+    if (device == NULL)
+      device = (getenv (ENV_GPIOMEM) != NULL) ? "/dev/gpiomem" : "/dev/mem" ;
+
+    if (strcmp (device, "/dev/mem") == 0)
+      base = (piModel2 ? 0x3F000000 : 0x20000000) + 0x00200000 ;
+    else
+      base = 0 ;
+
+    if ((fd = open (device, O_RDWR | O_SYNC | O_CLOEXEC)) < 0)
+    {
+      err = errno ;
+      free (ctx) ;
+      errno = err ;
+      return NULL ;
+    }
+
+    gpioMap = (uint32_t *)mmap (0, BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, base) ;
+    err = errno ;
+    close (fd) ;
+
+    if (gpioMap == MAP_FAILED)
+    {
+      free (ctx) ;
+      errno = err ;
+      return NULL ;
+    }
+    ctx->gpio = gpioMap ;
+  }
+  else if (mode == WPI_MODE_GPIO_SYS)
+  {
+    for (pin = 0 ; pin < 64 ; ++pin)
+    {
+      sprintf (fName, "/sys/class/gpio/gpio%d/value", pin) ;
+      ctx->sysFds [pin] = open (fName, O_RDWR | O_CLOEXEC) ;
+    }
+  }
+  else if (mode == WPI_MODE_GPIO_CHIP)
+  {
+    if (device == NULL)
+      if ((device = getenv (ENV_GPIOCHIP)) == NULL)
+	device = "/dev/gpiochip0" ;
+
+    if ((ctx->chip = wpiChipOpen (device)) == NULL)
+    {
+      err = errno ;
+      free (ctx) ;
+      errno = err ;
+      return NULL ;
+    }
+  }
+  else
+  {
+    free (ctx) ;
+    errno = EINVAL ;
+    return NULL ;
+  }
+
+  return ctx ;
+}
+
+
+/*
+ * wiringPiContextDestroy:
+ *	Let go of a context from wiringPiContextCreate (). The default
+ *	context can't be destroyed.
+ *********************************************************************************
+ */
+
+void wiringPiContextDestroy (struct wpiContext *ctx)
+{
+  int pin ;
+
+  if ((ctx == NULL) || (ctx == &defaultCtx))
+    return ;
+
+  /**/ if (ctx->sim != NULL)
+    wiringPiSimDestroy (ctx->sim) ;
+  else if (ctx->gpio != NULL)
+    munmap ((void *)ctx->gpio, BLOCK_SIZE) ;
+
+  if (ctx->chip != NULL)
+    wpiChipClose (ctx->chip) ;
+
+  for (pin = 0 ; pin < 64 ; ++pin)
+    if (ctx->sysFds [pin] != -1)
+      close (ctx->sysFds [pin]) ;
+
+  free (ctx) ;
+}
@@ -24,6 +24,10 @@
 #ifndef	__WIRING_PI_H__
 #define	__WIRING_PI_H__
 
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
 // Handy defines
 
 // wiringPi modes
@@ -33,6 +37,7 @@
 #define	WPI_MODE_GPIO_SYS	 2
 #define	WPI_MODE_PHYS		 3
 #define	WPI_MODE_PIFACE		 4
+#define	WPI_MODE_GPIO_CHIP	 5
 #define	WPI_MODE_UNINITIALISED	-1
 
 // Pin modes
@@ -66,6 +71,14 @@
 #define	INT_EDGE_RISING		2
 #define	INT_EDGE_BOTH		3
 
+// Hardware edge detect
+
+#define	ED_NONE			0x00
+#define	ED_RISING		0x01
+#define	ED_FALLING		0x02
+#define	ED_ASYNC_RISING		0x04
+#define	ED_ASYNC_FALLING	0x08
+
 // Pi model types and version numbers
 //	Intended for the GPIO program Use at your own risk.
 
@@ -111,10 +124,9 @@ extern const int   piMemorySize    [ 8] ;
 // wiringPiNodeStruct:
 //	This describes additional device nodes in the extended wiringPi
 //	2.0 scheme of things.
-//	It's a simple linked list for now, but will hopefully migrate to 
-//	a binary tree for efficiency reasons - but then again, the chances
-//	of more than 1 or 2 devices being added are fairly slim, so who
-//	knows....
+//	They're kept in a simple linked list, but wiringPiFindNode () uses
+//	a page table indexed by pin number, so having lots of them doesn't
+//	slow down access to any of them.
 
 struct wiringPiNodeStruct
 {
@@ -136,11 +148,90 @@ struct wiringPiNodeStruct
   void   (*analogWrite)     (struct wiringPiNodeStruct *node, int pin, int value) ;
 
   struct wiringPiNodeStruct *next ;
+
+// Added after the rest so modules built against the old layout still work
+
+  unsigned int (*digitalRead8) (struct wiringPiNodeStruct *node, int pin) ;
 } ;
 
 extern struct wiringPiNodeStruct *wiringPiNodes ;
 
 
+// wpiPinHandle:
+//	A pin that's been looked-up in advance by wpiPinOpen () so the
+//	inline wpiPinRead/wpiPinWrite functions below don't need to do the
+//	mode and table lookups on every call. On-board pins get pointers
+//	directly to the hardware registers, extension pins get their node.
+//	Handles are only valid until the next wiringPiSetup* call.
+
+struct wpiPinHandle
+{
+  int pin ;				// As given to wpiPinOpen ()
+  uint32_t mask ;			// Bit within the GPIO bank
+  volatile uint32_t *set ;		// NULL if not a memory-mapped pin
+  volatile uint32_t *clr ;
+  volatile uint32_t *lev ;
+  volatile uint32_t *pwm ;		// NULL if not a hardware PWM pin
+  struct wiringPiNodeStruct *node ;	// Extension module, or NULL
+} ;
+
+
+// wpiEdgeEvent:
+//	An edge on an input pin. In gpiochip mode the kernel timestamps it,
+//	otherwise it's when the interrupt dispatcher woke up - and the edge
+//	is worked out from the level read then, so with INT_EDGE_BOTH it
+//	can be wrong if the pin has already changed again.
+
+struct wpiEdgeEvent
+{
+  int      pin ;			// In the numbering it was set up with
+  int      edge ;			// INT_EDGE_RISING or INT_EDGE_FALLING
+  int      level ;			// HIGH or LOW, just after the edge
+  uint64_t ns ;				// When, on the CLOCK_MONOTONIC clock
+  uint32_t seq ;			// Per-pin count, to spot lost edges
+} ;
+
+struct wpiEventRing ;
+
+// wpiContext:
+//	One way in to the GPIO - mode, mapping and pin tables. The normal
+//	functions use the default one; see wiringPiContextCreate ()
+
+struct wpiContext ;
+
+// wpiState:
+//	A copy of the GPIO set-up, from wpiStateSave (). Register values,
+//	without the BCM password bits.
+
+#define	WPI_STATE_GPIO		1	// fsel, level and the pull-up/downs
+#define	WPI_STATE_PWM		2	// pwm and pwmClk
+#define	WPI_STATE_CLK		4	// gpClk
+#define	WPI_STATE_PADS		8
+
+struct wpiState
+{
+  uint32_t valid ;			// WPI_STATE_ bits for what we've got
+  uint32_t fsel     [6] ;
+  uint32_t level    [2] ;
+  uint32_t pudKnown [2] ;		// Pulls can't be read, so only the ones wiringPi set
+  uint32_t pudUp    [2] ;
+  uint32_t pudDown  [2] ;
+  uint32_t pwm      [5] ;		// Control, range 0, data 0, range 1, data 1
+  uint32_t pwmClk   [2] ;		// Control, divisor
+  uint32_t gpClk    [3][2] ;		// GPCLK0-2: control, divisor
+  uint32_t pads     [3] ;
+} ;
+
+// wpiPinMode:
+//	A pin and what to do with it, for setting up lots of pins at once.
+
+struct wpiPinMode
+{
+  int pin ;
+  int mode ;
+} ;
+
+
 // Function prototypes
 //	c++ wrappers thanks to a comment by Nick Lott
 //	(and others on the Raspberry Pi forums)
@@ -162,24 +253,47 @@ extern struct wiringPiNodeStruct *wiringPiNewNode  (int pinBase, int numPins) ;
 
 extern int  wiringPiSetup       (void) ;
 extern int  wiringPiSetupSys    (void) ;
+extern int  wiringPiSetupGpioChip (void) ;
 extern int  wiringPiSetupGpio   (void) ;
 extern int  wiringPiSetupPhys   (void) ;
 
 extern void pinModeAlt          (int pin, int mode) ;
 extern void pinMode             (int pin, int mode) ;
+extern void pinModeBulk         (const struct wpiPinMode *pins, int numPins) ;
+extern void pinModeAltBulk      (const struct wpiPinMode *pins, int numPins) ;
 extern void pullUpDnControl     (int pin, int pud) ;
+extern void pullUpDnControlBulk (const struct wpiPinMode *pins, int numPins) ;
 extern int  digitalRead         (int pin) ;
 extern void digitalWrite        (int pin, int value) ;
 extern void pwmWrite            (int pin, int value) ;
 extern int  analogRead          (int pin) ;
 extern void analogWrite         (int pin, int value) ;
 
+extern int  wpiPinOpen          (int pin, struct wpiPinHandle *handle) ;
+
 // PiFace specifics 
 //	(Deprecated)
 
 extern int  wiringPiSetupPiFace (void) ;
 extern int  wiringPiSetupPiFaceForGpioProg (void) ;	// Don't use this - for gpio program only
 
+// Contexts
+//	The _ctx functions act on the given context, the rest on the default.
+//	Other contexts always use BCM_GPIO pin numbers.
+
+extern struct wpiContext *wiringPiContextDefault (void) ;
+extern struct wpiContext *wiringPiContextCreate  (int mode, const char *device) ;
+extern void               wiringPiContextDestroy (struct wpiContext *ctx) ;
+
+extern void     pinMode_ctx           (struct wpiContext *ctx, int pin, int mode) ;
+extern void     pullUpDnControl_ctx   (struct wpiContext *ctx, int pin, int pud) ;
+extern int      digitalRead_ctx       (struct wpiContext *ctx, int pin) ;
+extern void     digitalWrite_ctx      (struct wpiContext *ctx, int pin, int value) ;
+extern void     digitalWriteBank_ctx  (struct wpiContext *ctx, int bank, uint32_t setMask, uint32_t clrMask) ;
+extern void     digitalWriteBanks_ctx (struct wpiContext *ctx, const uint32_t setMask [2], const uint32_t clrMask [2]) ;
+extern uint32_t digitalReadBank_ctx   (struct wpiContext *ctx, int bank) ;
+extern void     digitalReadBanks_ctx  (struct wpiContext *ctx, uint32_t levels [2]) ;
+
 // On-Board Raspberry Pi hardware specific stuff
 
 extern int  piBoardRev          (void) ;
@@ -195,11 +309,50 @@ extern void pwmSetRange         (unsigned int range) ;
 extern void pwmSetClock         (int divisor) ;
 extern void gpioClockSet        (int pin, int freq) ;
 
+// GPIO state save & restore
+
+extern int  wpiStateSave        (struct wpiState *state) ;
+extern int  wpiStateRestore     (const struct wpiState *state) ;
+extern int  wpiStateFormat      (const struct wpiState *state, char *buf, int size) ;
+extern int  wpiStateParse       (struct wpiState *state, const char *text) ;
+
+// Bank access
+//	The masks are in BCM_GPIO bit order - bank 0 is BCM_GPIO 0-31 and
+//	bank 1 is BCM_GPIO 32-53. Pin lists use the current pin numbering.
+
+extern int  digitalPinsToMask   (const int *pins, int numPins, uint64_t value, uint32_t setMask [2], uint32_t clrMask [2]) ;
+extern void digitalWriteBank    (int bank, uint32_t setMask, uint32_t clrMask) ;
+extern void digitalWriteBanks   (const uint32_t setMask [2], const uint32_t clrMask [2]) ;
+extern void digitalWritePins    (const int *pins, int numPins, uint64_t value) ;
+extern uint32_t digitalReadBank (int bank) ;
+extern void digitalReadBanks    (uint32_t levels [2]) ;
+extern unsigned int digitalReadByte (void) ;
+extern unsigned int digitalRead8    (int pin) ;
+
+// Hardware edge detect
+
+extern void     pinEdgeDetect   (int pin, int modes) ;
+extern uint32_t edgeDetectBank  (int bank, uint32_t mask) ;
+extern uint64_t edgeDetectPins  (const int *pins, int numPins) ;
+
 // Interrupts
 //	(Also Pi hardware specific)
 
 extern int  waitForInterrupt    (int pin, int mS) ;
 extern int  wiringPiISR         (int pin, int mode, void (*function)(void)) ;
+extern int  wiringPiISRex       (int pin, int mode, void (*function)(int pin, void *userData), void *userData) ;
+extern void wiringPiISRexCancel (int pin) ;
+extern int  wiringPiISRCapture  (int pin, int mode, struct wpiEventRing *ring) ;
+
+// Edge event rings, for wiringPiISRCapture
+//	Single producer, single consumer.
+
+extern struct wpiEventRing *wpiEventRingCreate (int size) ;
+extern void wpiEventRingDestroy   (struct wpiEventRing *ring) ;
+extern int  wpiEventRingPush      (struct wpiEventRing *ring, const struct wpiEdgeEvent *event) ;
+extern int  wpiEventRingRead      (struct wpiEventRing *ring, struct wpiEdgeEvent *events, int max) ;
+extern int  wpiEventRingWait      (struct wpiEventRing *ring, int mS) ;
+extern unsigned int wpiEventRingOverflows (struct wpiEventRing *ring) ;
 
 // Threads
 
@@ -217,6 +370,93 @@ extern void         delay             (unsigned int howLong) ;
 extern void         delayMicroseconds (unsigned int howLong) ;
 extern unsigned int millis            (void) ;
 extern unsigned int micros            (void) ;
+extern uint64_t     millis64          (void) ;
+extern uint64_t     micros64          (void) ;
+extern uint64_t     nanos             (void) ;
+
+// Absolute time delays
+//	Deadlines are in nanos () time.
+
+struct wpiPeriodic
+{
+  uint64_t     next ;			// Next deadline - set to 0 to start
+  unsigned int overruns ;		// Periods skipped because we were late
+} ;
+
+extern void         delayUntil        (uint64_t deadline) ;
+extern int          periodicNext      (struct wpiPeriodic *state, uint64_t period) ;
+extern unsigned int delayCalibrate    (void) ;
+extern unsigned int delayThreshold    (void) ;
+
+// Writing pins at given times
+//	The waiting and batching up the softPwm, softTone and digitalWriteAt ()
+//	threads share - see wpiWaitUntil () in wiringPi.c
+
+#define	WPI_NEVER	(~(uint64_t)0)
+
+struct wpiBatch
+{
+  uint32_t setMask [2] ;
+  uint32_t clrMask [2] ;
+  int      onBoard ;
+} ;
+
+extern void         wpiWaitInit       (pthread_cond_t *cond) ;
+extern int          wpiWaitUntil      (pthread_cond_t *cond, pthread_mutex_t *lock, uint64_t when) ;
+extern void         wpiBatchClear     (struct wpiBatch *batch) ;
+extern void         wpiBatchAdd       (struct wpiBatch *batch, int pin, int bank, uint32_t mask, int value) ;
+extern int          wpiBatchWrite     (const struct wpiBatch *batch) ;
+
+// Scheduled writes
+//	Also in nanos () time - see wiringPiTimed.c
+
+struct wpiTimedStats
+{
+  unsigned int depth ;			// Writes waiting now
+  unsigned int maxDepth ;		//	... and the most there's been
+  uint64_t     events ;			// Writes done
+  uint64_t     writes ;			// Times we've written to the pins
+  uint64_t     totalLate ;		// nS, summed over all the events
+  uint64_t     maxLate ;		// nS, the worst one
+} ;
+
+extern int          digitalWriteAt       (int pin, int value, uint64_t when) ;
+extern void         digitalWriteAtCancel (int pin) ;
+extern void         digitalWriteAtStats  (struct wpiTimedStats *stats) ;
+
+// Pin handles
+//	Anything that isn't a memory-mapped pin or a node pin (e.g. Sys mode)
+//	just goes through the normal functions, as do writes on the simulator.
+
+static inline int wpiPinRead (const struct wpiPinHandle *handle)
+{
+  if (handle->lev != NULL)
+    return (*handle->lev & handle->mask) != 0 ? HIGH : LOW ;
+  else if (handle->node != NULL)
+    return handle->node->digitalRead (handle->node, handle->pin) ;
+  else
+    return digitalRead (handle->pin) ;
+}
+
+static inline void wpiPinWrite (const struct wpiPinHandle *handle, int value)
+{
+  if (handle->set != NULL)
+    *(value == LOW ? handle->clr : handle->set) = handle->mask ;
+  else if (handle->node != NULL)
+    handle->node->digitalWrite (handle->node, handle->pin, value) ;
+  else
+    digitalWrite (handle->pin, value) ;
+}
+
+static inline void wpiPinPwmWrite (const struct wpiPinHandle *handle, int value)
+{
+  if (handle->pwm != NULL)
+    *handle->pwm = value ;
+  else if (handle->node != NULL)
+    handle->node->pwmWrite (handle->node, handle->pin, value) ;
+  else
+    pwmWrite (handle->pin, value) ;
+}
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,828 @@
+/*
+ * wiringPiChip.c:
+ *	GPIO character device (gpiochip) access for wiringPi.
+ *	Copyright (c) 2015 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+// This uses the Linux GPIO character device (the "v2" uAPI) rather than
+//	/sys/class/gpio. It doesn't need root, nothing needs exporting first
+//	and there is one file descriptor for the lot.
+//
+//	Lines (up to 64 of them) are requested the first time they're used -
+//	their mode, pull-up/down or edge is set, or a single line is read or
+//	written - leaving them as they are. All the lines we hold are in one
+//	request, so adding a line means giving the request back and asking
+//	again for the lot, with the outputs at their current levels. The
+//	lines are ours until wpiChipClose () - which wiringPiSetup* does when
+//	it's called again for another mode - but lines we never touch are
+//	left free for everyone else. A read or write of any number of the
+//	lines we hold is a single ioctl, and changing a line's mode,
+//	pull-up/down or edge is a re-configure of the whole request.
+//
+//	Edge events come in on the request's file descriptor, with the
+//	kernel's CLOCK_MONOTONIC timestamp. That changes when the request
+//	does, so it's kept in an epoll set, and that's what wpiChipFd ()
+//	gives out. As several threads may be waiting for different lines,
+//	wpiChipWait () has one of them read the events and hand them out to
+//	the rest.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <linux/gpio.h>
+
+#include "wiringPi.h"
+#include "wiringPiChip.h"
+
+#ifndef	TRUE
+#  define	TRUE	(1==1)
+#  define	FALSE	(1==2)
+#endif
+
+#define	MAX_LINES	GPIO_V2_LINES_MAX
+
+#define	DIRECTION	(GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_OUTPUT)
+#define	EDGES		(GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING)
+#define	BIAS		(GPIO_V2_LINE_FLAG_BIAS_PULL_UP | GPIO_V2_LINE_FLAG_BIAS_PULL_DOWN | GPIO_V2_LINE_FLAG_BIAS_DISABLED)
+
+struct wpiChip
+{
+  int      chipFd ;
+  int      reqFd ;			// -1 until we hold a line
+  int      pollFd ;			// epoll set with reqFd in it
+  int      chipLines ;			// On the chip, up to MAX_LINES
+  int      numLines ;			// In the request
+
+  uint64_t lines ;			// Line offsets we hold
+  uint64_t outputs ;			//	... and which are outputs
+  uint64_t busy ;			// Someone else had them when we asked
+  int      identity ;			// Request index == line offset
+  int      index  [MAX_LINES] ;		// Line offset -> request index
+  int      offset [MAX_LINES] ;		// Request index -> line offset
+  uint64_t flags  [MAX_LINES] ;		// Current config, by line offset
+
+  pthread_rwlock_t reqLock ;		// Held for writing while the request changes
+
+  pthread_mutex_t lock ;
+  pthread_cond_t  cond ;
+  int             reading ;
+  unsigned int    pending [MAX_LINES] ;	// Events not yet collected by wpiChipWait
+} ;
+
+
+/*
+ * toRequest: fromRequest:
+ *	Convert a mask of line offsets to request index bits and back again.
+ *********************************************************************************
+ */
+
+static uint64_t toRequest (struct wpiChip *chip, uint64_t lines)
+{
+  uint64_t bits = 0 ;
+
+  lines &= chip->lines ;
+  if (chip->identity)
+    return lines ;
+
+  for ( ; lines != 0 ; lines &= lines - 1)
+    bits |= (uint64_t)1 << chip->index [__builtin_ctzll (lines)] ;
+
+  return bits ;
+}
+
+static uint64_t fromRequest (struct wpiChip *chip, uint64_t bits)
+{
+  uint64_t lines = 0 ;
+
+  if (chip->identity)
+    return bits ;
+
+  for ( ; bits != 0 ; bits &= bits - 1)
+    lines |= (uint64_t)1 << chip->offset [__builtin_ctzll (bits)] ;
+
+  return lines ;
+}
+
+
+/*
+ * chipValues:
+ *	Read the levels of all the lines we hold, as a mask of line offsets.
+ *********************************************************************************
+ */
+
+static int chipValues (struct wpiChip *chip, uint64_t *levels)
+{
+  struct gpio_v2_line_values values ;
+
+  *levels = 0 ;
+  if (chip->numLines == 0)
+    return 0 ;
+
+  values.mask = toRequest (chip, chip->lines) ;
+  values.bits = 0 ;
+  if (ioctl (chip->reqFd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0)
+    return -1 ;
+
+  *levels = fromRequest (chip, values.bits) ;
+  return 0 ;
+}
+
+
+/*
+ * chipOutputs:
+ *	Work out which of the lines we hold are outputs
+ *********************************************************************************
+ */
+
+static void chipOutputs (struct wpiChip *chip)
+{
+  uint64_t todo, outputs = 0 ;
+  int line ;
+
+  for (todo = chip->lines ; todo != 0 ; todo &= todo - 1)
+  {
+    line = __builtin_ctzll (todo) ;
+    if ((chip->flags [line] & GPIO_V2_LINE_FLAG_OUTPUT) != 0)
+      outputs |= (uint64_t)1 << line ;
+  }
+
+  chip->outputs = outputs ;
+}
+
+
+/*
+ * chipConfig:
+ *	Build the config for the given lines from their flags. Lines with
+ *	the same flags share an attribute and the outputs are given the
+ *	levels asked for, so nothing glitches. Any other lines in the
+ *	request are left as they are.
+ *********************************************************************************
+ */
+
+static int chipConfig (struct wpiChip *chip, uint64_t lines, uint64_t levels, struct gpio_v2_line_config *config)
+{
+  uint64_t todo, same, outputs ;
+  int line, other, n ;
+
+  memset (config, 0, sizeof (struct gpio_v2_line_config)) ;
+
+  n       = 0 ;
+  outputs = 0 ;
+
+  for (todo = lines ; todo != 0 ; todo &= ~same)
+  {
+    line = __builtin_ctzll (todo) ;
+    same = 0 ;
+    for (other = line ; other < MAX_LINES ; ++other)
+      if (((todo & ((uint64_t)1 << other)) != 0) && (chip->flags [other] == chip->flags [line]))
+	same |= (uint64_t)1 << other ;
+
+    if (n == GPIO_V2_LINE_NUM_ATTRS_MAX - 1)	// Need one for the output values
+    {
+      errno = E2BIG ;
+      return -1 ;
+    }
+
+    config->attrs [n].attr.id    = GPIO_V2_LINE_ATTR_ID_FLAGS ;
+    config->attrs [n].attr.flags = chip->flags [line] ;
+    config->attrs [n].mask       = toRequest (chip, same) ;
+    ++n ;
+
+    if ((chip->flags [line] & GPIO_V2_LINE_FLAG_OUTPUT) != 0)
+      outputs |= same ;
+  }
+
+  if (outputs != 0)
+  {
+    config->attrs [n].attr.id     = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES ;
+    config->attrs [n].attr.values = toRequest (chip, levels & outputs) ;
+    config->attrs [n].mask        = toRequest (chip, outputs) ;
+    ++n ;
+  }
+
+  config->num_attrs = n ;
+  return 0 ;
+}
+
+
+/*
+ * chipConfigure:
+ *	Send the whole set of line flags to the kernel, keeping the outputs
+ *	at their current levels.
+ *	Called with the lock held.
+ *********************************************************************************
+ */
+
+static int chipConfigure (struct wpiChip *chip)
+{
+  struct gpio_v2_line_config config ;
+  uint64_t levels ;
+
+  if (chipValues (chip, &levels) < 0)
+    return -1 ;
+
+  if (chipConfig (chip, chip->lines, levels, &config) < 0)
+    return -1 ;
+
+  if (ioctl (chip->reqFd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config) < 0)
+    return -1 ;
+
+  chipOutputs (chip) ;
+  return 0 ;
+}
+
+
+/*
+ * chipMap:
+ *	Set up the offset <-> request index tables for a set of lines
+ *********************************************************************************
+ */
+
+static void chipMap (struct wpiChip *chip, uint64_t lines)
+{
+  int line ;
+
+  chip->lines    = lines ;
+  chip->numLines = 0 ;
+
+  for (line = 0 ; line < MAX_LINES ; ++line)
+  {
+    chip->index [line] = -1 ;
+    if ((lines & ((uint64_t)1 << line)) != 0)
+    {
+      chip->index  [line]           = chip->numLines ;
+      chip->offset [chip->numLines] = line ;
+      ++chip->numLines ;
+    }
+  }
+
+  chip->identity = (lines == ((chip->numLines == 64) ? ~(uint64_t)0 : (((uint64_t)1 << chip->numLines) - 1))) ;
+}
+
+
+/*
+ * chipGetLines:
+ *	Request a set of lines. The ones in known are set up from their
+ *	flags, with the outputs at the given levels; the rest are asked for
+ *	"as-is" - no direction flags means nothing is changed.
+ *********************************************************************************
+ */
+
+static int chipGetLines (struct wpiChip *chip, uint64_t lines, uint64_t known, uint64_t levels)
+{
+  struct gpio_v2_line_request req ;
+  struct epoll_event event ;
+  int i ;
+
+  chipMap (chip, lines) ;
+  chip->outputs = 0 ;
+
+  if (lines == 0)
+    return 0 ;
+
+  memset (&req, 0, sizeof (req)) ;
+
+  for (i = 0 ; i < chip->numLines ; ++i)
+    req.offsets [i] = chip->offset [i] ;
+  req.num_lines = chip->numLines ;
+  strncpy (req.consumer, "wiringPi", sizeof (req.consumer) - 1) ;
+
+  if (chipConfig (chip, known, levels, &req.config) < 0)
+    return -1 ;
+
+  if (ioctl (chip->chipFd, GPIO_V2_GET_LINE_IOCTL, &req) < 0)
+    return -1 ;
+
+  chip->reqFd = req.fd ;
+  (void)fcntl (chip->reqFd, F_SETFL, fcntl (chip->reqFd, F_GETFL) | O_NONBLOCK) ;
+
+  memset (&event, 0, sizeof (event)) ;
+  event.events = EPOLLIN ;
+  (void)epoll_ctl (chip->pollFd, EPOLL_CTL_ADD, chip->reqFd, &event) ;
+
+  chipOutputs (chip) ;
+  return 0 ;
+}
+
+
+/*
+ * chipRequest:
+ *	Add a line to the ones we hold: check it's free, note which way
+ *	it's set now, then give back the request and ask for the lot again.
+ *	If that fails, try to get back what we had. Edge events not yet read
+ *	from the old request are lost, so set lines up before waiting on them.
+ *	Called with the lock held.
+ *********************************************************************************
+ */
+
+static int chipRequest (struct wpiChip *chip, int line)
+{
+  struct gpio_v2_line_info lineInfo ;
+  uint64_t mask = (uint64_t)1 << line ;
+  uint64_t old, levels ;
+  int res, err ;
+
+  if ((chip->lines & mask) != 0)
+    return 0 ;
+
+  memset (&lineInfo, 0, sizeof (lineInfo)) ;
+  lineInfo.offset = line ;
+  if (ioctl (chip->chipFd, GPIO_V2_GET_LINEINFO_IOCTL, &lineInfo) < 0)
+    return -1 ;
+
+  if ((lineInfo.flags & GPIO_V2_LINE_FLAG_USED) != 0)
+  {
+    chip->busy |= mask ;
+    errno = EBUSY ;
+    return -1 ;
+  }
+
+  pthread_rwlock_wrlock (&chip->reqLock) ;
+
+  old = chip->lines ;
+  if ((res = chipValues (chip, &levels)) == 0)
+  {
+    if (chip->reqFd >= 0)
+    {
+      (void)epoll_ctl (chip->pollFd, EPOLL_CTL_DEL, chip->reqFd, NULL) ;
+      close (chip->reqFd) ;
+      chip->reqFd = -1 ;
+    }
+
+    chip->flags [line] = lineInfo.flags & DIRECTION ;
+
+    if ((res = chipGetLines (chip, old | mask, old, levels)) == 0)
+      chip->busy &= ~mask ;
+    else
+    {
+      err = errno ;
+      if (chipGetLines (chip, old, old, levels) < 0)
+	chipMap (chip, 0) ;
+      errno = err ;
+    }
+  }
+
+  pthread_rwlock_unlock (&chip->reqLock) ;
+
+  return res ;
+}
+
+
+/*
+ * chipHold:
+ *	Make sure we hold a line before reading or writing it. Lines someone
+ *	else had last time aren't asked for again here - only when their
+ *	mode, pull-up/down or edge is set.
+ *********************************************************************************
+ */
+
+static int chipHold (struct wpiChip *chip, int line)
+{
+  uint64_t mask = (uint64_t)1 << line ;
+  int res ;
+
+  if ((chip->lines & mask) != 0)
+    return 0 ;
+
+  if ((line >= chip->chipLines) || ((chip->busy & mask) != 0))
+    return -1 ;
+
+  pthread_mutex_lock (&chip->lock) ;
+    res = chipRequest (chip, line) ;
+  pthread_mutex_unlock (&chip->lock) ;
+
+  return res ;
+}
+
+
+/*
+ * chipSetFlags:
+ *	Change some of the flags for one line and tell the kernel, putting
+ *	them back if it didn't like it. We ask for the line first if we
+ *	don't hold it yet.
+ *********************************************************************************
+ */
+
+static int chipSetFlags (struct wpiChip *chip, int line, uint64_t clear, uint64_t set)
+{
+  uint64_t old ;
+  int res ;
+
+  if ((line < 0) || (line >= chip->chipLines))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  pthread_mutex_lock (&chip->lock) ;
+  if ((res = chipRequest (chip, line)) == 0)
+  {
+    old = chip->flags [line] ;
+    chip->flags [line] = (old & ~clear) | set ;
+    if ((res = chipConfigure (chip)) != 0)
+      chip->flags [line] = old ;
+  }
+  pthread_mutex_unlock (&chip->lock) ;
+
+  return res ;
+}
+
+
+/*
+ * wpiChipMode:
+ *	Make a line an INPUT or an OUTPUT. Anything else is ignored.
+ *********************************************************************************
+ */
+
+int wpiChipMode (struct wpiChip *chip, int line, int mode)
+{
+  /**/ if (mode == INPUT)
+    return chipSetFlags (chip, line, DIRECTION, GPIO_V2_LINE_FLAG_INPUT) ;
+  else if (mode == OUTPUT)
+    return chipSetFlags (chip, line, DIRECTION | EDGES, GPIO_V2_LINE_FLAG_OUTPUT) ;
+  else
+    return 0 ;
+}
+
+
+/*
+ * wpiChipPud:
+ *	Set the pull-up/down (bias) for a line
+ *********************************************************************************
+ */
+
+int wpiChipPud (struct wpiChip *chip, int line, int pud)
+{
+  /**/ if (pud == PUD_UP)
+    return chipSetFlags (chip, line, BIAS, GPIO_V2_LINE_FLAG_BIAS_PULL_UP) ;
+  else if (pud == PUD_DOWN)
+    return chipSetFlags (chip, line, BIAS, GPIO_V2_LINE_FLAG_BIAS_PULL_DOWN) ;
+  else
+    return chipSetFlags (chip, line, BIAS, GPIO_V2_LINE_FLAG_BIAS_DISABLED) ;
+}
+
+
+/*
+ * wpiChipEdge:
+ *	Set which edges of an input line make events. This also makes it
+ *	an input, and throws away anything still pending for wpiChipWait.
+ *	INT_EDGE_SETUP leaves it as it is.
+ *********************************************************************************
+ */
+
+int wpiChipEdge (struct wpiChip *chip, int line, int mode)
+{
+  uint64_t edges ;
+  int res ;
+
+  /**/ if (mode == INT_EDGE_SETUP)
+    return 0 ;
+  else if (mode == INT_EDGE_FALLING)
+    edges = GPIO_V2_LINE_FLAG_EDGE_FALLING ;
+  else if (mode == INT_EDGE_RISING)
+    edges = GPIO_V2_LINE_FLAG_EDGE_RISING ;
+  else
+    edges = EDGES ;
+
+  if ((res = chipSetFlags (chip, line, DIRECTION | EDGES, GPIO_V2_LINE_FLAG_INPUT | edges)) == 0)
+  {
+    pthread_mutex_lock (&chip->lock) ;
+      chip->pending [line] = 0 ;
+    pthread_mutex_unlock (&chip->lock) ;
+  }
+
+  return res ;
+}
+
+
+/*
+ * wpiChipRead: wpiChipWrite:
+ *	Read or write a single line
+ *********************************************************************************
+ */
+
+int wpiChipRead (struct wpiChip *chip, int line)
+{
+  struct gpio_v2_line_values values ;
+  int res = -1 ;
+
+  if ((line < 0) || (line >= MAX_LINES) || (chipHold (chip, line) < 0))
+    return LOW ;
+
+  pthread_rwlock_rdlock (&chip->reqLock) ;
+    if ((values.mask = toRequest (chip, (uint64_t)1 << line)) != 0)
+      res = ioctl (chip->reqFd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) ;
+  pthread_rwlock_unlock (&chip->reqLock) ;
+
+  if (res < 0)
+    return LOW ;
+
+  return (values.bits != 0) ? HIGH : LOW ;
+}
+
+void wpiChipWrite (struct wpiChip *chip, int line, int value)
+{
+  if ((line < 0) || (line >= MAX_LINES) || (chipHold (chip, line) < 0))
+    return ;
+
+  if (value == LOW)
+    wpiChipWriteLines (chip, 0, (uint64_t)1 << line) ;
+  else
+    wpiChipWriteLines (chip, (uint64_t)1 << line, 0) ;
+}
+
+
+/*
+ * wpiChipReadLines:
+ *	Read all the lines we hold in one go. Lines we don't hold read as 0.
+ *********************************************************************************
+ */
+
+uint64_t wpiChipReadLines (struct wpiChip *chip)
+{
+  uint64_t levels ;
+
+  pthread_rwlock_rdlock (&chip->reqLock) ;
+    (void)chipValues (chip, &levels) ;
+  pthread_rwlock_unlock (&chip->reqLock) ;
+
+  return levels ;
+}
+
+
+/*
+ * wpiChipWriteLines:
+ *	Set and clear any number of output lines in one go. As with the
+ *	bank writes, a line in both masks ends up set. Lines which aren't
+ *	outputs are left alone - the kernel would refuse the lot otherwise -
+ *	as are lines we don't hold yet: set their mode first.
+ *********************************************************************************
+ */
+
+void wpiChipWriteLines (struct wpiChip *chip, uint64_t setMask, uint64_t clrMask)
+{
+  struct gpio_v2_line_values values ;
+
+  pthread_rwlock_rdlock (&chip->reqLock) ;
+    if ((values.mask = toRequest (chip, (setMask | clrMask) & chip->outputs)) != 0)
+    {
+      values.bits = toRequest (chip, setMask) ;
+      (void)ioctl (chip->reqFd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) ;
+    }
+  pthread_rwlock_unlock (&chip->reqLock) ;
+}
+
+
+/*
+ * wpiChipEvents:
+ *	Take up to max edge events without waiting. Returns the number
+ *	taken, 0 if there weren't any, or -1 on error.
+ *	Don't mix this with wpiChipWait () - they'll steal each others events.
+ *********************************************************************************
+ */
+
+int wpiChipEvents (struct wpiChip *chip, struct wpiEdgeEvent *events, int max)
+{
+  struct gpio_v2_line_event buffer [16] ;
+  ssize_t got ;
+  int count, i ;
+
+  if (max > 16)
+    max = 16 ;
+
+  pthread_rwlock_rdlock (&chip->reqLock) ;
+    got = (chip->reqFd < 0) ? 0 : read (chip->reqFd, buffer, max * sizeof (struct gpio_v2_line_event)) ;
+  pthread_rwlock_unlock (&chip->reqLock) ;
+
+  if (got < 0)
+    return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1 ;
+
+  count = got / sizeof (struct gpio_v2_line_event) ;
+  for (i = 0 ; i < count ; ++i)
+  {
+    events [i].pin   = buffer [i].offset ;
+    events [i].edge  = (buffer [i].id == GPIO_V2_LINE_EVENT_RISING_EDGE) ? INT_EDGE_RISING : INT_EDGE_FALLING ;
+    events [i].level = (events [i].edge == INT_EDGE_RISING) ? HIGH : LOW ;
+    events [i].ns    = buffer [i].timestamp_ns ;
+    events [i].seq   = buffer [i].line_seqno ;
+  }
+
+  return count ;
+}
+
+
+/*
+ * wpiChipWait:
+ *	Wait for an edge event on one line, or mS milliseconds (-1 is forever).
+ *	Returns 1 if there was one (or more), 0 on timeout, -1 on error.
+ *	Whoever gets here first with nothing pending reads the events for
+ *	everyone; the others sleep until they've been handed out.
+ *********************************************************************************
+ */
+
+int wpiChipWait (struct wpiChip *chip, int line, int mS)
+{
+  struct wpiEdgeEvent events [16] ;
+  struct pollfd   polls ;
+  struct timespec now, deadline ;
+  int res = 0 ;
+  int count, i, left ;
+
+  if ((line < 0) || (line >= MAX_LINES))
+    return -1 ;
+
+  clock_gettime (CLOCK_MONOTONIC, &deadline) ;
+  if (mS > 0)
+  {
+    deadline.tv_sec  += mS / 1000 ;
+    deadline.tv_nsec += (mS % 1000) * 1000000 ;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+      deadline.tv_nsec -= 1000000000 ;
+      ++deadline.tv_sec ;
+    }
+  }
+
+  pthread_mutex_lock (&chip->lock) ;
+
+  while (chip->pending [line] == 0)
+  {
+    if (chip->reading)		// Someone else is reading - they'll let us know
+    {
+      if (mS < 0)
+	pthread_cond_wait (&chip->cond, &chip->lock) ;
+      else if (pthread_cond_timedwait (&chip->cond, &chip->lock, &deadline) == ETIMEDOUT)
+	break ;
+      continue ;
+    }
+
+    left = -1 ;
+    if (mS >= 0)
+    {
+      clock_gettime (CLOCK_MONOTONIC, &now) ;
+      left = (deadline.tv_sec - now.tv_sec) * 1000 + (deadline.tv_nsec - now.tv_nsec) / 1000000 ;
+      if (left < 0)
+	left = 0 ;
+    }
+
+    chip->reading = TRUE ;
+    pthread_mutex_unlock (&chip->lock) ;
+
+      polls.fd     = chip->pollFd ;
+      polls.events = POLLIN ;
+      res   = poll (&polls, 1, left) ;
+      count = (res > 0) ? wpiChipEvents (chip, events, 16) : 0 ;
+
+    pthread_mutex_lock (&chip->lock) ;
+    chip->reading = FALSE ;
+
+    for (i = 0 ; i < count ; ++i)
+      if (events [i].pin < MAX_LINES)
+	++chip->pending [events [i].pin] ;
+    pthread_cond_broadcast (&chip->cond) ;
+
+    if (res <= 0)
+      break ;
+  }
+
+  if (chip->pending [line] != 0)
+  {
+    chip->pending [line] = 0 ;
+    res = 1 ;
+  }
+
+  pthread_mutex_unlock (&chip->lock) ;
+
+  return res ;
+}
+
+
+/*
+ * wpiChipFd: wpiChipLines:
+ *	Return a file descriptor that's readable when there are edge events
+ *	(for poll/epoll - it's an epoll set, so it stays the same when the
+ *	request changes) and the mask of lines we hold.
+ *********************************************************************************
+ */
+
+int wpiChipFd (struct wpiChip *chip)
+{
+  return chip->pollFd ;
+}
+
+uint64_t wpiChipLines (struct wpiChip *chip)
+{
+  return chip->lines ;
+}
+
+
+/*
+ * wpiChipClose:
+ *	Give the lines back
+ *********************************************************************************
+ */
+
+void wpiChipClose (struct wpiChip *chip)
+{
+  if (chip == NULL)
+    return ;
+
+  if (chip->reqFd >= 0)
+    close (chip->reqFd) ;
+  close (chip->pollFd) ;
+  close (chip->chipFd) ;
+  pthread_cond_destroy   (&chip->cond) ;
+  pthread_mutex_destroy  (&chip->lock) ;
+  pthread_rwlock_destroy (&chip->reqLock) ;
+  free (chip) ;
+}
+
+
+/*
+ * chipFail:
+ *	Tidy up after a failed open, keeping errno for the caller
+ *********************************************************************************
+ */
+
+static struct wpiChip *chipFail (struct wpiChip *chip)
+{
+  int err = errno ;
+
+  if (chip->pollFd >= 0)
+    close (chip->pollFd) ;
+  if (chip->chipFd >= 0)
+    close (chip->chipFd) ;
+  free (chip) ;
+
+  errno = err ;
+  return NULL ;
+}
+
+
+/*
+ * wpiChipOpen:
+ *	Open a gpiochip device, e.g. /dev/gpiochip0. No lines are requested
+ *	until they're used.
+ *	Returns NULL on failure with errno set.
+ *********************************************************************************
+ */
+
+struct wpiChip *wpiChipOpen (const char *path)
+{
+  struct wpiChip *chip ;
+  struct gpiochip_info info ;
+  pthread_condattr_t condAttr ;
+
+  if ((chip = (struct wpiChip *)calloc (1, sizeof (struct wpiChip))) == NULL)
+    return NULL ;
+
+  chip->reqFd  = -1 ;
+  chip->pollFd = -1 ;
+
+  if ((chip->chipFd = open (path, O_RDWR | O_CLOEXEC)) < 0)
+    return chipFail (chip) ;
+
+  if (ioctl (chip->chipFd, GPIO_GET_CHIPINFO_IOCTL, &info) < 0)
+    return chipFail (chip) ;
+
+  if ((chip->pollFd = epoll_create1 (EPOLL_CLOEXEC)) < 0)
+    return chipFail (chip) ;
+
+  chip->chipLines = (info.lines > MAX_LINES) ? MAX_LINES : (int)info.lines ;
+  chipMap (chip, 0) ;
+
+  pthread_rwlock_init (&chip->reqLock, NULL) ;
+  pthread_mutex_init (&chip->lock, NULL) ;
+  pthread_condattr_init (&condAttr) ;
+  pthread_condattr_setclock (&condAttr, CLOCK_MONOTONIC) ;
+  pthread_cond_init (&chip->cond, &condAttr) ;
+  pthread_condattr_destroy (&condAttr) ;
+
+  return chip ;
+}
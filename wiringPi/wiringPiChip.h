@@ -0,0 +1,56 @@
+/*
+ * wiringPiChip.h:
+ *	GPIO character device (gpiochip) access for wiringPi.
+ *	Copyright (c) 2015 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <stdint.h>
+
+// Line numbers are the chip's line offsets - BCM_GPIO numbers on the Pi.
+//	Line masks are 64-bit, bit N is line N.
+
+struct wpiChip ;
+struct wpiEdgeEvent ;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern struct wpiChip *wpiChipOpen       (const char *path) ;
+extern void            wpiChipClose      (struct wpiChip *chip) ;
+extern uint64_t        wpiChipLines      (struct wpiChip *chip) ;
+
+extern int             wpiChipMode       (struct wpiChip *chip, int line, int mode) ;
+extern int             wpiChipPud        (struct wpiChip *chip, int line, int pud) ;
+extern int             wpiChipEdge       (struct wpiChip *chip, int line, int mode) ;
+
+extern int             wpiChipRead       (struct wpiChip *chip, int line) ;
+extern void            wpiChipWrite      (struct wpiChip *chip, int line, int value) ;
+extern uint64_t        wpiChipReadLines  (struct wpiChip *chip) ;
+extern void            wpiChipWriteLines (struct wpiChip *chip, uint64_t setMask, uint64_t clrMask) ;
+
+extern int             wpiChipFd         (struct wpiChip *chip) ;
+extern int             wpiChipEvents     (struct wpiChip *chip, struct wpiEdgeEvent *events, int max) ;
+extern int             wpiChipWait       (struct wpiChip *chip, int line, int mS) ;
+
+#ifdef __cplusplus
+}
+#endif
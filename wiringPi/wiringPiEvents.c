@@ -0,0 +1,204 @@
+/*
+ * wiringPiEvents.c:
+ *	Queues of timestamped edge events for wiringPi.
+ *	Copyright (c) 2015 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+// A ring is a fixed size, single producer/single consumer queue of
+//	struct wpiEdgeEvent. No locks: the producer (normally the interrupt
+//	dispatcher thread - see wiringPiISRCapture) only moves the head and
+//	the consumer only moves the tail. When it's full, new events are
+//	counted and thrown away rather than overwriting ones not yet read.
+//
+//	A consumer with nothing to do can sleep in wpiEventRingWait (); the
+//	producer only makes the system call to wake it if it's asleep.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include "wiringPi.h"
+
+#define	CACHE_LINE	64
+
+struct wpiEventRing
+{
+  unsigned int mask ;			// Size - 1, size is a power of 2
+  int          fd ;			// eventfd to wake a waiting consumer
+
+  unsigned int head     __attribute__ ((aligned (CACHE_LINE))) ;	// Producer
+  unsigned int overflows ;
+
+  unsigned int tail     __attribute__ ((aligned (CACHE_LINE))) ;	// Consumer
+  unsigned int waiting ;
+
+  struct wpiEdgeEvent events [] __attribute__ ((aligned (CACHE_LINE))) ;
+} ;
+
+
+/*
+ * wpiEventRingCreate:
+ *	Make a ring with room for at least size events.
+ *	Returns NULL on failure with errno set.
+ *********************************************************************************
+ */
+
+struct wpiEventRing *wpiEventRingCreate (int size)
+{
+  struct wpiEventRing *ring ;
+  unsigned int actual = 2 ;
+
+  while ((int)actual < size)
+    actual <<= 1 ;
+
+  if (posix_memalign ((void **)&ring, CACHE_LINE, sizeof (struct wpiEventRing) + actual * sizeof (struct wpiEdgeEvent)) != 0)
+    return NULL ;
+
+  if ((ring->fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+  {
+    free (ring) ;
+    return NULL ;
+  }
+
+  ring->mask      = actual - 1 ;
+  ring->head      = 0 ;
+  ring->tail      = 0 ;
+  ring->overflows = 0 ;
+  ring->waiting   = 0 ;
+
+  return ring ;
+}
+
+
+/*
+ * wpiEventRingDestroy:
+ *	Free a ring. Make sure nothing is still feeding it.
+ *********************************************************************************
+ */
+
+void wpiEventRingDestroy (struct wpiEventRing *ring)
+{
+  if (ring == NULL)
+    return ;
+
+  close (ring->fd) ;
+  free (ring) ;
+}
+
+
+/*
+ * wpiEventRingPush:
+ *	Producer side: Add an event. Returns 0, or -1 if the ring was full
+ *	and the event has been counted as an overflow.
+ *********************************************************************************
+ */
+
+int wpiEventRingPush (struct wpiEventRing *ring, const struct wpiEdgeEvent *event)
+{
+  unsigned int head = ring->head ;
+  uint64_t one = 1 ;
+
+  if (head - __atomic_load_n (&ring->tail, __ATOMIC_ACQUIRE) > ring->mask)
+  {
+    __atomic_add_fetch (&ring->overflows, 1, __ATOMIC_RELAXED) ;
+    return -1 ;
+  }
+
+  ring->events [head & ring->mask] = *event ;
+  __atomic_store_n (&ring->head, head + 1, __ATOMIC_SEQ_CST) ;
+
+  if (__atomic_load_n (&ring->waiting, __ATOMIC_SEQ_CST) != 0)
+    if (__atomic_exchange_n (&ring->waiting, 0, __ATOMIC_SEQ_CST) != 0)
+      (void)write (ring->fd, &one, sizeof (one)) ;
+
+  return 0 ;
+}
+
+
+/*
+ * wpiEventRingRead:
+ *	Consumer side: Take up to max events, oldest first, without waiting.
+ *	Returns the number taken.
+ *********************************************************************************
+ */
+
+int wpiEventRingRead (struct wpiEventRing *ring, struct wpiEdgeEvent *events, int max)
+{
+  unsigned int tail = ring->tail ;
+  unsigned int head = __atomic_load_n (&ring->head, __ATOMIC_ACQUIRE) ;
+  int count = 0 ;
+
+  while ((tail != head) && (count < max))
+    events [count++] = ring->events [tail++ & ring->mask] ;
+
+  __atomic_store_n (&ring->tail, tail, __ATOMIC_RELEASE) ;
+
+  return count ;
+}
+
+
+/*
+ * wpiEventRingWait:
+ *	Consumer side: Wait up to mS milliseconds (-1 is forever) for there
+ *	to be something to read. Returns 1 if there is, 0 if not.
+ *********************************************************************************
+ */
+
+int wpiEventRingWait (struct wpiEventRing *ring, int mS)
+{
+  struct pollfd polls ;
+  uint64_t count ;
+
+  if (__atomic_load_n (&ring->head, __ATOMIC_ACQUIRE) != ring->tail)
+    return 1 ;
+
+// Tell the producer we're going to sleep, then look again in case it
+//	got something in before it noticed.
+
+  __atomic_store_n (&ring->waiting, 1, __ATOMIC_SEQ_CST) ;
+
+  if (__atomic_load_n (&ring->head, __ATOMIC_SEQ_CST) == ring->tail)
+  {
+    polls.fd     = ring->fd ;
+    polls.events = POLLIN ;
+    if (poll (&polls, 1, mS) > 0)
+      (void)read (ring->fd, &count, sizeof (count)) ;
+  }
+
+  __atomic_store_n (&ring->waiting, 0, __ATOMIC_SEQ_CST) ;
+
+  return (__atomic_load_n (&ring->head, __ATOMIC_ACQUIRE) != ring->tail) ? 1 : 0 ;
+}
+
+
+/*
+ * wpiEventRingOverflows:
+ *	How many events have been thrown away because the ring was full
+ *********************************************************************************
+ */
+
+unsigned int wpiEventRingOverflows (struct wpiEventRing *ring)
+{
+  return __atomic_load_n (&ring->overflows, __ATOMIC_RELAXED) ;
+}
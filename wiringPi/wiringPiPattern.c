@@ -0,0 +1,435 @@
+/*
+ * wiringPiPattern.c:
+ *	Timed playback of GPIO output patterns for wiringPi.
+ *	Copyright (c) 2015 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+// Rather than a loop of digitalWrite () and delayMicroseconds (), where
+//	every delay adds its own error to the ones before, the pattern is
+//	worked out in advance as a list of steps, each a time offset and a
+//	pair of bank masks. One high priority thread then plays them against
+//	absolute deadlines (see delayUntil ()) with at most 4 register
+//	writes per step, and records how late each step went out.
+//
+//	One-shot mode plays the steps once, loop mode repeats them every
+//	length nS until stopped. Stream mode is double buffered: while one
+//	buffer plays, the next can be queued with wpiPatternQueue (), and it
+//	carries on from where the first left off. If the player runs dry,
+//	that's an underrun: it waits, then starts the next buffer as soon as
+//	it arrives. (So the end of a stream counts as one.)
+//
+//	The steps aren't copied - they, and the late [] arrays, must stay put
+//	until they've been played.
+//
+//	On the simulated hardware, every step is a write of its own, so the
+//	simulator's event log holds every change to the outputs, in order.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "wiringPi.h"
+#include "wiringPiPattern.h"
+
+#ifndef	TRUE
+#  define	TRUE	(1==1)
+#  define	FALSE	(!TRUE)
+#endif
+
+// How often a long wait between steps looks to see if we've been stopped
+
+#define	STOP_CHECK	10000000
+
+struct patternBuffer
+{
+  const struct wpiPatternStep *steps ;
+  int                          numSteps ;
+  uint64_t                     length ;
+  uint32_t                    *late ;
+} ;
+
+struct wpiPattern
+{
+  int          mode ;
+  volatile int stop ;
+  int          idle ;
+
+  pthread_t       thread ;
+  pthread_mutex_t lock ;
+  pthread_cond_t  cond ;
+
+  struct patternBuffer buffers [2] ;
+  int                  head ;		// Buffer playing (or next to play)
+  int                  count ;		// Buffers waiting to be played, including that one
+
+  struct wpiPatternStats stats ;
+} ;
+
+
+/*
+ * patternCheck:
+ *	Make sure the steps are in order and fit into the length, and work
+ *	out the length if it wasn't given.
+ *	Returns 0, or -1 with errno set.
+ *********************************************************************************
+ */
+
+static int patternCheck (const struct wpiPatternStep *steps, int numSteps, uint64_t *length)
+{
+  int i ;
+
+  if ((steps == NULL) || (numSteps <= 0))
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  for (i = 1 ; i < numSteps ; ++i)
+    if (steps [i].offset < steps [i - 1].offset)
+    {
+      errno = EINVAL ;
+      return -1 ;
+    }
+
+  /**/ if (*length == 0)
+    *length = steps [numSteps - 1].offset ;
+  else if (*length < steps [numSteps - 1].offset)
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * patternDelay:
+ *	Wait for the deadline, but keep an eye out for being stopped if
+ *	it's a long way off.
+ *********************************************************************************
+ */
+
+static void patternDelay (struct wpiPattern *pattern, uint64_t deadline)
+{
+  uint64_t now ;
+
+  while ((now = nanos ()) + STOP_CHECK < deadline)
+  {
+    if (pattern->stop)
+      return ;
+    delayUntil (now + STOP_CHECK) ;
+  }
+
+  delayUntil (deadline) ;
+}
+
+
+/*
+ * patternThread:
+ *	Play the buffers as they come
+ *********************************************************************************
+ */
+
+static void *patternThread (void *arg)
+{
+  struct wpiPattern *pattern = (struct wpiPattern *)arg ;
+  struct patternBuffer *buffer ;
+  uint64_t base, deadline, now, late, totalLate, maxLate ;
+  int i ;
+
+  (void)piHiPri (90) ;
+
+  base = nanos () ;
+
+  pthread_mutex_lock (&pattern->lock) ;
+
+  while (!pattern->stop)
+  {
+    if (pattern->count == 0)		// Stream mode and we've run dry
+    {
+      ++pattern->stats.underruns ;
+      pattern->idle = TRUE ;
+      pthread_cond_broadcast (&pattern->cond) ;
+
+      while ((pattern->count == 0) && !pattern->stop)
+	pthread_cond_wait (&pattern->cond, &pattern->lock) ;
+
+      pattern->idle = FALSE ;
+      if (pattern->stop)
+	break ;
+
+      base = nanos () ;			// Too late to keep to the old timeline
+    }
+
+    buffer = &pattern->buffers [pattern->head] ;
+    pthread_mutex_unlock (&pattern->lock) ;
+
+    totalLate = maxLate = 0 ;
+    for (i = 0 ; (i < buffer->numSteps) && !pattern->stop ; ++i)
+    {
+      deadline = base + buffer->steps [i].offset ;
+      patternDelay (pattern, deadline) ;
+      if (pattern->stop)
+	break ;
+
+      now = nanos () ;
+      digitalWriteBanks (buffer->steps [i].setMask, buffer->steps [i].clrMask) ;
+
+      late = (now > deadline) ? now - deadline : 0 ;
+      totalLate += late ;
+      if (late > maxLate)
+	maxLate = late ;
+      if (buffer->late != NULL)
+	buffer->late [i] = (late > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)late ;
+    }
+
+    base += buffer->length ;
+
+    pthread_mutex_lock (&pattern->lock) ;
+
+    pattern->stats.steps     += i ;
+    pattern->stats.totalLate += totalLate ;
+    if (maxLate > pattern->stats.maxLate)
+      pattern->stats.maxLate = maxLate ;
+
+    if (i < buffer->numSteps)		// Stopped part way through
+      break ;
+
+    ++pattern->stats.passes ;
+
+    if (pattern->mode == WPI_PATTERN_LOOP)
+      continue ;
+
+    pattern->head ^= 1 ;
+    --pattern->count ;
+    pthread_cond_broadcast (&pattern->cond) ;
+
+    if (pattern->mode == WPI_PATTERN_ONESHOT)
+      break ;
+  }
+
+  pattern->idle = TRUE ;
+  pthread_cond_broadcast (&pattern->cond) ;
+  pthread_mutex_unlock (&pattern->lock) ;
+
+  return NULL ;
+}
+
+
+/*
+ * wpiPatternStart:
+ *	Start playing a pattern of numSteps steps, in the given mode.
+ *	The steps must be in time order; length is the time (nS) from the
+ *	start of the pattern to the start of the next pass (loop mode) or
+ *	the next buffer (stream mode), 0 to use the offset of the last step.
+ *	If late isn't NULL, the lateness (nS) of each step is stored in it.
+ *	The GPIO pins must already be set up as outputs.
+ *	Returns NULL on failure with errno set.
+ *********************************************************************************
+ */
+
+struct wpiPattern *wpiPatternStart (int mode, const struct wpiPatternStep *steps, int numSteps, uint64_t length, uint32_t *late)
+{
+  struct wpiPattern *pattern ;
+  pthread_condattr_t attr ;
+  int res ;
+
+  if ((mode < WPI_PATTERN_ONESHOT) || (mode > WPI_PATTERN_STREAM))
+  {
+    errno = EINVAL ;
+    return NULL ;
+  }
+
+  if (patternCheck (steps, numSteps, &length) != 0)
+    return NULL ;
+
+  if ((mode == WPI_PATTERN_LOOP) && (length == 0))	// Would never sleep
+  {
+    errno = EINVAL ;
+    return NULL ;
+  }
+
+  if ((pattern = calloc (1, sizeof (struct wpiPattern))) == NULL)
+    return NULL ;
+
+  pattern->mode  = mode ;
+  pattern->head  = 0 ;
+  pattern->count = 1 ;
+
+  pattern->buffers [0].steps    = steps ;
+  pattern->buffers [0].numSteps = numSteps ;
+  pattern->buffers [0].length   = length ;
+  pattern->buffers [0].late     = late ;
+
+  pthread_mutex_init     (&pattern->lock, NULL) ;
+  pthread_condattr_init  (&attr) ;
+  pthread_condattr_setclock (&attr, CLOCK_MONOTONIC) ;
+  pthread_cond_init      (&pattern->cond, &attr) ;
+  pthread_condattr_destroy (&attr) ;
+
+  if ((res = pthread_create (&pattern->thread, NULL, patternThread, pattern)) != 0)
+  {
+    pthread_cond_destroy  (&pattern->cond) ;
+    pthread_mutex_destroy (&pattern->lock) ;
+    free (pattern) ;
+    errno = res ;
+    return NULL ;
+  }
+
+  return pattern ;
+}
+
+
+/*
+ * wpiPatternQueue:
+ *	Stream mode: Queue up the next buffer of steps, waiting until there's
+ *	room if both buffers are in use. When this returns, the buffer queued
+ *	the time before last has been played and can be re-used.
+ *	Offsets are from the start of this buffer.
+ *	Returns 0, or -1 with errno set.
+ *********************************************************************************
+ */
+
+int wpiPatternQueue (struct wpiPattern *pattern, const struct wpiPatternStep *steps, int numSteps, uint64_t length, uint32_t *late)
+{
+  struct patternBuffer *buffer ;
+
+  if (pattern->mode != WPI_PATTERN_STREAM)
+  {
+    errno = EINVAL ;
+    return -1 ;
+  }
+
+  if (patternCheck (steps, numSteps, &length) != 0)
+    return -1 ;
+
+  pthread_mutex_lock (&pattern->lock) ;
+
+  while ((pattern->count == 2) && !pattern->stop)
+    pthread_cond_wait (&pattern->cond, &pattern->lock) ;
+
+  if (pattern->stop)
+  {
+    pthread_mutex_unlock (&pattern->lock) ;
+    errno = ECANCELED ;
+    return -1 ;
+  }
+
+  buffer = &pattern->buffers [(pattern->head + pattern->count) & 1] ;
+  buffer->steps    = steps ;
+  buffer->numSteps = numSteps ;
+  buffer->length   = length ;
+  buffer->late     = late ;
+  ++pattern->count ;
+
+  pthread_cond_broadcast (&pattern->cond) ;
+  pthread_mutex_unlock (&pattern->lock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * wpiPatternWait:
+ *	Wait up to mS milliseconds (-1 is forever) for the player to finish:
+ *	the end of a one-shot pattern, or everything queued in stream mode.
+ *	(A loop never finishes.)
+ *	Returns 1 if it has, 0 if not.
+ *********************************************************************************
+ */
+
+int wpiPatternWait (struct wpiPattern *pattern, int mS)
+{
+  struct timespec until ;
+  int res = 0 ;
+
+  if (mS >= 0)
+  {
+    clock_gettime (CLOCK_MONOTONIC, &until) ;
+    until.tv_sec  += mS / 1000 ;
+    until.tv_nsec += (mS % 1000) * 1000000L ;
+    if (until.tv_nsec >= 1000000000L)
+    {
+      ++until.tv_sec ;
+      until.tv_nsec -= 1000000000L ;
+    }
+  }
+
+  pthread_mutex_lock (&pattern->lock) ;
+
+  while (!pattern->idle && (res == 0))
+  {
+    if (mS < 0)
+      res = pthread_cond_wait      (&pattern->cond, &pattern->lock) ;
+    else
+      res = pthread_cond_timedwait (&pattern->cond, &pattern->lock, &until) ;
+  }
+
+  res = pattern->idle ? 1 : 0 ;
+
+  pthread_mutex_unlock (&pattern->lock) ;
+
+  return res ;
+}
+
+
+/*
+ * wpiPatternStats:
+ *	How it's been going. These are updated at the end of each buffer or
+ *	pass through the pattern.
+ *********************************************************************************
+ */
+
+void wpiPatternStats (struct wpiPattern *pattern, struct wpiPatternStats *stats)
+{
+  pthread_mutex_lock   (&pattern->lock) ;
+    *stats = pattern->stats ;
+  pthread_mutex_unlock (&pattern->lock) ;
+}
+
+
+/*
+ * wpiPatternStop:
+ *	Stop playing (part way through if need be) and free the pattern.
+ *	The outputs are left as they were.
+ *********************************************************************************
+ */
+
+void wpiPatternStop (struct wpiPattern *pattern)
+{
+  if (pattern == NULL)
+    return ;
+
+  pthread_mutex_lock (&pattern->lock) ;
+    pattern->stop = TRUE ;
+    pthread_cond_broadcast (&pattern->cond) ;
+  pthread_mutex_unlock (&pattern->lock) ;
+
+  pthread_join (pattern->thread, NULL) ;
+
+  pthread_cond_destroy  (&pattern->cond) ;
+  pthread_mutex_destroy (&pattern->lock) ;
+  free (pattern) ;
+}
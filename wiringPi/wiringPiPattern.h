@@ -0,0 +1,67 @@
+/*
+ * wiringPiPattern.h:
+ *	Timed playback of GPIO output patterns for wiringPi.
+ *	Copyright (c) 2015 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <stdint.h>
+
+// Modes
+
+#define	WPI_PATTERN_ONESHOT	0
+#define	WPI_PATTERN_LOOP	1
+#define	WPI_PATTERN_STREAM	2
+
+// A step: at offset nS from the start of the pattern, clear the pins in
+//	clrMask then set the ones in setMask. Masks are per bank in BCM_GPIO
+//	order - see digitalPinsToMask ()
+
+struct wpiPatternStep
+{
+  uint64_t offset ;
+  uint32_t setMask [2] ;
+  uint32_t clrMask [2] ;
+} ;
+
+struct wpiPatternStats
+{
+  uint64_t     steps ;			// Steps played
+  uint64_t     totalLate ;		// nS, summed over all of them
+  uint64_t     maxLate ;		// nS, the worst one
+  unsigned int passes ;			// Times through a pattern/buffer
+  unsigned int underruns ;		// Stream mode: times we ran out
+} ;
+
+struct wpiPattern ;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern struct wpiPattern *wpiPatternStart (int mode, const struct wpiPatternStep *steps, int numSteps, uint64_t length, uint32_t *late) ;
+extern int                wpiPatternQueue (struct wpiPattern *pattern, const struct wpiPatternStep *steps, int numSteps, uint64_t length, uint32_t *late) ;
+extern int                wpiPatternWait  (struct wpiPattern *pattern, int mS) ;
+extern void               wpiPatternStats (struct wpiPattern *pattern, struct wpiPatternStats *stats) ;
+extern void               wpiPatternStop  (struct wpiPattern *pattern) ;
+
+#ifdef __cplusplus
+}
+#endif
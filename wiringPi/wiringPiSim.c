@@ -0,0 +1,430 @@
+/*
+ * wiringPiSim.c:
+ *	Simulated GPIO hardware for wiringPi.
+ *	Copyright (c) 2015 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+// This stands in for the GPIO, PWM, Clock and Pads register blocks when
+//	WIRINGPI_SIM is set in the environment, so wiringPi programs can be
+//	run (and timed) on any Linux box.
+//
+//	The blocks are just memory - anonymous, or a file if WIRINGPI_SIM
+//	is a pathname, so another program can watch or poke the "hardware".
+//	Writes to memory can't be trapped, so a model thread polls the
+//	registers: it moves GPSET/GPCLR writes into an output latch, works
+//	out GPLEV from that, the function selects and the pull-up/downs,
+//	and records every change to the GPFSEL and pull-up/down registers
+//	and to the output latch.
+//
+//	wiringPi's own pin writes don't go through GPSET/GPCLR though, as
+//	writes between two runs of the model would overwrite each other.
+//	They call wiringPiSimWrite () instead, which updates the latch and
+//	levels there and then, and records each write that changes the latch
+//	as an event of its own.
+//
+//	Anything else is seen when the model next runs, every SIM_INTERVAL
+//	uS, so a read straight after some other register write may see the
+//	old state - call wiringPiSimSync () first if you need to know.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "wiringPi.h"
+#include "wiringPiSim.h"
+
+#define	BLOCK_SIZE	(4*1024)
+
+#define	SIM_INTERVAL	50
+#define	SIM_EVENTS	1024
+
+// GPIO register (word) offsets
+
+#define	GPFSEL0		 0
+#define	GPSET0		 7
+#define	GPCLR0		10
+#define	GPLEV0		13
+#define	GPPUD		37
+#define	GPPUDCLK0	38
+
+struct wpiSim
+{
+  volatile uint32_t *block [WPI_SIM_BLOCKS] ;
+
+  pthread_mutex_t lock ;
+  pthread_t       thread ;
+
+  uint32_t latch    [2] ;	// Output latch, from GPSET/GPCLR
+  uint32_t driven   [2] ;	// Inputs driven by wiringPiSimInput ()
+  uint32_t inputs   [2] ;	//	... and their levels
+  uint32_t pullUp   [2] ;
+  uint32_t pullDown [2] ;
+
+  uint32_t fsel     [6] ;	// Last seen values
+  uint32_t gppud ;
+  uint32_t pudClk   [2] ;
+
+  struct wpiSimEvent events [SIM_EVENTS] ;
+  unsigned int       seq ;
+  unsigned int       head, tail ;
+} ;
+
+static struct wpiSim *defaultSim = NULL ;
+
+
+/*
+ * simLog:
+ *	Record an event, overwriting the oldest one if nobody is reading them.
+ *********************************************************************************
+ */
+
+static void simLog (struct wpiSim *sim, int type, int reg, uint32_t value)
+{
+  struct wpiSimEvent *event = &sim->events [sim->head % SIM_EVENTS] ;
+
+  event->seq   = sim->seq++ ;
+  event->type  = type ;
+  event->reg   = reg ;
+  event->value = value ;
+
+  if (++sim->head - sim->tail > SIM_EVENTS)
+    ++sim->tail ;
+}
+
+
+/*
+ * simLatch:
+ *	Apply one write of sets and clears to a bank's output latch.
+ *	Call with the lock held.
+ *********************************************************************************
+ */
+
+static void simLatch (struct wpiSim *sim, int bank, uint32_t set, uint32_t clr)
+{
+  uint32_t value = (sim->latch [bank] & ~clr) | set ;
+
+  if (value != sim->latch [bank])
+  {
+    sim->latch [bank] = value ;
+    simLog (sim, WPI_SIM_LATCH, bank, value) ;
+  }
+}
+
+
+/*
+ * simUpdate:
+ *	Run the model once - apply anything written to GPSET and GPCLR,
+ *	track the function select and pull-up/down registers and update
+ *	the levels. Call with the lock held.
+ *********************************************************************************
+ */
+
+static void simUpdate (struct wpiSim *sim)
+{
+  volatile uint32_t *gpio = sim->block [WPI_SIM_GPIO] ;
+  uint32_t set, clr, value, outputs, inputs ;
+  int bank, reg, pin ;
+
+  for (reg = 0 ; reg < 6 ; ++reg)
+    if ((value = gpio [GPFSEL0 + reg]) != sim->fsel [reg])
+    {
+      sim->fsel [reg] = value ;
+      simLog (sim, WPI_SIM_FSEL, reg, value) ;
+    }
+
+  if ((value = gpio [GPPUD]) != sim->gppud)
+  {
+    sim->gppud = value ;
+    simLog (sim, WPI_SIM_PUD, 0, value) ;
+  }
+
+  for (bank = 0 ; bank < 2 ; ++bank)
+  {
+
+// Pull up/down: The clock going high latches the current GPPUD setting
+
+    value = gpio [GPPUDCLK0 + bank] ;
+    if (value != sim->pudClk [bank])
+    {
+      sim->pudClk [bank] = value ;
+      simLog (sim, WPI_SIM_PUDCLK, bank, value) ;
+
+      sim->pullUp   [bank] &= ~value ;
+      sim->pullDown [bank] &= ~value ;
+      /**/ if ((sim->gppud & 3) == PUD_UP)
+	sim->pullUp   [bank] |= value ;
+      else if ((sim->gppud & 3) == PUD_DOWN)
+	sim->pullDown [bank] |= value ;
+    }
+
+// GPSET and GPCLR are write-only, so we take (and clear) what's been written
+
+    set = __atomic_exchange_n (&gpio [GPSET0 + bank], 0, __ATOMIC_SEQ_CST) ;
+    clr = __atomic_exchange_n (&gpio [GPCLR0 + bank], 0, __ATOMIC_SEQ_CST) ;
+    simLatch (sim, bank, set, clr) ;
+
+// Work out the levels: outputs show the latch, inputs are driven or pulled
+
+    outputs = 0 ;
+    for (pin = 0 ; pin < 32 ; ++pin)
+    {
+      reg = (bank * 32 + pin) / 10 ;
+      if (reg > 5)
+	break ;
+      if (((sim->fsel [reg] >> (((bank * 32 + pin) % 10) * 3)) & 7) == 1)
+	outputs |= 1 << pin ;
+    }
+
+    inputs = (sim->inputs [bank] & sim->driven [bank]) | (sim->pullUp [bank] & ~sim->driven [bank]) ;
+    gpio [GPLEV0 + bank] = (sim->latch [bank] & outputs) | (inputs & ~outputs) ;
+  }
+}
+
+
+/*
+ * wiringPiSimSync:
+ *	Make the model act on the registers now, rather than waiting for
+ *	its thread to get round to it.
+ *********************************************************************************
+ */
+
+void wiringPiSimSync (struct wpiSim *sim)
+{
+  pthread_mutex_lock (&sim->lock) ;
+    simUpdate (sim) ;
+  pthread_mutex_unlock (&sim->lock) ;
+}
+
+
+/*
+ * wiringPiSimWrite:
+ *	Set and clear pins in one bank, as a write to GPSET and GPCLR would,
+ *	but straight into the model, so the levels change now and every write
+ *	is seen - and recorded - on its own. The clears happen before the sets.
+ *********************************************************************************
+ */
+
+void wiringPiSimWrite (struct wpiSim *sim, int bank, uint32_t setMask, uint32_t clrMask)
+{
+  pthread_mutex_lock (&sim->lock) ;
+    simUpdate (sim) ;				// Anything poked into the registers goes first
+    simLatch  (sim, bank & 1, setMask, clrMask) ;
+    simUpdate (sim) ;
+  pthread_mutex_unlock (&sim->lock) ;
+}
+
+
+/*
+ * wiringPiSimInput:
+ *	Drive an input pin (BCM_GPIO numbering) from "outside". A value
+ *	of -1 lets it go again, so it floats back to its pull-up/down.
+ *********************************************************************************
+ */
+
+void wiringPiSimInput (struct wpiSim *sim, int gpioPin, int value)
+{
+  int      bank = (gpioPin >> 5) & 1 ;
+  uint32_t mask = 1 << (gpioPin & 31) ;
+
+  pthread_mutex_lock (&sim->lock) ;
+    if (value < 0)
+      sim->driven [bank] &= ~mask ;
+    else
+    {
+      sim->driven [bank] |= mask ;
+      if (value == LOW)
+	sim->inputs [bank] &= ~mask ;
+      else
+	sim->inputs [bank] |=  mask ;
+    }
+  pthread_mutex_unlock (&sim->lock) ;
+
+  wiringPiSimSync (sim) ;
+}
+
+
+/*
+ * wiringPiSimEvents:
+ *	Take up to max of the recorded events, oldest first.
+ *	Returns the number taken.
+ *********************************************************************************
+ */
+
+int wiringPiSimEvents (struct wpiSim *sim, struct wpiSimEvent *events, int max)
+{
+  int count = 0 ;
+
+  pthread_mutex_lock (&sim->lock) ;
+    while ((count < max) && (sim->tail != sim->head))
+      events [count++] = sim->events [sim->tail++ % SIM_EVENTS] ;
+  pthread_mutex_unlock (&sim->lock) ;
+
+  return count ;
+}
+
+
+/*
+ * wiringPiSimBlock:
+ *	Return the memory standing in for one of the register blocks
+ *********************************************************************************
+ */
+
+volatile uint32_t *wiringPiSimBlock (struct wpiSim *sim, int block)
+{
+  if ((block < 0) || (block >= WPI_SIM_BLOCKS))
+    return NULL ;
+
+  return sim->block [block] ;
+}
+
+
+/*
+ * wiringPiSim:
+ *	Return the simulator that wiringPiSetup () is using, if any.
+ *********************************************************************************
+ */
+
+struct wpiSim *wiringPiSim (void)
+{
+  return defaultSim ;
+}
+
+
+/*
+ * simThread:
+ *	Keep the model ticking over
+ *********************************************************************************
+ */
+
+static void *simThread (void *arg)
+{
+  struct wpiSim *sim = (struct wpiSim *)arg ;
+  struct timespec sleeper ;
+
+  sleeper.tv_sec  = 0 ;
+  sleeper.tv_nsec = SIM_INTERVAL * 1000 ;
+
+  for (;;)
+  {
+    wiringPiSimSync (sim) ;
+    nanosleep (&sleeper, NULL) ;
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * wiringPiSimCreate:
+ *	Create a simulated set of register blocks and start the model.
+ *	If backing is a pathname, the blocks live in that file, otherwise
+ *	they're anonymous memory.
+ *	Returns NULL on failure with errno set.
+ *********************************************************************************
+ */
+
+struct wpiSim *wiringPiSimCreate (const char *backing)
+{
+  struct wpiSim *sim ;
+  volatile uint32_t *gpio ;
+  uint8_t *mem = MAP_FAILED ;
+  int fd, block, reg ;
+
+  if ((sim = (struct wpiSim *)calloc (1, sizeof (struct wpiSim))) == NULL)
+    return NULL ;
+
+  if ((backing != NULL) && (backing [0] == '/'))
+  {
+    if ((fd = open (backing, O_RDWR | O_CREAT | O_CLOEXEC, 0666)) >= 0)
+    {
+      if (ftruncate (fd, WPI_SIM_BLOCKS * BLOCK_SIZE) == 0)
+	mem = (uint8_t *)mmap (0, WPI_SIM_BLOCKS * BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0) ;
+      close (fd) ;
+    }
+  }
+  else
+    mem = (uint8_t *)mmap (0, WPI_SIM_BLOCKS * BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0) ;
+
+  if (mem == MAP_FAILED)
+  {
+    free (sim) ;
+    return NULL ;
+  }
+
+  for (block = 0 ; block < WPI_SIM_BLOCKS ; ++block)
+    sim->block [block] = (volatile uint32_t *)(mem + block * BLOCK_SIZE) ;
+
+// Start from whatever is there (a re-used file may not be all zeros)
+//	without recording it as a change
+
+  gpio = sim->block [WPI_SIM_GPIO] ;
+  for (reg = 0 ; reg < 6 ; ++reg)
+    sim->fsel [reg] = gpio [GPFSEL0 + reg] ;
+  sim->gppud      = gpio [GPPUD] ;
+  sim->pudClk [0] = gpio [GPPUDCLK0] ;
+  sim->pudClk [1] = gpio [GPPUDCLK0 + 1] ;
+  sim->latch  [0] = gpio [GPLEV0] ;
+  sim->latch  [1] = gpio [GPLEV0 + 1] ;
+
+  pthread_mutex_init (&sim->lock, NULL) ;
+  wiringPiSimSync (sim) ;
+
+  if ((errno = pthread_create (&sim->thread, NULL, simThread, sim)) != 0)
+  {
+    munmap (mem, WPI_SIM_BLOCKS * BLOCK_SIZE) ;
+    free (sim) ;
+    return NULL ;
+  }
+
+  if (defaultSim == NULL)
+    defaultSim = sim ;
+
+  return sim ;
+}
+
+
+/*
+ * wiringPiSimDestroy:
+ *	Stop the model and free the simulator. Nothing else must be using it.
+ *********************************************************************************
+ */
+
+void wiringPiSimDestroy (struct wpiSim *sim)
+{
+  if (sim == NULL)
+    return ;
+
+  pthread_cancel (sim->thread) ;
+  pthread_join   (sim->thread, NULL) ;
+
+  if (defaultSim == sim)
+    defaultSim = NULL ;
+
+  munmap ((void *)sim->block [0], WPI_SIM_BLOCKS * BLOCK_SIZE) ;
+  pthread_mutex_destroy (&sim->lock) ;
+  free (sim) ;
+}
@@ -0,0 +1,67 @@
+/*
+ * wiringPiSim.h:
+ *	Simulated GPIO hardware for wiringPi.
+ *	Copyright (c) 2015 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <stdint.h>
+
+// Register blocks
+
+#define	WPI_SIM_GPIO		0
+#define	WPI_SIM_PWM		1
+#define	WPI_SIM_CLK		2
+#define	WPI_SIM_PADS		3
+#define	WPI_SIM_BLOCKS		4
+
+// Event types recorded by the model
+
+#define	WPI_SIM_FSEL		0	// reg = GPFSEL 0-5, value = new contents
+#define	WPI_SIM_PUD		1	// value = new GPPUD contents
+#define	WPI_SIM_PUDCLK		2	// reg = bank 0-1, value = GPPUDCLK contents
+#define	WPI_SIM_LATCH		3	// reg = bank 0-1, value = new output latch
+
+struct wpiSimEvent
+{
+  unsigned int seq ;
+  int          type ;
+  int          reg ;
+  uint32_t     value ;
+} ;
+
+struct wpiSim ;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern struct wpiSim     *wiringPiSimCreate (const char *backing) ;
+extern void               wiringPiSimDestroy (struct wpiSim *sim) ;
+extern struct wpiSim     *wiringPiSim       (void) ;
+extern volatile uint32_t *wiringPiSimBlock  (struct wpiSim *sim, int block) ;
+extern void               wiringPiSimSync   (struct wpiSim *sim) ;
+extern void               wiringPiSimWrite  (struct wpiSim *sim, int bank, uint32_t setMask, uint32_t clrMask) ;
+extern void               wiringPiSimInput  (struct wpiSim *sim, int gpioPin, int value) ;
+extern int                wiringPiSimEvents (struct wpiSim *sim, struct wpiSimEvent *events, int max) ;
+
+#ifdef __cplusplus
+}
+#endif
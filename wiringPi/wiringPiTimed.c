@@ -0,0 +1,317 @@
+/*
+ * wiringPiTimed.c:
+ *	Writes scheduled for a future time.
+ *	Copyright (c) 2015 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+// digitalWriteAt () queues a write for the time given, and one timer
+//	thread does them all: it keeps the pending writes in a heap, sleeps
+//	until just before the earliest is due, then busy-waits the rest of
+//	the way (see wpiWaitUntil ()), so the caller's own scheduling latency
+//	doesn't come into it.
+//
+//	Writes for the same time go out together, so writes for the same
+//	time on the same bank are a single register write (or ioctl, in
+//	gpiochip mode). If the thread wakes late, writes for later times that
+//	are already due still go out one time at a time, in order, so a short
+//	pulse isn't lost. Pins that aren't on-board are written one at a time
+//	with digitalWrite ().
+//
+//	Writes for the same pin at the same time are done in the order they
+//	were queued, so the last one wins.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "wiringPi.h"
+
+#ifndef	TRUE
+#  define	TRUE	(1==1)
+#  define	FALSE	(!TRUE)
+#endif
+
+#define	HEAP_START	64
+
+struct timedWrite
+{
+  uint64_t     when ;
+  unsigned int seq ;		// Keeps writes for the same time in order
+  int          pin ;
+  int          value ;
+  int          bank ;
+  uint32_t     mask ;		// 0 if it's not an on-board pin
+} ;
+
+static pthread_mutex_t timedLock = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t  timedCond ;
+static int             timedRunning = FALSE ;
+
+static struct timedWrite *heap    = NULL ;
+static unsigned int       heapLen = 0 ;
+static unsigned int       heapMax = 0 ;
+static unsigned int       nextSeq = 0 ;
+
+static struct wpiTimedStats stats ;
+
+
+/*
+ * before:
+ *	Heap order: earliest first, then first queued
+ *********************************************************************************
+ */
+
+static inline int before (const struct timedWrite *a, const struct timedWrite *b)
+{
+  if (a->when != b->when)
+    return a->when < b->when ;
+
+  return (int)(a->seq - b->seq) < 0 ;
+}
+
+
+/*
+ * heapUp: heapDown:
+ *	Restore the heap after adding at the end or replacing the top
+ *********************************************************************************
+ */
+
+static void heapUp (unsigned int i)
+{
+  struct timedWrite t = heap [i] ;
+  unsigned int parent ;
+
+  while (i > 0)
+  {
+    parent = (i - 1) / 2 ;
+    if (!before (&t, &heap [parent]))
+      break ;
+    heap [i] = heap [parent] ;
+    i = parent ;
+  }
+  heap [i] = t ;
+}
+
+static void heapDown (unsigned int i)
+{
+  struct timedWrite t = heap [i] ;
+  unsigned int child ;
+
+  for (;;)
+  {
+    child = 2 * i + 1 ;
+    if (child >= heapLen)
+      break ;
+    if ((child + 1 < heapLen) && before (&heap [child + 1], &heap [child]))
+      ++child ;
+    if (!before (&heap [child], &t))
+      break ;
+    heap [i] = heap [child] ;
+    i = child ;
+  }
+  heap [i] = t ;
+}
+
+
+/*
+ * heapPop:
+ *	Take the earliest write off the heap
+ *********************************************************************************
+ */
+
+static struct timedWrite heapPop (void)
+{
+  struct timedWrite top = heap [0] ;
+
+  if (--heapLen > 0)
+  {
+    heap [0] = heap [heapLen] ;
+    heapDown (0) ;
+  }
+
+  return top ;
+}
+
+
+/*
+ * timedThread:
+ *	Wait for the next write to be due, then do it, and everything else
+ *	queued for the same time.
+ *********************************************************************************
+ */
+
+static void *timedThread (void *arg)
+{
+  struct timedWrite item ;
+  struct wpiBatch batch ;
+  uint64_t when, now, late ;
+
+  (void)piHiPri (90) ;
+  (void)delayThreshold () ;		// Calibrate now, not with the lock held
+
+  pthread_mutex_lock (&timedLock) ;
+
+  for (;;)
+  {
+
+// Not due yet? Wait, but look again if an earlier one gets queued
+
+    when = (heapLen == 0) ? WPI_NEVER : heap [0].when ;
+    if (!wpiWaitUntil (&timedCond, &timedLock, when))
+      continue ;
+
+// Gather up everything for the same time
+
+    wpiBatchClear (&batch) ;
+    now = nanos () ;
+
+    while ((heapLen > 0) && (heap [0].when == when))
+    {
+      item = heapPop () ;
+      wpiBatchAdd (&batch, item.pin, item.bank, item.mask, item.value) ;
+
+      late = now - item.when ;
+      ++stats.events ;
+      stats.totalLate += late ;
+      if (late > stats.maxLate)
+	stats.maxLate = late ;
+    }
+
+    if (wpiBatchWrite (&batch))
+      ++stats.writes ;
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * digitalWriteAt:
+ *	Write value to pin when nanos () gets to when. If that's already
+ *	gone, it's written as soon as possible (and counted as late).
+ *	Returns 0, or -1 with errno set.
+ *********************************************************************************
+ */
+
+int digitalWriteAt (int pin, int value, uint64_t when)
+{
+  struct timedWrite *newHeap ;
+  struct timedWrite item ;
+  uint32_t setMask [2], clrMask [2] ;
+  pthread_t myThread ;
+  int res ;
+
+  item.when  = when ;
+  item.pin   = pin ;
+  item.value = value ;
+  item.bank  = 0 ;
+  item.mask  = 0 ;
+
+  if (digitalPinsToMask (&pin, 1, value == LOW ? 0 : 1, setMask, clrMask) == 0)
+  {
+    item.bank = ((setMask [1] | clrMask [1]) != 0) ? 1 : 0 ;
+    item.mask = setMask [item.bank] | clrMask [item.bank] ;
+  }
+
+  pthread_mutex_lock (&timedLock) ;
+
+  if (!timedRunning)
+  {
+    wpiWaitInit (&timedCond) ;
+
+    if ((res = pthread_create (&myThread, NULL, timedThread, NULL)) != 0)
+    {
+      pthread_cond_destroy (&timedCond) ;
+      pthread_mutex_unlock (&timedLock) ;
+      errno = res ;
+      return -1 ;
+    }
+    pthread_detach (myThread) ;
+    timedRunning = TRUE ;
+  }
+
+  if (heapLen == heapMax)
+  {
+    if ((newHeap = realloc (heap, (heapMax == 0 ? HEAP_START : heapMax * 2) * sizeof (struct timedWrite))) == NULL)
+    {
+      pthread_mutex_unlock (&timedLock) ;
+      return -1 ;
+    }
+    heap     = newHeap ;
+    heapMax  = (heapMax == 0) ? HEAP_START : heapMax * 2 ;
+  }
+
+  item.seq = nextSeq++ ;
+  heap [heapLen++] = item ;
+  heapUp (heapLen - 1) ;
+
+  if (heapLen > stats.maxDepth)
+    stats.maxDepth = heapLen ;
+
+  if (heap [0].seq == item.seq)	// New earliest - the thread needs to know
+    pthread_cond_signal (&timedCond) ;
+
+  pthread_mutex_unlock (&timedLock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * digitalWriteAtCancel:
+ *	Forget any writes still waiting for pin, or all of them if pin is -1
+ *********************************************************************************
+ */
+
+void digitalWriteAtCancel (int pin)
+{
+  unsigned int i, kept = 0 ;
+
+  pthread_mutex_lock (&timedLock) ;
+
+  for (i = 0 ; i < heapLen ; ++i)
+    if ((pin != -1) && (heap [i].pin != pin))
+      heap [kept++] = heap [i] ;
+
+  heapLen = kept ;
+  for (i = heapLen / 2 ; i-- > 0 ; )
+    heapDown (i) ;
+
+  pthread_mutex_unlock (&timedLock) ;
+}
+
+
+/*
+ * digitalWriteAtStats:
+ *	How deep the queue is and how late the writes have been
+ *********************************************************************************
+ */
+
+void digitalWriteAtStats (struct wpiTimedStats *result)
+{
+  pthread_mutex_lock (&timedLock) ;
+    stats.depth = heapLen ;
+    *result     = stats ;
+  pthread_mutex_unlock (&timedLock) ;
+}